@@ -0,0 +1,116 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   block_cache.h
+
+    Cache of blocks read from the data files of tiles, with CLOCK eviction
+*/
+
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr size_t MIN_CACHE_BLOCK_BYTES { 4096 };        ///< smallest permitted block
+constexpr size_t MAX_CACHE_BLOCK_BYTES { 65536 };       ///< largest permitted block
+
+// -----------  block_cache ----------------
+
+/*! \class  block_cache
+    \brief  A fixed number of equal-sized blocks of float values, indexed by file and block number, with CLOCK eviction
+
+    An object is intended to be used by a single thread; it is NOT thread-safe. Nothing is allocated after construction.
+*/
+
+class block_cache
+{
+protected:
+
+  size_t _block_bytes;                      ///< size of each block, in bytes
+  size_t _n_slots;                          ///< number of blocks that may be held
+
+  std::vector<float>    _values;            ///< the blocks, one after another
+  std::vector<uint64_t> _file_ids;          ///< file identifier of the block in each slot; zero if the slot is empty
+  std::vector<uint64_t> _block_nrs;         ///< block number of the block in each slot
+  std::vector<uint8_t>  _referenced;        ///< CLOCK reference bit of each slot
+
+  std::vector<int32_t>  _index;             ///< open-addressed hash table of slot numbers; -1 if empty
+  size_t                _index_mask;        ///< size of _index - 1 (the size is a power of two)
+
+  size_t _hand { 0 };                       ///< the CLOCK hand
+
+  uint64_t _hits   { 0 };                   ///< number of lookups that found the block
+  uint64_t _misses { 0 };                   ///< number of lookups that did not find the block
+
+/*! \brief              The first position in _index at which to look for a block
+    \param  file_id     identifier of the file
+    \param  block_nr    number of the block
+    \return             the home position of the block in _index
+*/
+  inline const size_t _home(const uint64_t file_id, const uint64_t block_nr) const
+  { uint64_t h { (file_id * 0x9E3779B97F4A7C15ull) ^ (block_nr * 0xC2B2AE3D27D4EB4Full) };
+
+    h ^= (h >> 29);
+
+    return (h & _index_mask);
+  }
+
+/*! \brief          Remove a slot from _index
+    \param  slot    the slot to remove
+*/
+  void _unindex(const int32_t slot);
+
+public:
+
+/*! \brief                  Constructor
+    \param  block_bytes     size of each block, in bytes; rounded to a power of two between MIN_CACHE_BLOCK_BYTES and MAX_CACHE_BLOCK_BYTES
+    \param  budget_bytes    maximum memory to use for the blocks, in bytes; at least one block is always held
+*/
+  block_cache(const size_t block_bytes, const size_t budget_bytes);
+
+/// size of each block, in bytes
+  inline const size_t block_bytes(void) const
+    { return _block_bytes; }
+
+/// number of blocks that may be held
+  inline const size_t n_slots(void) const
+    { return _n_slots; }
+
+/*! \brief              Find a block
+    \param  file_id     identifier of the file (non-zero)
+    \param  block_nr    number of the block
+    \return             pointer to the values in the block; nullptr if the block is not in the cache
+*/
+  const float* find(const uint64_t file_id, const uint64_t block_nr);
+
+/*! \brief              Make room for a block, evicting another if necessary
+    \param  file_id     identifier of the file (non-zero)
+    \param  block_nr    number of the block
+    \return             pointer to the space for the values in the block, which the caller must fill
+
+    The block MUST NOT already be in the cache
+*/
+  float* insert(const uint64_t file_id, const uint64_t block_nr);
+
+/*! \brief      Take the count of hits
+    \return     the number of hits since the last call
+*/
+  inline const uint64_t take_hits(void)
+    { const uint64_t rv { _hits };
+
+      _hits = 0;
+      return rv;
+    }
+
+/// number of lookups that did not find the block
+  inline const uint64_t misses(void) const
+    { return _misses; }
+};
+
+#endif    // BLOCK_CACHE_H
@@ -0,0 +1,47 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   coverage.h
+
+    The number of sites from which each cell of a plot is visible
+*/
+
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include "fields.h"
+#include "plot_geometry.h"
+#include "site_search.h"
+
+#include <vector>
+
+using coverage_field = std::vector<std::vector<int>>;     ///< number of sites from which each cell is visible, indexed as [row][column], with rows from S to N and columns from W to E
+
+/*! \brief                  The distance from the centre of a plot within which the terrain is needed to calculate its coverage
+    \param  centre          latitude and longitude of the centre of the plot
+    \param  distance_scale  radius of the plot, in metres
+    \param  sites           the sites
+    \return                 the distance from the centre of the plot to the farthest site, plus the distance to a corner of the plot, in metres
+*/
+const double coverage_reach(const std::pair<double, double>& centre, const double distance_scale, const std::vector<site_candidate>& sites);
+
+/*! \brief              Calculate the number of sites from which each cell of a plot is visible
+    \param  tiles       the tiles that contain the plot and the terrain between it and the sites
+    \param  req         the parameters of the plot; <i>req.qth</i> is its centre, and <i>req.antenna_height</i> is used at every site
+    \param  sites       the sites
+    \param  n_threads   the number of threads to use
+    \param  geometry    the geometry of the cells of the plot
+    \return             the coverage of the plot
+
+    The visibility from each site is calculated by sweeping outwards along bearings from the site (see polar_field), far enough to
+    reach every cell of the plot; each cell then takes the visibility of the nearest sample of the sweep. The sites are taken in turn,
+    each using all the threads. Sites at which the height of the terrain is unknown are ignored.
+*/
+const coverage_field calculate_coverage(const tile_map& tiles, const field_request& req, const std::vector<site_candidate>& sites, const unsigned int n_threads,
+                                        const plot_geometry& geometry);
+
+#endif    // COVERAGE_H
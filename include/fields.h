@@ -0,0 +1,209 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   fields.h
+
+    Calculation of the per-cell fields (height, elevation angle, gradient and line of sight) for a plot
+*/
+
+#ifndef FIELDS_H
+#define FIELDS_H
+
+#include "grid_float.h"
+#include "plot_geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+enum class VISIBILITY { UNKNOWN,
+                        VISIBLE,
+                        NOT_VISIBLE
+                      };
+
+/// the ways of calculating the gradient field
+enum class GRADIENT_METHOD { SAMPLE,           ///< sample the terrain ±10m along the bearing from the QTH (the reference)
+                             STENCIL           ///< directional derivative of the completed height field
+                           };
+
+using tile_map = std::map<int /* lat-long code */, grid_float_tile>;      ///< tiles, referenced by their lat-long codes [lat * 1000 + (+ve)long]
+
+/// the parameters that define the fields for a plot
+struct field_request
+{ std::pair<double, double> qth;                    ///< latitude and longitude of the QTH
+  int                       n_cells;                ///< number of cells from the centre to the edge of the plot
+  float                     distance_per_square;    ///< size of a cell, in metres
+  double                    distance_scale;         ///< radius of the plot, in metres
+  float                     antenna_height;         ///< height of the antenna, in metres
+  float                     raw_qth_height;         ///< terrain height at the QTH, in metres
+  bool                      elev;                   ///< whether to calculate the elevation-angle field
+  bool                      los;                    ///< whether to calculate the line-of-sight field
+  bool                      grad;                   ///< whether to calculate the gradient field
+  GRADIENT_METHOD           grad_method { GRADIENT_METHOD::SAMPLE };    ///< how to calculate the gradient field
+  int                       supersample { 1 };                          ///< number of samples along each side of a cell for its height
+  SUPERSAMPLE               supersample_mode { SUPERSAMPLE::MEAN };     ///< how to combine the samples of a cell
+  double                    fresnel_frequency { 0 };                    ///< frequency for the Fresnel-clearance and diffraction fields, in Hz; zero if neither is wanted
+  float                     fresnel_rx_height { 1.5 };                  ///< height of the receiving antenna above the terrain of each cell, in metres
+  bool                      diffraction { false };                      ///< whether to calculate the diffraction field (needs fresnel_frequency)
+  double                    mhat_bin_width { 1000 };                    ///< width of the bins of the radial histogram for the MHAT curve, in metres; zero for no histogram
+};
+
+/// statistics of the fields, accumulated while the fields are populated
+struct field_statistics
+{ float  min_height             { std::numeric_limits<float>::max() };     ///< lowest value in the height field (including the antenna and NODATA)
+  float  max_height             { std::numeric_limits<float>::lowest() };  ///< highest value in the height field (including the antenna)
+  float  min_grad               { std::numeric_limits<float>::max() };     ///< lowest value in the gradient field (including NODATA)
+  float  max_grad               { std::numeric_limits<float>::lowest() };  ///< highest value in the gradient field
+  double sum_terrain_height     { 0 };                                     ///< sum of the terrain heights within the radius of the plot, for MHAT
+  int    n_cells_terrain_height { 0 };                                     ///< number of cells in sum_terrain_height
+
+  std::vector<double> radial_sum;                                          ///< sum of the terrain heights in each bin of distance from the QTH, for the MHAT curve
+  std::vector<int>    radial_count;                                        ///< number of cells in each element of radial_sum
+
+/*! \brief              Include the height of the terrain of a cell within the radius of the plot, for MHAT
+    \param  h           height of the terrain, corrected for curvature and without the antenna
+    \param  distance    distance of the cell from the QTH, in metres
+    \param  bin_width   width of the bins of the radial histogram, in metres; zero for no histogram
+
+    Bin <i>n</i> (wrt 0) contains the cells more than n * <i>bin_width</i> and no more than (n + 1) * <i>bin_width</i> from the QTH
+    (bin 0 also contains the QTH)
+*/
+  inline void add_terrain_height(const float h, const double distance, const double bin_width)
+    { sum_terrain_height += h;
+      n_cells_terrain_height++;
+
+      if (bin_width > 0)
+      { const size_t bin { ( (distance > 0) ? static_cast<size_t>(ceil(distance / bin_width)) - 1 : 0 ) };
+
+        if (bin >= radial_sum.size())
+        { radial_sum.resize(bin + 1, 0);
+          radial_count.resize(bin + 1, 0);
+        }
+
+        radial_sum[bin] += h;
+        radial_count[bin]++;
+      }
+    }
+
+/// include a value of the height field
+  inline void add_height(const float h)
+    { min_height = std::min(h, min_height);
+      max_height = std::max(h, max_height);
+    }
+
+/// include a value of the gradient field
+  inline void add_grad(const float g)
+    { min_grad = std::min(g, min_grad);
+      max_grad = std::max(g, max_grad);
+    }
+
+/// include the statistics of other cells
+  inline void merge(const field_statistics& other)
+    { min_height = std::min(other.min_height, min_height);
+      max_height = std::max(other.max_height, max_height);
+      min_grad = std::min(other.min_grad, min_grad);
+      max_grad = std::max(other.max_grad, max_grad);
+      sum_terrain_height += other.sum_terrain_height;
+      n_cells_terrain_height += other.n_cells_terrain_height;
+
+      if (other.radial_sum.size() > radial_sum.size())
+      { radial_sum.resize(other.radial_sum.size(), 0);
+        radial_count.resize(other.radial_count.size(), 0);
+      }
+
+      for (size_t n = 0; n < other.radial_sum.size(); ++n)
+      { radial_sum[n] += other.radial_sum[n];
+        radial_count[n] += other.radial_count[n];
+      }
+    }
+};
+
+// -----------  field_set ----------------
+
+/*! \class  field_set
+    \brief  The fields for a plot, indexed as [row][column], with rows from S to N and columns from W to E
+*/
+
+class field_set
+{
+public:
+
+  std::vector<std::vector<float>>      height;                       ///< the height field; INCLUDES the antenna in the QTH cell
+  std::vector<std::vector<float>>      angle;                        ///< the angle-of-elevation field, in degrees
+  std::vector<std::vector<float>>      grad;                         ///< the QTH-based gradient field
+  std::vector<std::vector<VISIBILITY>> los;                          ///< the LOS field
+  std::vector<std::vector<float>>      fresnel;                      ///< the first-Fresnel-zone clearance field (see polar_field)
+  std::vector<std::vector<float>>      diffraction;                  ///< the knife-edge diffraction-loss field, in dB (see polar_field)
+
+  field_statistics                     stats;                        ///< statistics of the fields
+
+/*! \brief              Constructor
+    \param  n_cells     number of cells from the centre to the edge of the plot
+
+    All the fields are set to zero (or UNKNOWN)
+*/
+  explicit field_set(const int n_cells) :
+    height(2 * n_cells + 1, std::vector<float>(2 * n_cells + 1, 0)),
+    angle(2 * n_cells + 1, std::vector<float>(2 * n_cells + 1, 0)),
+    grad(2 * n_cells + 1, std::vector<float>(2 * n_cells + 1, 0)),
+    los(2 * n_cells + 1, std::vector<VISIBILITY>(2 * n_cells + 1, VISIBILITY::UNKNOWN)),
+    fresnel(2 * n_cells + 1, std::vector<float>(2 * n_cells + 1, 0)),
+    diffraction(2 * n_cells + 1, std::vector<float>(2 * n_cells + 1, 0))
+  { }
+};
+
+/*! \brief                          Populate the fields for some of the rows of a plot
+    \param  tiles                   the tiles that contain the plot
+    \param  req                     the parameters of the plot
+    \param  delta_y_start           the starting y offset (the plot starts at -n_cells)
+    \param  delta_y_increment       the number of rows by which to increment y
+    \param  fields                  the fields to populate
+    \param  geometry                the geometry of the cells; if nullptr, the geometry of each cell is calculated directly
+
+    This function is thread-safe. It does not yet handle the NODATA case reasonably. The work is done by one of eight kernels,
+    each compiled for one combination of <i>req.elev</i>, <i>req.grad</i> and <i>req.los</i>.
+*/
+void populate_fields(const tile_map& tiles, const field_request& req, const int delta_y_start, const int delta_y_increment, field_set& fields,
+                     const plot_geometry* geometry = nullptr);
+
+/*! \brief          Calculate the gradient field from the height field
+    \param  req     the parameters of the plot
+    \param  fields  the fields; the height field must be complete
+
+    The gradient of each cell is the derivative of height along the bearing from the QTH, from central differences
+    between the neighbouring cells (one-sided differences at the edges of the plot). This approximates GRADIENT_METHOD::SAMPLE
+    rather than reproducing it: the differences are largest (up to about 0.4 on the synthetic terrain) at the edges of the plot
+    and on steep ground whose slope changes within a cell, and a cell with a NODATA neighbour has a NODATA gradient, even if
+    the terrain 10m either side of it is valid
+*/
+void stencil_gradient_field(const field_request& req, field_set& fields);
+
+/*! \brief                  Populate all the fields of a plot, in parallel
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields to populate
+    \param  geometry        the geometry of the cells; if nullptr, the geometry of each cell is calculated directly
+*/
+void calculate_fields(const tile_map& tiles, const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry* geometry = nullptr);
+
+/*! \brief                  The MHAT for every radius that is a multiple of the width of the bins of the radial histogram
+    \param  stats           the statistics of a populated set of fields
+    \param  antenna_top     height of the top of the antenna, in metres (raw height of the QTH + height of the antenna)
+    \param  bin_width       width of the bins of the radial histogram, in metres
+    \param  max_radius      the radius of the plot, in metres
+    \return                 pairs of radius, in metres, and MHAT, in metres, for increasing radii; the last radius is <i>max_radius</i>
+
+    The MHATs are obtained from prefix sums of the histogram, so the whole curve costs no more sampling than the MHAT for the
+    radius of the plot alone; radii within which there are no cells are omitted.
+*/
+const std::vector<std::pair<double, float>> mhat_curve(const field_statistics& stats, const float antenna_top, const double bin_width, const double max_radius);
+
+#endif    // FIELDS_H
@@ -10,12 +10,15 @@
 #ifndef GRID_FLOAT_H
 #define GRID_FLOAT_H
 
+#include "profile.h"
 #include "string_functions.h"
 
 #include <cmath>
 #include <fstream>
 #include <iostream>     // for writing to cout, etc.
+#include <memory>
 #include <string>
+#include <vector>
 
 /*! \file   grid_float.h
 
@@ -49,6 +52,31 @@ This is repeated for the second row of the raster, continuing to the lower right
 // https://anuga.anu.edu.au/ticket/211 [xllcorner and yllcorner]
 // https://pubs.usgs.gov/tm/11b9/tm11B9.pdf [6-pixel tile overlap; 32-bit data]
 
+/// where the data of a tile are held, from fastest to slowest access
+enum class TILE_STORAGE { RAM,          ///< in a vector in RAM
+                          MAPPED,       ///< in a read-only mapping of the data file, so the kernel may reclaim the pages
+                          DISK          ///< not in memory; read from the data file as needed ("small memory")
+                        };
+
+/// how to combine the samples within an area
+enum class SUPERSAMPLE { MEAN,          ///< the mean of the valid samples
+                         MAX            ///< the highest valid sample
+                       };
+
+/*! \brief      The name of a kind of tile storage
+    \param  s   the kind of storage
+    \return     the name of <i>s</i>
+*/
+const std::string storage_name(const TILE_STORAGE s);
+
+/*! \brief                  Set the parameters of the per-thread caches of blocks read from tiles on disk
+    \param  block_bytes     size of each block, in bytes; rounded to a power of two between 4096 and 65536
+    \param  budget_bytes    maximum memory to use for the blocks in each thread's cache, in bytes
+
+    MUST be called before any thread has read from a tile on disk
+*/
+void configure_disk_cache(const size_t block_bytes, const size_t budget_bytes);
+
 // -----------  grid_float_tile ----------------
 
 /*! \class  grid_float_tile
@@ -80,11 +108,15 @@ protected:
   std::string _byte_order;      ///< MUST be "LSBFIRST"; currently unchecked
   
 // assume float is 32-bit (this is checked before use)
-  std::vector<std::vector<float>> _data;    ///< actual data in the tile; enables access as [latitude][longitude]
+  std::vector<float> _data;                 ///< actual data in the tile, row by row, if _storage is RAM; access as [latitude * _n_columns + longitude]
+
+  std::shared_ptr<const float> _mapping;    ///< the mapped data file, if _storage is MAPPED; shared by copies of the tile
   
-  mutable std::ifstream* _ifsp { nullptr };                       // small-memory data access; MUST use pointter as ifstreams are non-copyable
-  bool                   _sm   { false };
-  std::string            _data_filename;
+  std::shared_ptr<const int> _fd;           ///< descriptor of the data file, if _storage is DISK; shared by copies of the tile, and closed with the last of them
+  uint64_t                   _file_id { 0 }; ///< identifies _fd in the per-thread block caches; never reused
+
+  TILE_STORAGE _storage { TILE_STORAGE::RAM };                    ///< where the data are held
+  std::string  _data_filename;
   
   int _n_invalid_data { 0 };    ///< number of NODATA or NODATA_VALUE cells
   
@@ -132,24 +164,80 @@ protected:
     Returns Q0 if the point is within one metre of the centre of the cell
 */
   const QUADRANT _quadrant(const double& latitude, const double& longitude) const;
+
+/// read the data file into _data
+  void _load_into_ram(void);
+
+/// map the data file into _mapping
+  void _map(void);
+
+/// open the data file for reading with pread()
+  void _open(void);
+
+/*! \brief      Count the NODATA cells
+    \param  vp  pointer to all the values in the tile
+*/
+  void _count_invalid_data(const float* vp);
+
+/*! \brief              Read the value of a cell from the data file
+    \param  row_nr      row number
+    \param  column_nr   column number
+    \return             the value of the cell [row_nr][column_nr]
+
+    Thread-safe: the file is read with pread(), through a cache of blocks (with CLOCK eviction) that belongs to the calling thread
+*/
+  const float _disk_value(const int row_nr, const int column_nr) const;
+
+/*! \brief              The value of the cell with particular indices
+    \param  row_nr      row number
+    \param  column_nr   column number
+    \return             the value of the cell [row_nr][column_nr]
+*/
+  inline const float _value(const int row_nr, const int column_nr) const
+  { switch (_storage)
+    { case TILE_STORAGE::RAM :
+        return _data[static_cast<size_t>(row_nr) * _n_columns + column_nr];
+
+      case TILE_STORAGE::MAPPED :
+        return _mapping.get()[static_cast<size_t>(row_nr) * _n_columns + column_nr];
+
+      default :
+        return _disk_value(row_nr, column_nr);
+    }
+  }
   
 public:
 
 /*! \brief                      Constructor
     \param  header_filename     name of the header file
     \param  data_filename       name of the data file
+    \param  storage             where to hold the data
 */
-  grid_float_tile(const std::string& header_filename, const std::string& data_filename, const bool small_memory = false);
+  grid_float_tile(const std::string& header_filename, const std::string& data_filename, const TILE_STORAGE storage = TILE_STORAGE::RAM);
 
 /// destructor
   inline virtual ~grid_float_tile(void)
-  { if (_ifsp)
-      delete _ifsp;
-  }
+    { }
 
 /// Textual description of the tile
   const std::string to_string(void) const;
 
+/// where the data are held
+  inline const TILE_STORAGE storage(void) const
+    { return _storage; }
+
+/*! \brief                  Move the data to a different kind of storage
+    \param  new_storage     where to hold the data
+
+    Demotion to MAPPED or DISK releases the memory used by the data. This function MUST NOT
+    be called while another thread is reading from the tile.
+*/
+  void storage(const TILE_STORAGE new_storage);
+
+/// number of bytes of data in the tile
+  inline const uint64_t data_bytes(void) const
+    { return static_cast<uint64_t>(sizeof(float)) * _n_rows * _n_columns; }
+
 /*! \brief              Is a point within the tile?
     \param  latitude    latitude of point
     \param  longitude   longitude of point
@@ -194,6 +282,21 @@ public:
   inline const float interpolated_value(const std::pair<double, double>& ll) const
     { return interpolated_value(ll.first, ll.second); }
 
+/*! \brief          Combine up to k × k cells spread evenly over a rectangle
+    \param  south   latitude of the southern edge of the rectangle
+    \param  west    longitude of the western edge of the rectangle
+    \param  north   latitude of the northern edge of the rectangle
+    \param  east    longitude of the eastern edge of the rectangle
+    \param  k       number of samples along each side of the rectangle
+    \param  mode    how to combine the samples
+    \return         the mean or the maximum of the valid samples
+
+    The rectangle MUST be within the tile. If fewer than <i>k</i> cells of the tile span a side of the rectangle,
+    each of those cells is sampled once, rather than some being sampled more than once.
+    Throws a grid_float_error if none of the samples is valid.
+*/
+  const float area_value(const double& south, const double& west, const double& north, const double& east, const int k, const SUPERSAMPLE mode) const;
+
  /*! \brief             Convert a latitude and longitude to the equivalent indices
      \param  latitude   latitude of point
      \param  longitude  longitude of point
@@ -261,8 +364,52 @@ const std::pair<double, double> ll_from_bd(const double& lat1 /* deg */, const d
 inline const std::pair<double, double> ll_from_bd(const std::pair<double, double>& ll, const double& bearing_d /* degrees */, const double& distance_m /* metres */)
   { return ll_from_bd(ll.first, ll.second, bearing_d, distance_m); }
 
+/*! \brief          Obtain the bearing and distance of one point from another
+    \param  ll1     latitude and longitude of source, in degrees
+    \param  ll2     latitude and longitude of target, in degrees
+    \return         bearing of target from source, in degrees clockwise from north [0, 360), and distance along the Earth's surface, in metres
+
+    The inverse of ll_from_bd(): it is solved iteratively, so that ll_from_bd(ll1, bearing, distance) reproduces <i>ll2</i>
+*/
+const std::pair<double, double> bd_from_ll(const std::pair<double, double>& ll1, const std::pair<double, double>& ll2);
+
 const double bearing(const int delta_x, const int delta_y);  // bearing in degrees
 
+/*  \brief          Calculate the elevation above zero degrees of one point as seen from another
+    \param  lat1    latitude of first point
+    \param  long1   longitude of first point
+    \param  lat2    latitude of second point
+    \param  long2   longitude of second point
+    \param  h1      height of first point relative to sphere/geoid
+    \param  h2      height of first point relative to sphere/geoid
+    \return         the elevation of the second point as seen from the first point
+
+   The USGS "elevation" values are referenced to a geoid. Locally, and for the purpose of this
+   calculation, it's sufficient to treat the Earth between the two points as a sphere.
+   
+   Assuming a negative elevation angle (i.e. OD = OB + BD, both +ve)
+   O = centre of Earth
+   RE = radius of Earth
+   A = top of antenna (RE + h1)
+   OD = RE + h2 [== OB] projected on to horizontal plane through A
+   B = top of point 2 (i.e., r + h2)
+   theta = distance along surface between the points / radius of Earth
+*/
+const float elevation_angle(const double& lat1, const double& long1, const double& lat2, const double& long2, const double& h1, const double& h2);
+
+/*  \brief          Calculate the elevation above zero degrees of one point as seen from another
+    \param  ll1     latitude and longitude of first point
+    \param  ll2     latitude and longitude of second point
+    \param  h1      height of first point relative to sphere/geoid
+    \param  h2      height of first point relative to sphere/geoid
+    \return         the elevation of the second point as seen from the first point
+
+   The USGS "elevation" values are referenced to a geoid. Locally, and for the purpose of this
+   calculation, it's sufficient to treat the Earth between the two points as a sphere.
+*/
+inline const float elevation_angle(const std::pair<double, double>& ll1, const std::pair<double, double>& ll2, const double& h1, const double& h2)
+  { return elevation_angle(ll1.first, ll1.second, ll2.first, ll2.second, h1, h2); }
+
 /*! \brief              Return a base filename derived from latitude and longitude
     \param  latitude    latitude
     \param  longitude   longitude
@@ -383,7 +530,7 @@ public:
 */
   grid_float_error(const int n, const std::string& s) :
     x_error(n, s)
-  { }
+  { PROFILER.increment(COUNTER::GRID_FLOAT_ERROR); }
 };
 
 #endif    // GRID_FLOAT_H
@@ -10,13 +10,65 @@
 
 #include "macros.h"
 
+#include <array>
 #include <chrono>
 #include <mutex>
-#include <unordered_map>
+#include <string>
 
 using namespace std::literals::chrono_literals;
 using namespace std::literals::string_literals;
 
+/// the fields of /proc/meminfo that are recognised, in the order in which the kernel lists them
+enum class MEMINFO { MEM_TOTAL,           // MemTotal
+                     MEM_FREE,            // MemFree
+                     MEM_AVAILABLE,       // MemAvailable
+                     BUFFERS,             // Buffers
+                     CACHED,              // Cached
+                     SWAP_CACHED,         // SwapCached
+                     ACTIVE,              // Active
+                     INACTIVE,            // Inactive
+                     ACTIVE_ANON,         // Active(anon)
+                     INACTIVE_ANON,       // Inactive(anon)
+                     ACTIVE_FILE,         // Active(file)
+                     INACTIVE_FILE,       // Inactive(file)
+                     UNEVICTABLE,         // Unevictable
+                     MLOCKED,             // Mlocked
+                     SWAP_TOTAL,          // SwapTotal
+                     SWAP_FREE,           // SwapFree
+                     DIRTY,               // Dirty
+                     WRITEBACK,           // Writeback
+                     ANON_PAGES,          // AnonPages
+                     MAPPED,              // Mapped
+                     SHMEM,               // Shmem
+                     SLAB,                // Slab
+                     S_RECLAIMABLE,       // SReclaimable
+                     S_UNRECLAIM,         // SUnreclaim
+                     KERNEL_STACK,        // KernelStack
+                     PAGE_TABLES,         // PageTables
+                     NFS_UNSTABLE,        // NFS_Unstable
+                     BOUNCE,              // Bounce
+                     WRITEBACK_TMP,       // WritebackTmp
+                     COMMIT_LIMIT,        // CommitLimit
+                     COMMITTED_AS,        // Committed_AS
+                     VMALLOC_TOTAL,       // VmallocTotal
+                     VMALLOC_USED,        // VmallocUsed
+                     VMALLOC_CHUNK,       // VmallocChunk
+                     HARDWARE_CORRUPTED,  // HardwareCorrupted
+                     ANON_HUGE_PAGES,     // AnonHugePages
+                     SHMEM_HUGE_PAGES,    // ShmemHugePages
+                     SHMEM_PMD_MAPPED,    // ShmemPmdMapped
+                     HUGE_PAGES_TOTAL,    // HugePages_Total
+                     HUGE_PAGES_FREE,     // HugePages_Free
+                     HUGE_PAGES_RSVD,     // HugePages_Rsvd
+                     HUGE_PAGES_SURP,     // HugePages_Surp
+                     HUGEPAGESIZE,        // Hugepagesize
+                     DIRECT_MAP_4K,       // DirectMap4k
+                     DIRECT_MAP_2M,       // DirectMap2M
+                     N_FIELDS             // number of fields; not itself a field
+                   };
+
+constexpr uint64_t CGROUP_NO_LIMIT { UINT64_MAX };                  ///< value of memory.max when the cgroup has no limit
+
 // -----------  memory_information ----------------
 
 /*! \class  memory_information
@@ -30,12 +82,39 @@ protected:
   std::chrono::system_clock::time_point _last_update_time;         ///< time at which /proc/meminfo was last read
   std::chrono::system_clock::duration   _minimum_interval;         ///< minimum interval between unforced reads of /proc/meminfo
 
-  std::unordered_map<std::string /* name */, uint64_t /* value */> _values; ///< all the values from /proc/meminfo; see "man free", "man procfs"
+  std::array<uint64_t, static_cast<size_t>(MEMINFO::N_FIELDS)> _values { };   ///< the values from /proc/meminfo, in bytes (except HugePages_*); see "man free", "man procfs"
+
+  std::string _cgroup_max_filename;                                 ///< memory.max of this process's cgroup (v2); empty if there is none
+  std::string _cgroup_current_filename;                             ///< memory.current of this process's cgroup (v2)
+  std::string _cgroup_stat_filename;                                ///< memory.stat of this process's cgroup (v2)
+  std::string _pressure_filename;                                   ///< PSI file for memory: the cgroup's memory.pressure, or /proc/pressure/memory; empty if neither exists
+
+  uint64_t    _cgroup_max           { CGROUP_NO_LIMIT };            ///< limit on the memory of the cgroup, in bytes
+  uint64_t    _cgroup_current       { 0 };                          ///< memory currently charged to the cgroup, in bytes
+  uint64_t    _cgroup_inactive_file { 0 };                          ///< reclaimable page cache charged to the cgroup, in bytes
+
+/*! \brief          Possibly read /proc/meminfo and the cgroup memory files
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+
+    Does not allocate memory
+*/
+  void _get_meminfo(const bool force = false);
+
+/// locate the cgroup (v2) memory files for this process
+  void _find_cgroup(void);
 
-/*! \brief          Possibly read /proc/meminfo
+/*! \brief          Get a value from /proc/meminfo
+    \param  field   the field to get
     \param  force   whether to force reading of /proc/meminfo regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+    \return         the value of <i>field</i>; zero if the kernel does not provide it
 */
-  void _get_meminfo(const bool force = false);                      ///< possibly read /proc/meminfo
+  inline const uint64_t _value(const MEMINFO field, const bool force)
+    { _get_meminfo(force);
+
+      std::lock_guard<std::mutex> memory_lock(_memory_mutex);
+
+      return _values[static_cast<size_t>(field)];
+    }
 
   std::mutex _memory_mutex;                                         ///< used to make it thread-safe
 
@@ -50,153 +129,195 @@ public:
 
 /// get MemTotal
   inline const uint64_t mem_total(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("MemTotal"s) ); }             // MemTotal:        8178256 kB
+    { return _value(MEMINFO::MEM_TOTAL, force); }                            // MemTotal:        8178256 kB
 
 /// get MemFree
   inline const uint64_t mem_free(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("MemFree"s) ); }              // MemFree:          551600 kB
+    { return _value(MEMINFO::MEM_FREE, force); }                             // MemFree:          551600 kB
 
 /// get MemAvailable
   inline const uint64_t mem_available(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("MemAvailable"s) ); }         // MemAvailable:    2265744 kB
+    { return _value(MEMINFO::MEM_AVAILABLE, force); }                        // MemAvailable:    2265744 kB
 
 /// get Buffers
   inline const uint64_t buffers(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Buffers"s) ); }              // Buffers:          271592 kB
+    { return _value(MEMINFO::BUFFERS, force); }                              // Buffers:          271592 kB
 
 /// get Cached
   inline const uint64_t cached(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Cached"s) ); }               // Cached:          1462272 kB
+    { return _value(MEMINFO::CACHED, force); }                               // Cached:          1462272 kB
 
 /// get SwapCached
   inline const uint64_t swap_cached(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("SwapCached"s) ); }           // SwapCached:       181216 kB
+    { return _value(MEMINFO::SWAP_CACHED, force); }                          // SwapCached:       181216 kB
 
 /// get Active
   inline const uint64_t active(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Active"s) ); }               // Active:          4381312 kB
+    { return _value(MEMINFO::ACTIVE, force); }                               // Active:          4381312 kB
 
 /// get Inactive
   inline const uint64_t inactive(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Inactive"s) ); }             // Inactive:        1240504 kB
+    { return _value(MEMINFO::INACTIVE, force); }                             // Inactive:        1240504 kB
 
 /// get Active(anon)
   inline const uint64_t active_anon(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Active(anon)"s) ); }         // Active(anon):    3344136 kB
+    { return _value(MEMINFO::ACTIVE_ANON, force); }                          // Active(anon):    3344136 kB
 
 /// get Inactive(anon)
   inline const uint64_t inactive_anon(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Inactive(anon)"s) ); }       // Inactive(anon):   719528 kB
+    { return _value(MEMINFO::INACTIVE_ANON, force); }                        // Inactive(anon):   719528 kB
 
 /// get Active(file)
   inline const uint64_t active_file(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Active(file)"s) ); }         // Active(file):    1037176 kB
+    { return _value(MEMINFO::ACTIVE_FILE, force); }                          // Active(file):    1037176 kB
 
 /// get Inactive(file)
   inline const uint64_t inactive_file(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Inactive(file)"s) ); }       // Inactive(file):   520976 kB
+    { return _value(MEMINFO::INACTIVE_FILE, force); }                        // Inactive(file):   520976 kB
 
 /// get Unevictable
   inline const uint64_t unevictable(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Unevictable"s) ); }          // Unevictable:         112 kB
+    { return _value(MEMINFO::UNEVICTABLE, force); }                          // Unevictable:         112 kB
 
 /// get Mlocked
   inline const uint64_t mlocked(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Mlocked"s) ); }              // Mlocked:             112 kB
+    { return _value(MEMINFO::MLOCKED, force); }                              // Mlocked:             112 kB
 
 /// get SwapTotal
   inline const uint64_t swap_total(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("SwapTotal"s) ); }            // SwapTotal:      15615864 kB
+    { return _value(MEMINFO::SWAP_TOTAL, force); }                           // SwapTotal:      15615864 kB
 
   inline const uint64_t swap_free(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("SwapFree"s) ); }             // SwapFree:       14495636 kB
+    { return _value(MEMINFO::SWAP_FREE, force); }                            // SwapFree:       14495636 kB
 
   inline const uint64_t dirty(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Dirty"s) ); }                // Dirty:              1376 kB
+    { return _value(MEMINFO::DIRTY, force); }                                // Dirty:              1376 kB
 
   inline const uint64_t writeback(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Writeback"s) ); }            // Writeback:             0 kB
+    { return _value(MEMINFO::WRITEBACK, force); }                            // Writeback:             0 kB
 
   inline const uint64_t anon_pages(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("AnonPages"s) ); }            // AnonPages:       3882372 kB
+    { return _value(MEMINFO::ANON_PAGES, force); }                           // AnonPages:       3882372 kB
 
   inline const uint64_t mapped(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Mapped"s) ); }               // Mapped:           384940 kB
+    { return _value(MEMINFO::MAPPED, force); }                               // Mapped:           384940 kB
 
   inline const uint64_t shmem(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Shmem"s) ); }                // Shmem:            175676 kB
+    { return _value(MEMINFO::SHMEM, force); }                                // Shmem:            175676 kB
 
   inline const uint64_t slab(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Slab"s) ); }                 // Slab:             655936 kB
+    { return _value(MEMINFO::SLAB, force); }                                 // Slab:             655936 kB
 
   inline const uint64_t s_reclaimable(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("SReclaimable"s) ); }         // SReclaimable:     459916 kB
+    { return _value(MEMINFO::S_RECLAIMABLE, force); }                        // SReclaimable:     459916 kB
 
   inline const uint64_t s_unreclaim(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("SUnreclaim"s) ); }           // SUnreclaim:       196020 kB
+    { return _value(MEMINFO::S_UNRECLAIM, force); }                          // SUnreclaim:       196020 kB
 
   inline const uint64_t kernel_stack(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("KernelStack"s) ); }          // KernelStack:       21568 kB
+    { return _value(MEMINFO::KERNEL_STACK, force); }                         // KernelStack:       21568 kB
 
   inline const uint64_t page_tables(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("PageTables"s) ); }           // PageTables:        80948 kB
+    { return _value(MEMINFO::PAGE_TABLES, force); }                          // PageTables:        80948 kB
 
   inline const uint64_t nfs_unstable(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("NFS_Unstable"s) ); }         // NFS_Unstable:          0 kB
+    { return _value(MEMINFO::NFS_UNSTABLE, force); }                         // NFS_Unstable:          0 kB
 
   inline const uint64_t bounce(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Bounce"s) ); }               // Bounce:                0 kB
+    { return _value(MEMINFO::BOUNCE, force); }                               // Bounce:                0 kB
 
   inline const uint64_t writeback_tmp(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("WritebackTmp"s) ); }         // WritebackTmp:          0 kB
+    { return _value(MEMINFO::WRITEBACK_TMP, force); }                        // WritebackTmp:          0 kB
 
   inline const uint64_t commit_limit(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("CommitLimit"s) ); }          // CommitLimit:    19704992 kB
+    { return _value(MEMINFO::COMMIT_LIMIT, force); }                         // CommitLimit:    19704992 kB
 
   inline const uint64_t committed_as(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Committed_AS"s) ); }         // Committed_AS:   10977852 kB
+    { return _value(MEMINFO::COMMITTED_AS, force); }                         // Committed_AS:   10977852 kB
 
   inline const uint64_t vmalloc_total(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("VmallocTotal"s) ); }         // VmallocTotal:   34359738367 kB
+    { return _value(MEMINFO::VMALLOC_TOTAL, force); }                        // VmallocTotal:   34359738367 kB
 
   inline const uint64_t vmalloc_used(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("VmallocUsed"s) ); }          // VmallocUsed:           0 kB
+    { return _value(MEMINFO::VMALLOC_USED, force); }                         // VmallocUsed:           0 kB
 
   inline const uint64_t vmalloc_chunk(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("VmallocChunk"s) ); }         // VmallocChunk:          0 kB
+    { return _value(MEMINFO::VMALLOC_CHUNK, force); }                        // VmallocChunk:          0 kB
 
   inline const uint64_t hardware_corrupted(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("HardwareCorrupted"s) ); }    // HardwareCorrupted:     0 kB
+    { return _value(MEMINFO::HARDWARE_CORRUPTED, force); }                   // HardwareCorrupted:     0 kB
 
   inline const uint64_t anon_huge_pages(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("AnonHugePages"s) ); }        // AnonHugePages:         0 kB
+    { return _value(MEMINFO::ANON_HUGE_PAGES, force); }                      // AnonHugePages:         0 kB
 
   inline const uint64_t shmem_huge_pages(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("ShmemHugePages"s) ); }       // ShmemHugePages:        0 kB
+    { return _value(MEMINFO::SHMEM_HUGE_PAGES, force); }                     // ShmemHugePages:        0 kB
 
   inline const uint64_t shmem_pmd_mapped(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("ShmemPmdMapped"s) ); }       // ShmemPmdMapped:        0 kB
+    { return _value(MEMINFO::SHMEM_PMD_MAPPED, force); }                     // ShmemPmdMapped:        0 kB
 
   inline const uint64_t huge_pages_total(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("HugePages_Total"s) ); }      // HugePages_Total:       0
+    { return _value(MEMINFO::HUGE_PAGES_TOTAL, force); }                     // HugePages_Total:       0
 
   inline const uint64_t huge_pages_free(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("HugePages_Free"s) ); }       // HugePages_Free:        0
+    { return _value(MEMINFO::HUGE_PAGES_FREE, force); }                      // HugePages_Free:        0
 
   inline const uint64_t huge_pages_rsvd(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("HugePages_Rsvd"s) ); }       // HugePages_Rsvd:        0
+    { return _value(MEMINFO::HUGE_PAGES_RSVD, force); }                      // HugePages_Rsvd:        0
 
   inline const uint64_t huge_pages_surp(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("HugePages_Surp"s) ); }       // HugePages_Surp:        0
+    { return _value(MEMINFO::HUGE_PAGES_SURP, force); }                      // HugePages_Surp:        0
 
   inline const uint64_t hugepagesize(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("Hugepagesize"s) ); }         // Hugepagesize:       2048 kB
+    { return _value(MEMINFO::HUGEPAGESIZE, force); }                         // Hugepagesize:       2048 kB
 
   inline const uint64_t direct_map_4k(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("DirectMap4k"s) ); }          // DirectMap4k:     6185856 kB
+    { return _value(MEMINFO::DIRECT_MAP_4K, force); }                        // DirectMap4k:     6185856 kB
 
   inline const uint64_t direct_map_2m(const bool force = false)
-    { return ( _get_meminfo(force), _values.at("DirectMap2M"s) ); }          // DirectMap2M:     2201600 kB
+    { return _value(MEMINFO::DIRECT_MAP_2M, force); }                        // DirectMap2M:     2201600 kB
+
+/*! \brief          Is this process in a cgroup (v2) with a memory limit?
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+*/
+  inline const bool cgroup_limited(const bool force = false)
+    { return (cgroup_max(force) != CGROUP_NO_LIMIT); }
+
+/*! \brief          Get the memory limit of this process's cgroup
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+    \return         memory.max, in bytes; CGROUP_NO_LIMIT if there is no limit
+*/
+  const uint64_t cgroup_max(const bool force = false);
+
+/*! \brief          Get the memory charged to this process's cgroup
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+    \return         memory.current, in bytes; zero if there is no cgroup
+*/
+  const uint64_t cgroup_current(const bool force = false);
+
+/*! \brief          Get the memory that this process may still use without causing swapping or an OOM kill
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+    \return         the available memory, in bytes
+
+    The lesser of MemAvailable and the headroom within the cgroup limit (which counts inactive page cache as reclaimable)
+*/
+  const uint64_t available(const bool force = false);
+
+/*! \brief      Get the current memory pressure
+    \return     the "some avg10" value from the PSI file, in per cent; -1 if PSI is not available
+
+    This is the percentage of the last ten seconds during which at least one task was stalled waiting for memory.
+    The cgroup's memory.pressure is used if the process is in a cgroup (v2); otherwise /proc/pressure/memory.
+    Does not allocate memory.
+*/
+  const double memory_pressure(void) const;
+
+/*! \brief      Get the peak resident set size of this process
+    \return     VmHWM from /proc/self/status, in bytes
+
+    Returns zero if the value cannot be determined
+*/
+  const uint64_t peak_rss(void) const;
 
 /*! \brief          Convert to printable string
     \param  force   whether to force reading of /proc/meminfo regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
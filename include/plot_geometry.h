@@ -0,0 +1,97 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   plot_geometry.h
+
+    The bearing and distance from the QTH of every cell of a plot, computed once per plot
+*/
+
+#ifndef PLOT_GEOMETRY_H
+#define PLOT_GEOMETRY_H
+
+#include "grid_float.h"
+
+#include <cstdlib>
+#include <vector>
+
+/// the geometry of a cell of a plot, relative to the QTH
+struct cell_geometry
+{ double bearing;           ///< bearing from the QTH, in degrees
+  double distance;          ///< distance from the QTH along the curved surface, in metres
+  double cos_factor;        ///< cos(distance / RE)
+  double correction;        ///< curvature_correction(distance)
+};
+
+/*! \brief                          Calculate the geometry of a cell directly
+    \param  delta_x                 number of cells east of the QTH
+    \param  delta_y                 number of cells north of the QTH
+    \param  distance_per_square     size of a cell, in metres
+    \return                         the geometry of the cell [delta_y][delta_x]
+*/
+const cell_geometry direct_cell_geometry(const int delta_x, const int delta_y, const float distance_per_square);
+
+// -----------  plot_geometry ----------------
+
+/*! \class  plot_geometry
+    \brief  The geometry of every cell of a plot
+
+    The squared distance delta_x² + delta_y² has eightfold symmetry on the square grid, so only the
+    octant 0 <= minor <= major is calculated; the other octants are obtained by reflection. The values
+    are identical to those from direct_cell_geometry().
+
+    The table is keyed by the cell (major, minor) of the octant, not by the squared distance: cells of the
+    octant with the same squared distance, such as (5, 0) and (4, 3), have separate entries, so the distance,
+    cos(distance / RE) and curvature_correction() are calculated once for each cell of the octant rather than
+    once for each distinct squared distance.
+*/
+
+class plot_geometry
+{
+protected:
+
+/// the values that are shared by all eight reflections of a cell
+  struct octant_entry
+  { double base_angle;      ///< atan(minor / major), in degrees
+    double distance;        ///< distance from the QTH along the curved surface, in metres
+    double cos_factor;      ///< cos(distance / RE)
+    double correction;      ///< curvature_correction(distance)
+  };
+
+  int                       _n_cells;       ///< number of cells from the centre to the edge of the plot
+  std::vector<octant_entry> _entries;       ///< the entries for the cells of the octant, indexed by _index(major, minor)
+
+/*! \brief          The position of a cell in _entries
+    \param  major   the larger of |delta_x| and |delta_y|
+    \param  minor   the smaller of |delta_x| and |delta_y|
+    \return         the index of the entry for the cell
+*/
+  inline static const size_t _index(const int major, const int minor)
+    { return ( static_cast<size_t>(major) * (major + 1) / 2 + minor ); }
+
+public:
+
+/*! \brief                          Constructor
+    \param  n_cells                 number of cells from the centre to the edge of the plot
+    \param  distance_per_square     size of a cell, in metres
+*/
+  plot_geometry(const int n_cells, const float distance_per_square);
+
+/// number of cells from the centre to the edge of the plot
+  inline const int n_cells(void) const
+    { return _n_cells; }
+
+/*! \brief              The geometry of a cell
+    \param  delta_x     number of cells east of the QTH
+    \param  delta_y     number of cells north of the QTH
+    \return             the geometry of the cell [delta_y][delta_x]
+
+    Performs no bounds checking
+*/
+  const cell_geometry operator()(const int delta_x, const int delta_y) const;
+};
+
+#endif    // PLOT_GEOMETRY_H
@@ -0,0 +1,163 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   polar.h
+
+    Calculation of the fields for a plot on a grid of bearing × range, with one sweep along each bearing
+*/
+
+#ifndef POLAR_H
+#define POLAR_H
+
+#include "fields.h"
+#include "plot_geometry.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+constexpr double SPEED_OF_LIGHT      { 299792458.0 };    // m/s
+constexpr float  MAX_CLEARANCE_RATIO { 10 };             // clearance ratios are limited to ±MAX_CLEARANCE_RATIO
+
+// -----------  polar_field ----------------
+
+/*! \class  polar_field
+    \brief  The terrain along evenly spaced bearings from the QTH, sampled at evenly spaced ranges
+
+    Each bearing is swept outwards from the QTH once. Every sample along the sweep is used for the height, the elevation angle,
+    the gradient and the line of sight of all the samples beyond it, so a plot's LOS costs one sample per point rather than
+    one ray per cell. The values for each bearing are contiguous, indexed by range.
+*/
+
+class polar_field
+{
+protected:
+
+  int    _n_bearings;                   ///< number of bearings
+  int    _n_ranges;                     ///< number of ranges along each bearing, including the QTH at range zero
+  double _range_step;                   ///< distance between samples along a bearing, in metres
+
+  std::vector<float>   _height;         ///< the height of each sample, corrected for curvature; -9999 if NODATA
+  std::vector<float>   _angle;          ///< the elevation angle of each sample as seen from the antenna, in degrees
+  std::vector<uint8_t> _visible;        ///< whether each sample is visible from the antenna
+  std::vector<float>   _clearance;      ///< the Fresnel-clearance ratio of the path to each sample; empty if not wanted
+  std::vector<float>   _loss;           ///< the diffraction loss of the path to each sample, in dB; empty if not wanted
+
+/*! \brief                  Sweep along one bearing
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot
+    \param  bearing_nr      the number of the bearing
+*/
+  void _sweep(const tile_map& tiles, const field_request& req, const int bearing_nr);
+
+/*! \brief                  Calculate the Fresnel-clearance ratios along one bearing, once its heights are known
+    \param  req             the parameters of the plot
+    \param  bearing_nr      the number of the bearing
+*/
+  void _clear(const field_request& req, const int bearing_nr);
+
+/*! \brief                  Calculate the diffraction losses along one bearing, once its Fresnel-clearance ratios are known
+    \param  req             the parameters of the plot
+    \param  bearing_nr      the number of the bearing
+*/
+  void _diffract(const field_request& req, const int bearing_nr);
+
+/*! \brief                  The position of a sample in the arrays
+    \param  bearing_nr      the number of the bearing (taken modulo the number of bearings)
+    \param  range_nr        the number of the range
+    \return                 the index of the sample
+*/
+  inline const size_t _index(const int bearing_nr, const int range_nr) const
+    { return static_cast<size_t>( (bearing_nr + _n_bearings) % _n_bearings ) * _n_ranges + range_nr; }
+
+public:
+
+/*! \brief                  Constructor
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+
+    The bearings are spaced so that adjacent samples at the corners of the plot are no more than one cell apart, and the
+    ranges are spaced one cell apart. The Fresnel-clearance ratios are calculated only if <i>req.fresnel_frequency</i> is
+    non-zero.
+
+    The Fresnel-clearance ratio of a sample is the smallest value, over all the samples between it and the QTH, of the
+    clearance between the terrain and the straight path from the antenna to a receiving antenna <i>req.fresnel_rx_height</i>
+    above the sample, divided by the radius of the first Fresnel zone at that point. A ratio of 1 or more means that the
+    first Fresnel zone is clear; a negative ratio means that the path is obstructed.
+
+    If <i>req.diffraction</i> is true, the diffraction loss of the path to each sample is also calculated, by the Deygout method
+    limited to three edges: the candidate edges are the terrain samples touched by a string stretched from the antenna to the
+    receiving antenna; the principal edge is the one with the largest diffraction parameter, and the secondary edges are the
+    worst on each side of it, relative to the principal edge and the corresponding end of the path. If the string touches no
+    terrain, the loss is that of the point of least Fresnel clearance.
+*/
+  polar_field(const tile_map& tiles, const field_request& req, const unsigned int n_threads);
+
+/// number of bearings
+  inline const int n_bearings(void) const
+    { return _n_bearings; }
+
+/// number of ranges along each bearing
+  inline const int n_ranges(void) const
+    { return _n_ranges; }
+
+/*! \brief                      Is the sample nearest to a bearing and distance visible?
+    \param  bearing_from_north  bearing from the QTH, in degrees
+    \param  distance            distance from the QTH along the curved surface, in metres
+    \return                     whether the nearest sample is visible from the antenna; false beyond the last range
+*/
+  inline const bool visible(const double bearing_from_north, const double distance) const
+    { const int range_nr { static_cast<int>(lround(distance / _range_step)) };
+
+      return ( (range_nr < _n_ranges) and _visible[_index(static_cast<int>(lround(bearing_from_north * _n_bearings / 360)), range_nr)] );
+    }
+
+/*! \brief                  Fill the Cartesian fields of a plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields to fill
+    \param  geometry        the geometry of the cells
+
+    Heights, angles, gradients, Fresnel-clearance ratios and diffraction losses are interpolated between the four surrounding samples;
+    visibility is taken from the nearest sample
+*/
+  void reproject(const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry& geometry) const;
+
+/*! \brief                  Fill only the Fresnel-clearance and diffraction fields of a plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields; only <i>fields.fresnel</i> and <i>fields.diffraction</i> are changed
+    \param  geometry        the geometry of the cells
+*/
+  void reproject_radio_fields(const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry& geometry) const;
+};
+
+/*! \brief                  Populate all the fields of a plot on a polar grid, and reproject them to the Cartesian fields
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields to populate
+    \param  geometry        the geometry of the cells
+
+    The gradient is the difference between adjacent samples along each bearing, so <i>req.grad_method</i> is ignored; <i>req.supersample</i>
+    is also ignored
+*/
+void calculate_polar_fields(const tile_map& tiles, const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry& geometry);
+
+/*! \brief                  Populate the Fresnel-clearance and diffraction fields of a plot whose other fields are calculated cell by cell
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot; <i>req.fresnel_frequency</i> must be non-zero
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields; only <i>fields.fresnel</i> and <i>fields.diffraction</i> are changed
+    \param  geometry        the geometry of the cells
+
+    The fields are calculated on a polar grid, as for calculate_polar_fields()
+*/
+void calculate_radio_fields(const tile_map& tiles, const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry& geometry);
+
+#endif    // POLAR_H
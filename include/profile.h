@@ -0,0 +1,204 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   profile.h
+
+    Phase-level timing and event counters
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "trace.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <time.h>
+
+/// the phases of a run for which we accumulate time
+enum class PHASE { R_STARTUP,               ///< starting the R instance
+                   TILE_NEEDS,              ///< determining which tiles are needed
+                   DOWNLOAD,                ///< downloading tiles (includes UNZIP)
+                   UNZIP,                   ///< unzipping downloaded tiles
+                   LOAD,                    ///< making the tiles available
+                   POPULATE_FIELDS,         ///< calculating the fields
+                   HORIZON,                 ///< calculating the horizon
+                   SITE_SEARCH,             ///< scoring candidate sites
+                   COVERAGE,                ///< calculating the number of sites from which each cell is visible
+                   RADIO_FIELDS,            ///< calculating the Fresnel-clearance and diffraction fields (when not calculated with the other fields)
+                   TERRAIN_PROFILES,        ///< extracting terrain profiles
+                   RENDER_HEIGHT,           ///< rendering the height plot
+                   RENDER_LOS,              ///< rendering the LOS plot
+                   RENDER_ELEV,             ///< rendering the elevation plot
+                   RENDER_GRAD,             ///< rendering the gradient plot
+                   RENDER_COVERAGE,         ///< rendering the coverage plot
+                   RENDER_FRESNEL,          ///< rendering the Fresnel-clearance plot
+                   RENDER_DIFFRACTION,      ///< rendering the diffraction plot
+                   R_CALLS,                 ///< commands sent to R (included in the RENDER_ phases)
+                   N_PHASES                 ///< number of phases; MUST BE LAST
+                 };
+
+/// the events that we count
+enum class COUNTER { INTERPOLATED_VALUE,    ///< calls to grid_float_tile::interpolated_value()
+                     LL_FROM_BD,            ///< calls to ll_from_bd()
+                     GRID_FLOAT_ERROR,      ///< grid_float_errors thrown
+                     BYTES_READ,            ///< bytes read from tile data files
+                     TILE_DEMOTIONS,        ///< tiles moved to slower storage by the tile_governor
+                     TILE_PROMOTIONS,       ///< tiles moved to faster storage by the tile_governor
+                     BLOCK_CACHE_HITS,      ///< reads from tiles on disk that were satisfied by a thread's block cache
+                     BLOCK_CACHE_MISSES,    ///< reads from tiles on disk that required a block to be read from the file
+                     AREA_VALUE,            ///< calls to grid_float_tile::area_value()
+                     AREA_SAMPLES,          ///< tile cells read by grid_float_tile::area_value()
+                     N_COUNTERS             ///< number of counters; MUST BE LAST
+                   };
+
+// -----------  phase_profiler ----------------
+
+/*! \class  phase_profiler
+    \brief  Accumulate wall and CPU time per phase, and counts of events
+
+    All the accumulators are atomic, so the object may be updated from any thread. Nothing
+    is recorded unless the profiler has been enabled.
+*/
+
+class phase_profiler
+{
+protected:
+
+  constexpr static size_t N_PHASES   { static_cast<size_t>(PHASE::N_PHASES) };
+  constexpr static size_t N_COUNTERS { static_cast<size_t>(COUNTER::N_COUNTERS) };
+
+  bool _enabled { false };                                  ///< whether to record anything
+
+  std::array<std::atomic<uint64_t>, N_PHASES>   _wall_ns;   ///< accumulated wall time, in ns
+  std::array<std::atomic<uint64_t>, N_PHASES>   _cpu_ns;    ///< accumulated process CPU time, in ns
+  std::array<std::atomic<uint64_t>, N_PHASES>   _calls;     ///< number of times each phase has been entered
+  std::array<std::atomic<uint64_t>, N_COUNTERS> _counters;  ///< the event counters
+
+public:
+
+/// constructor
+  phase_profiler(void);
+
+/// is the profiler enabled?
+  inline const bool enabled(void) const
+    { return _enabled; }
+
+/// enable or disable the profiler
+  inline void enabled(const bool b)
+    { _enabled = b; }
+
+/*! \brief      Increment a counter
+    \param  c   the counter to increment
+    \param  n   the amount by which to increment <i>c</i>
+*/
+  inline void increment(const COUNTER c, const uint64_t n = 1)
+    { if (_enabled)
+        _counters[static_cast<size_t>(c)].fetch_add(n, std::memory_order_relaxed);
+    }
+
+/*! \brief          Add time to a phase
+    \param  p       the phase
+    \param  wall_ns wall time, in ns
+    \param  cpu_ns  CPU time, in ns
+*/
+  void add(const PHASE p, const uint64_t wall_ns, const uint64_t cpu_ns);
+
+/// reset all the accumulators to zero
+  void reset(void);
+
+/*! \brief                  Summarise the accumulated values as a JSON object
+    \param  radius          the radius of the plot, in metres
+    \param  peak_rss        peak resident set size, in bytes
+    \return                 the summary
+*/
+  const std::string to_json(const double radius, const uint64_t peak_rss) const;
+};
+
+extern phase_profiler PROFILER;          ///< the profiler for the program
+
+/*! \brief      The name of a phase
+    \param  p   the phase
+    \return     the name of <i>p</i>, as used in the JSON summary and in traces
+*/
+const char* phase_name(const PHASE p);
+
+/*! \brief  Process CPU time, in ns
+    \return the CPU time consumed by all threads in the process
+*/
+inline const uint64_t process_cpu_ns(void)
+{ timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+  return (static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec);
+}
+
+// -----------  phase_timer ----------------
+
+/*! \class  phase_timer
+    \brief  RAII object that adds its lifetime to a phase in PROFILER, and records it as an event in TRACER
+
+    Time is accumulated per invocation, so if several invocations of a phase run concurrently,
+    the wall time for that phase may exceed the wall time of the enclosing phase.
+*/
+
+class phase_timer
+{
+protected:
+
+  PHASE                                 _phase;         ///< the phase being timed
+  bool                                  _active;        ///< whether the profiler was enabled at construction
+  bool                                  _traced;        ///< whether the trace recorder was enabled at construction
+  std::chrono::steady_clock::time_point _wall_start;    ///< wall time at construction
+  uint64_t                              _cpu_start;     ///< CPU time at construction, in ns
+
+public:
+
+/*! \brief      Constructor
+    \param  p   the phase to be timed
+*/
+  explicit inline phase_timer(const PHASE p) :
+    _phase(p),
+    _active(PROFILER.enabled()),
+    _traced(TRACER.enabled())
+  { if (_active or _traced)
+      _wall_start = std::chrono::steady_clock::now();
+
+    if (_active)
+      _cpu_start = process_cpu_ns();
+  }
+
+/// destructor
+  inline ~phase_timer(void)
+    { stop(); }
+
+/// stop timing and record the elapsed time; subsequent calls do nothing
+  inline void stop(void)
+  { if (_active or _traced)
+    { const auto now { std::chrono::steady_clock::now() };
+
+      if (_active)
+        PROFILER.add(_phase, std::chrono::duration_cast<std::chrono::nanoseconds>(now - _wall_start).count(), process_cpu_ns() - _cpu_start);
+
+      if (_traced)
+        TRACER.record(phase_name(_phase), _wall_start, now);
+
+      _active = false;
+      _traced = false;
+    }
+  }
+
+  phase_timer(const phase_timer&) = delete;
+  phase_timer& operator=(const phase_timer&) = delete;
+};
+
+#endif    // PROFILE_H
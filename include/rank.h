@@ -0,0 +1,38 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   rank.h
+
+    The rank of every value in a field, for plots whose colours follow the distribution of the values rather than the values themselves
+*/
+
+#ifndef RANK_H
+#define RANK_H
+
+#include <vector>
+
+/// the ranks of the values in a field
+struct field_ranks
+{ std::vector<std::vector<int>> index;          ///< the scaled rank of each cell, indexed as [row][column]
+  std::vector<float>            quantiles;      ///< the values at evenly spaced quantiles, from the lowest to the highest value
+};
+
+/*! \brief                  Rank the values in a field
+    \param  field           the field, indexed as [row][column]; all rows must be the same length
+    \param  max_index       the scaled rank of the highest value
+    \param  n_quantiles     the number of quantiles to return (at least two)
+    \param  n_threads       the number of threads to use
+    \return                 the scaled ranks and the quantiles
+
+    The scaled rank of a value is (max_index × the number of values less than it) / (the number of values - 1), truncated;
+    this is the same as using lower_bound() on a sorted copy of the field. Quantile <i>q</i> is the value at position
+    (q / (n_quantiles - 1)) × (the number of values - 1) of the sorted copy. The values are sorted with a parallel radix sort
+    on their bit patterns, and the ranks are then scattered back to the cells.
+*/
+const field_ranks rank_field(const std::vector<std::vector<float>>& field, const int max_index, const int n_quantiles, const unsigned int n_threads);
+
+#endif    // RANK_H
@@ -0,0 +1,136 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   site_search.h
+
+    Score many candidate QTHs in parallel, so that the best of them can be chosen for full plots
+*/
+
+#ifndef SITE_SEARCH_H
+#define SITE_SEARCH_H
+
+#include "fields.h"
+#include "x_error.h"
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// error numbers
+constexpr int SITE_SEARCH_FILE_ERROR    { -1 },       ///< error reading a file of candidates
+              SITE_SEARCH_UNKNOWN_SCORE { -2 };       ///< unrecognised name of score
+
+/// a candidate site
+struct site_candidate
+{ std::string               name;                   ///< name of the site; used in the names of output files
+  std::pair<double, double> qth;                    ///< latitude and longitude of the site
+};
+
+/// the score by which candidates are ranked
+enum class SITE_SCORE { HORIZON,                    ///< mean elevation of the horizon over a sector of bearings; lower is better
+                        MHAT,                       ///< mean height of the antenna above the terrain; higher is better
+                        VISIBLE                     ///< fraction of the area that is visible from the antenna; higher is better
+                      };
+
+/// the parameters of a search
+struct site_search_request
+{ double     radius;                                ///< radius around each site over which it is scored, in metres
+  double     range_step;                            ///< distance between samples along each bearing, in metres
+  float      antenna_height;                        ///< height of the antenna, in metres
+  double     sector_start { 0 };                    ///< first bearing of the sector for the horizon score, in degrees
+  double     sector_end   { 360 };                  ///< bearing at the end of the sector for the horizon score, in degrees
+  SITE_SCORE rank_by      { SITE_SCORE::HORIZON };  ///< the score by which the sites are ranked
+};
+
+/// the scores of a site
+struct site_score
+{ site_candidate site;                              ///< the site
+  bool           valid            { false };        ///< whether the terrain height at the site is known
+  float          raw_height       { -9999 };        ///< height of the terrain at the site, per USGS
+  float          mean_horizon     { 0 };            ///< mean elevation of the horizon over the sector, in degrees
+  float          mhat             { 0 };            ///< mean height of the antenna above the terrain within the radius, in metres
+  float          visible_fraction { 0 };            ///< fraction of the area within the radius that is visible from the antenna
+};
+
+/*! \brief              Read candidate sites from a file
+    \param  filename    name of the file
+    \return             the candidates in the file
+
+    Each non-empty line contains the name, latitude and longitude of a site, separated by white space (the format of the QTH database).
+    Throws site_search_error if the file cannot be read.
+*/
+const std::vector<site_candidate> read_site_candidates(const std::string& filename);
+
+/*! \brief          Candidate sites on a regular grid
+    \param  south   southern edge of the area, in degrees
+    \param  west    western edge of the area, in degrees
+    \param  north   northern edge of the area, in degrees
+    \param  east    eastern edge of the area, in degrees
+    \param  step    distance between adjacent candidates, in metres
+    \return         the candidates, from SW to NE, named by their row and column
+*/
+const std::vector<site_candidate> grid_site_candidates(const double south, const double west, const double north, const double east, const double step);
+
+/*! \brief              The tiles needed to score a set of candidates
+    \param  candidates  the candidate sites
+    \param  radius      radius around each site over which it is scored, in metres
+    \return             the lat-long codes of the tiles that contain the area within <i>radius</i> of any candidate
+*/
+const std::set<int> site_search_tiles(const std::vector<site_candidate>& candidates, const double radius);
+
+/*! \brief              Score candidate sites, in parallel
+    \param  tiles       the tiles that contain the areas around the sites
+    \param  candidates  the candidate sites
+    \param  req         the parameters of the search
+    \param  n_threads   the number of threads to use
+    \return             the scores of all the sites, best first according to <i>req.rank_by</i>; sites without valid terrain are last
+
+    Each site is scored from one sweep outwards along each of 360 bearings, with no fields calculated, which takes
+    360 * (<i>req.radius</i> / <i>req.range_step</i>) terrain samples. With the range step that drmap uses (the radius divided by the
+    number of cells from the centre to the edge of the plot, n), that is 360n samples per site, whereas a full plot takes about
+    (2n + 1)^2 samples; so with the default n of 300, a full plot costs about as much as scoring three sites (and n / 90 sites in general)
+*/
+const std::vector<site_score> search_sites(const tile_map& tiles, const std::vector<site_candidate>& candidates, const site_search_request& req,
+                                           const unsigned int n_threads);
+
+/*! \brief          Convert a name to a score
+    \param  name    name of the score: "hzn", "mhat" or "visible"
+    \return         the score called <i>name</i>
+
+    Throws site_search_error if <i>name</i> is not recognised
+*/
+const SITE_SCORE site_score_from_name(const std::string& name);
+
+/*! \brief          Convert site scores to CSV
+    \param  scores  the scores
+    \return         the scores, one site per line after a header line
+*/
+const std::string site_scores_to_csv(const std::vector<site_score>& scores);
+
+// -------------------------------------- Errors  -----------------------------------
+
+/*! \class  site_search_error
+    \brief  Errors related to the search for sites
+*/
+
+class site_search_error : public x_error
+{
+protected:
+
+public:
+
+/*!	\brief	    Construct from error code and reason
+	\param	n	error code
+	\param	s	reason
+*/
+  inline site_search_error(const int n, const std::string& s) :
+    x_error(n, s)
+  { }
+};
+
+#endif    // SITE_SEARCH_H
@@ -0,0 +1,147 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   synth.h
+
+    Deterministic synthetic terrain, written as USGS-style GridFloat tiles
+*/
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include "x_error.h"
+
+#include <cstdint>
+#include <string>
+
+// error numbers
+constexpr int SYNTH_UNKNOWN_TERRAIN { -1 },         ///< unrecognised name of terrain
+              SYNTH_WRITE_ERROR     { -2 };         ///< error writing a tile
+
+constexpr int   USGS_CELLS_PER_DEGREE { 10800 };        ///< ⅓″ data
+constexpr int   USGS_TILE_OVERLAP     { 6 };            ///< number of cells by which USGS tiles overlap their neighbours, on each side
+constexpr float SYNTH_NODATA          { -9999 };        ///< NODATA value written into synthetic tiles
+
+/// the kinds of synthetic terrain
+enum class SYNTH_TERRAIN { MOUNTAINS,                   ///< fractal mountains everywhere
+                           PLAINS,                      ///< nearly-flat plains everywhere
+                           MIXED                        ///< mountains and plains, separated by a fractal coastline
+                         };
+
+// -----------  synthetic_terrain ----------------
+
+/*! \class  synthetic_terrain
+    \brief  A deterministic height field, defined for every latitude and longitude
+
+    The height at a point depends only on the seed, the parameters and the point itself, so the
+    overlapping cells of adjacent tiles always agree, and any tile may be regenerated independently
+    of the others.
+*/
+
+class synthetic_terrain
+{
+protected:
+
+  uint64_t      _seed;                  ///< seed from which everything is derived
+  SYNTH_TERRAIN _terrain;               ///< kind of terrain
+  double        _hole_probability;      ///< probability that a hole block contains a NODATA hole
+
+/*! \brief          Pseudo-random value associated with a lattice point
+    \param  ix      x lattice coordinate
+    \param  iy      y lattice coordinate
+    \param  octave  octave (or other discriminator)
+    \return         value in the range [0, 1)
+*/
+  const double _lattice_value(const int64_t ix, const int64_t iy, const int octave) const;
+
+/*! \brief              Smoothly-interpolated value noise
+    \param  x           x coordinate, in lattice units
+    \param  y           y coordinate, in lattice units
+    \param  octave      octave (or other discriminator)
+    \return             value in the range [0, 1)
+*/
+  const double _value_noise(const double x, const double y, const int octave) const;
+
+/*! \brief              Fractal Brownian motion
+    \param  x           x coordinate, in lattice units of the lowest octave
+    \param  y           y coordinate, in lattice units of the lowest octave
+    \param  n_octaves   number of octaves to sum
+    \param  octave_base discriminator of the lowest octave
+    \return             value in the range [0, 1)
+*/
+  const double _fbm(const double x, const double y, const int n_octaves, const int octave_base) const;
+
+/*! \brief              Is a point inside a NODATA hole?
+    \param  latitude    latitude of point
+    \param  longitude   longitude of point
+    \return             whether the point at <i>latitude</i>, <i>longitude</i> has no data
+*/
+  const bool _in_hole(const double latitude, const double longitude) const;
+
+public:
+
+/*! \brief                      Constructor
+    \param  seed                seed from which the terrain is derived
+    \param  terrain             kind of terrain
+    \param  hole_probability    probability that any 0.1° × 0.1° block contains a NODATA hole
+*/
+  synthetic_terrain(const uint64_t seed, const SYNTH_TERRAIN terrain = SYNTH_TERRAIN::MIXED, const double hole_probability = 0) :
+    _seed(seed),
+    _terrain(terrain),
+    _hole_probability(hole_probability)
+  { }
+
+/*! \brief              Height at a point
+    \param  latitude    latitude of point
+    \param  longitude   longitude of point
+    \return             the height, in metres, at <i>latitude</i>, <i>longitude</i>; SYNTH_NODATA if there are no data at the point
+*/
+  const float height(const double latitude, const double longitude) const;
+};
+
+/*! \brief                      Write a synthetic tile
+    \param  terrain             the terrain
+    \param  llcode              the llcode [lat * 1000 + (+ve)long] of the tile
+    \param  directory           directory into which the header and data files are written
+    \param  cells_per_degree    number of cells per degree of latitude or longitude
+    \return                     number of NODATA cells in the tile
+
+    The header and data files are named and laid out exactly as a USGS ⅓″ tile, including the
+    overlap of USGS_TILE_OVERLAP cells on each side
+*/
+const uint64_t write_synthetic_tile(const synthetic_terrain& terrain, const int llcode, const std::string& directory, const int cells_per_degree = USGS_CELLS_PER_DEGREE);
+
+/*! \brief          Convert a name to a kind of synthetic terrain
+    \param  name    name of the terrain: "mountains", "plains" or "mixed"
+    \return         the kind of terrain called <i>name</i>
+
+    Throws synth_error if <i>name</i> is not recognised
+*/
+const SYNTH_TERRAIN synth_terrain_from_name(const std::string& name);
+
+// -------------------------------------- Errors  -----------------------------------
+
+/*! \class  synth_error
+    \brief  Errors related to synthetic terrain
+*/
+
+class synth_error : public x_error
+{
+protected:
+
+public:
+
+/*!	\brief	    Construct from error code and reason
+	\param	n	error code
+	\param	s	reason
+*/
+  inline synth_error(const int n, const std::string& s) :
+    x_error(n, s)
+  { }
+};
+
+#endif    // SYNTH_H
@@ -0,0 +1,124 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   terrain_profile.h
+
+    Terrain profiles along great-circle paths from the QTH
+*/
+
+#ifndef TERRAIN_PROFILE_H
+#define TERRAIN_PROFILE_H
+
+#include "fields.h"
+#include "site_search.h"
+#include "x_error.h"
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// error numbers
+constexpr int TERRAIN_PROFILE_WRITE_ERROR { -1 };      ///< error writing profiles
+
+/// a path from the QTH
+struct profile_path
+{ std::string name;                 ///< name of the path
+  double      bearing;              ///< bearing from the QTH, in degrees
+  double      distance;             ///< length of the path, along the curved surface, in metres
+};
+
+/// one sample along a path
+struct profile_sample
+{ float distance;                   ///< distance from the QTH along the curved surface, in metres
+  float raw_height;                 ///< height of the terrain, per USGS; -9999 if NODATA
+  float height;                     ///< height parallel to the vertical at the QTH (see populate_fields()), in metres; -9999 if NODATA
+  float angle;                      ///< elevation angle as seen from the antenna, in degrees (-90 at the QTH); -9999 if NODATA
+};
+
+/// the terrain along a path
+struct terrain_profile
+{ profile_path                path;         ///< the path
+  std::vector<profile_sample> samples;      ///< the samples, from the QTH outwards
+};
+
+/*! \brief              The paths from the QTH to some targets
+    \param  qth         latitude and longitude of the QTH
+    \param  targets     the targets
+    \return             the path to each target, in the same order as <i>targets</i>
+*/
+const std::vector<profile_path> target_paths(const std::pair<double, double>& qth, const std::vector<site_candidate>& targets);
+
+/*! \brief              Evenly spaced paths from the QTH
+    \param  n_bearings  number of bearings
+    \param  distance    length of each path, in metres
+    \return             paths of length <i>distance</i> along the bearings 0, 360 / <i>n_bearings</i>, ... degrees, named by their bearings
+*/
+const std::vector<profile_path> bearing_paths(const int n_bearings, const double distance);
+
+/*! \brief              The tiles needed for some paths
+    \param  qth         latitude and longitude of the QTH
+    \param  paths       the paths
+    \param  step        distance between samples along each path, in metres
+    \return             the lat-long codes of the tiles that contain any sample
+*/
+const std::set<int> profile_tiles(const std::pair<double, double>& qth, const std::vector<profile_path>& paths, const double step);
+
+/*! \brief                  Extract the terrain along some paths, in parallel
+    \param  tiles           the tiles that contain the paths
+    \param  qth             latitude and longitude of the QTH
+    \param  eye_height      height of the antenna above the geoid (terrain plus antenna), in metres
+    \param  paths           the paths
+    \param  step            distance between samples along each path, in metres
+    \param  n_threads       the number of threads to use
+    \return                 the profile along each path, in the same order as <i>paths</i>
+
+    Each profile has a sample at the QTH, one every <i>step</i> metres, and one at the end of the path. The heights are
+    corrected for curvature in the same way as in populate_fields().
+*/
+const std::vector<terrain_profile> extract_profiles(const tile_map& tiles, const std::pair<double, double>& qth, const double eye_height,
+                                                    const std::vector<profile_path>& paths, const double step, const unsigned int n_threads);
+
+/*! \brief              Convert profiles to CSV
+    \param  profiles    the profiles
+    \return             one line per sample after a header line: name, bearing, distance, raw height, height, elevation angle
+*/
+const std::string profiles_to_csv(const std::vector<terrain_profile>& profiles);
+
+/*! \brief              Write profiles to a binary file
+    \param  profiles    the profiles
+    \param  filename    name of the file
+
+    All values are little-endian, whatever the byte order of the host. The file contains the number of profiles (uint32),
+    followed by each profile: the length of its name (uint16), the name, the bearing and length of the path (float64 each),
+    the number of samples (uint32), then the distance, raw height, height and elevation angle of each sample (float32 each).
+    Throws terrain_profile_error if the file cannot be written.
+*/
+void write_profiles_binary(const std::vector<terrain_profile>& profiles, const std::string& filename);
+
+// -------------------------------------- Errors  -----------------------------------
+
+/*! \class  terrain_profile_error
+    \brief  Errors related to terrain profiles
+*/
+
+class terrain_profile_error : public x_error
+{
+protected:
+
+public:
+
+/*!	\brief	    Construct from error code and reason
+	\param	n	error code
+	\param	s	reason
+*/
+  inline terrain_profile_error(const int n, const std::string& s) :
+    x_error(n, s)
+  { }
+};
+
+#endif    // TERRAIN_PROFILE_H
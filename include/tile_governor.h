@@ -0,0 +1,75 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   tile_governor.h
+
+    Move tiles between RAM, mapped files and disk according to the pressure on memory
+*/
+
+#ifndef TILE_GOVERNOR_H
+#define TILE_GOVERNOR_H
+
+#include "fields.h"
+#include "memory.h"
+
+#include <set>
+
+// -----------  tile_governor ----------------
+
+/*! \class  tile_governor
+    \brief  Demote tiles (RAM -> MAPPED -> DISK) when memory is short, and promote them again when it is not
+
+    Memory is short when the memory available to the process is below the low-water mark, or
+    when the PSI "some avg10" value exceeds a threshold. Tiles that are not needed for the current
+    plot are demoted first. Promotion occurs only while the available memory after the promotion would
+    remain above the high-water mark and PSI shows little pressure, and only for tiles that are needed.
+*/
+
+class tile_governor
+{
+protected:
+
+  memory_information& _mem_info;                ///< source of the memory information
+
+  uint64_t _low_water;                          ///< demote tiles if the available memory is less than this, in bytes
+  uint64_t _high_water;                         ///< promote a tile only if the available memory would remain above this, in bytes
+  double   _pressure_threshold;                 ///< demote tiles if PSI "some avg10" exceeds this, in per cent
+
+/*! \brief          Demote one tile by one step
+    \param  tiles   the tiles
+    \param  needed  the lat-long codes of the tiles needed for the current plot
+    \return         whether a tile was demoted
+*/
+  const bool _demote_one(tile_map& tiles, const std::set<int>& needed);
+
+/*! \brief          Promote one needed tile by one step, if there is room
+    \param  tiles   the tiles
+    \param  needed  the lat-long codes of the tiles needed for the current plot
+    \return         whether a tile was promoted
+*/
+  const bool _promote_one(tile_map& tiles, const std::set<int>& needed);
+
+public:
+
+/*! \brief                      Constructor
+    \param  mem_info            source of the memory information
+    \param  low_water           demote tiles if the available memory is less than this, in bytes
+    \param  high_water          promote a tile only if the available memory would remain above this, in bytes
+    \param  pressure_threshold  demote tiles if PSI "some avg10" exceeds this, in per cent
+*/
+  tile_governor(memory_information& mem_info, const uint64_t low_water = 500'000'000, const uint64_t high_water = 1'000'000'000, const double pressure_threshold = 10.0);
+
+/*! \brief          Demote or promote tiles until the use of memory is acceptable
+    \param  tiles   the tiles
+    \param  needed  the lat-long codes of the tiles needed for the current plot
+
+    This function MUST NOT be called while another thread is reading from <i>tiles</i>.
+*/
+  void rebalance(tile_map& tiles, const std::set<int>& needed);
+};
+
+#endif    // TILE_GOVERNOR_H
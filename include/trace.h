@@ -0,0 +1,183 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   trace.h
+
+    Per-thread event tracing, written in Chrome trace event format (readable by chrome://tracing and Perfetto)
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// a single complete ("ph": "X") event
+struct trace_event
+{ const char* name;             ///< name of the event; MUST be a string literal (or otherwise outlive the recorder)
+  const char* arg_name;         ///< name of the (optional) argument; nullptr if there is no argument
+  int64_t     arg_value;        ///< value of the argument
+  uint64_t    start_ns;         ///< start time, in ns since the recorder was enabled
+  uint64_t    duration_ns;      ///< duration, in ns
+};
+
+/// the events recorded by a single thread
+struct trace_buffer
+{ int                      tid;         ///< small integer identifying the thread
+  std::vector<trace_event> events;      ///< the events, in order of completion
+};
+
+// -----------  trace_recorder ----------------
+
+/*! \class  trace_recorder
+    \brief  Record timed events in per-thread buffers
+
+    Each thread appends to its own buffer, so recording an event needs no lock; a lock is
+    taken only the first time that a thread records an event. The buffers are owned by the
+    recorder, so events survive the threads that recorded them.
+*/
+
+class trace_recorder
+{
+protected:
+
+  bool                                       _enabled { false };   ///< whether to record anything
+  std::chrono::steady_clock::time_point      _origin;              ///< time at which recording was enabled
+  std::vector<std::unique_ptr<trace_buffer>> _buffers;             ///< one buffer per thread that has recorded an event
+  std::mutex                                 _buffers_mutex;       ///< mutex for <i>_buffers</i>
+
+/// the buffer for the current thread; creates the buffer if necessary
+  trace_buffer& _this_thread_buffer(void);
+
+public:
+
+/// is the recorder enabled?
+  inline const bool enabled(void) const
+    { return _enabled; }
+
+/// enable the recorder; the time origin is the time of this call
+  void enable(void);
+
+/*! \brief              Nanoseconds since the recorder was enabled
+    \param  tp          time point
+    \return             time between enabling the recorder and <i>tp</i>, in ns
+*/
+  inline const uint64_t ns_since_origin(const std::chrono::steady_clock::time_point& tp) const
+    { return std::chrono::duration_cast<std::chrono::nanoseconds>(tp - _origin).count(); }
+
+/*! \brief              Record a complete event for the current thread
+    \param  name        name of the event
+    \param  start       time at which the event started
+    \param  end         time at which the event ended
+    \param  arg_name    name of the optional argument (or nullptr)
+    \param  arg_value   value of the optional argument
+*/
+  void record(const char* name, const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end,
+              const char* arg_name = nullptr, const int64_t arg_value = 0);
+
+/*! \brief              Write all the recorded events to a file
+    \param  filename    name of the file
+
+    Must not be called while other threads may be recording events
+*/
+  void write(const std::string& filename);
+};
+
+extern trace_recorder TRACER;             ///< the trace recorder for the program
+
+// -----------  trace_scope ----------------
+
+/*! \class  trace_scope
+    \brief  RAII object that records its lifetime as an event in TRACER
+
+    Does nothing (beyond testing a bool) if TRACER is not enabled
+*/
+
+class trace_scope
+{
+protected:
+
+  const char*                           _name;          ///< name of the event
+  const char*                           _arg_name;      ///< name of the optional argument
+  int64_t                               _arg_value;     ///< value of the optional argument
+  bool                                  _active;        ///< whether the recorder was enabled at construction
+  std::chrono::steady_clock::time_point _start;         ///< time at construction
+
+public:
+
+/*! \brief              Constructor
+    \param  name        name of the event; MUST be a string literal
+    \param  arg_name    name of the optional argument; MUST be nullptr or a string literal
+    \param  arg_value   value of the optional argument
+*/
+  explicit inline trace_scope(const char* name, const char* arg_name = nullptr, const int64_t arg_value = 0) :
+    _name(name),
+    _arg_name(arg_name),
+    _arg_value(arg_value),
+    _active(TRACER.enabled())
+  { if (_active)
+      _start = std::chrono::steady_clock::now();
+  }
+
+/// destructor
+  inline ~trace_scope(void)
+  { if (_active)
+      TRACER.record(_name, _start, std::chrono::steady_clock::now(), _arg_name, _arg_value);
+  }
+
+  trace_scope(const trace_scope&) = delete;
+  trace_scope& operator=(const trace_scope&) = delete;
+};
+
+// -----------  traced_lock_guard ----------------
+
+/*! \class  traced_lock_guard
+    \brief  A lock_guard that records an event whenever it has to wait for the mutex
+
+    The event covers only the time spent blocked, so uncontended acquisitions record nothing
+*/
+
+template <typename M>
+class traced_lock_guard
+{
+protected:
+
+  M& _m;                        ///< the mutex
+
+public:
+
+/*! \brief          Constructor; acquires the mutex
+    \param  m       the mutex
+    \param  name    the name of the event recorded when the acquisition is contended; MUST be a string literal
+*/
+  inline traced_lock_guard(M& m, const char* name) :
+    _m(m)
+  { if (!TRACER.enabled())
+      _m.lock();
+    else
+    { if (!_m.try_lock())
+      { const auto start { std::chrono::steady_clock::now() };
+
+        _m.lock();
+        TRACER.record(name, start, std::chrono::steady_clock::now());
+      }
+    }
+  }
+
+/// destructor; releases the mutex
+  inline ~traced_lock_guard(void)
+    { _m.unlock(); }
+
+  traced_lock_guard(const traced_lock_guard&) = delete;
+  traced_lock_guard& operator=(const traced_lock_guard&) = delete;
+};
+
+#endif    // TRACE_H
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+
+# Released under the GNU Public License, version 2
+
+# Principal author: N7DR
+
+# Copyright owners:
+#    N7DR
+
+"""End-to-end benchmark of drmap over a fixed matrix of scenarios, with regression tracking.
+
+Synthetic tiles are written with drmap-synth, then drmap is run headless with -profile for every
+combination of radius, plot type, memory mode and number of threads. The phase timings and peak
+RSS of each scenario are compared with a stored baseline, and any metric that is worse than the
+baseline by more than the threshold is reported as a regression (and the exit status is 1).
+
+Typical use:
+
+    scripts/macrobench.py --update-baseline          # record a baseline
+    scripts/macrobench.py                            # compare against it
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+
+LATITUDE  = 40.5
+LONGITUDE = -105.5
+
+PLOT_TYPES = { "height" : [ ],                       # the height field alone
+               "los"    : [ "-los" ],
+               "hzn"    : [ "-hzn" ],
+               "grad"   : [ "-grad" ],
+               "elev"   : [ "-elev" ]
+             }
+
+MEMORY_MODES = { "ram" : [ ],
+                 "sm"  : [ "-sm" ]
+               }
+
+def default_threads():
+    """1, 2, 4, ... up to and including the number of CPUs"""
+    n_cpus = os.cpu_count() or 1
+    rv = [ ]
+    n = 1
+
+    while n < n_cpus:
+        rv.append(n)
+        n *= 2
+
+    rv.append(n_cpus)
+    return rv
+
+def csv_list(s, conversion = str):
+    return [ conversion(v) for v in s.split(",") if v ]
+
+def scenario_name(radius, plot_type, memory_mode, n_threads):
+    return f"r{radius}km-{plot_type}-{memory_mode}-t{n_threads}"
+
+def run_scenario(args, radius, plot_type, memory_mode, n_threads):
+    """run one scenario args.repeats times; return the best values of each metric"""
+    out_directory = os.path.join(args.workdir, "out")
+    profile_file  = os.path.join(out_directory, "profile.json")
+
+    command = [ args.drmap, "-call", "BENCH", "-datadir", os.path.join(args.workdir, "tiles"), "-outdir", out_directory,
+                "-lat", str(LATITUDE), "-long", str(LONGITUDE), "-radius", str(radius), "-cells", str(args.cells),
+                "-threads", str(n_threads), "-profile", profile_file ]
+    command += PLOT_TYPES[plot_type] + MEMORY_MODES[memory_mode]
+
+    if not args.with_r:
+        command.append("-headless")
+
+    best = { }
+
+    for _ in range(args.repeats):
+        start = time.monotonic()
+        subprocess.run(command, check = True, stdout = subprocess.DEVNULL)
+        total = time.monotonic() - start
+
+        with open(profile_file) as f:
+            profile = json.load(f)[0]
+
+        metrics = { "total_wall_s" : total, "peak_rss_bytes" : profile["peak_rss_bytes"] }
+
+        for phase, values in profile["phases"].items():
+            if values["calls"]:
+                metrics[phase + "_wall_s"] = values["wall_s"]
+
+        for key, value in metrics.items():
+            best[key] = min(value, best.get(key, value))
+
+    return best
+
+def compare(results, baseline, threshold, floor_s):
+    """return a list of descriptions of regressions"""
+    rv = [ ]
+
+    for name, metrics in sorted(results.items()):
+        if name not in baseline:
+            continue
+
+        for key, value in sorted(metrics.items()):
+            base = baseline[name].get(key)
+
+            if base is None or base <= 0:
+                continue
+
+            if key.endswith("_s") and max(value, base) < floor_s:        # too short to measure meaningfully
+                continue
+
+            ratio = value / base
+
+            if ratio > 1 + threshold:
+                rv.append(f"{name} {key}: {base:.4g} -> {value:.4g} (+{100 * (ratio - 1):.1f}%)")
+
+    return rv
+
+def main():
+    parser = argparse.ArgumentParser(description = __doc__, formatter_class = argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--drmap", default = "bin/drmap", help = "drmap executable")
+    parser.add_argument("--synth", default = "bin/drmap-synth", help = "drmap-synth executable")
+    parser.add_argument("--workdir", default = "/tmp/drmap-macrobench", help = "directory for tiles and output")
+    parser.add_argument("--baseline", default = "macrobench-baseline.json", help = "baseline file")
+    parser.add_argument("--update-baseline", action = "store_true", help = "write the results to the baseline file")
+    parser.add_argument("--threshold", type = float, default = 0.10, help = "fractional worsening that counts as a regression")
+    parser.add_argument("--floor", type = float, default = 0.05, help = "ignore times, in seconds, shorter than this")
+    parser.add_argument("--radii", default = "1,5,20,100", help = "comma-separated radii, in km")
+    parser.add_argument("--plots", default = ",".join(PLOT_TYPES), help = "comma-separated plot types")
+    parser.add_argument("--memory", default = ",".join(MEMORY_MODES), help = "comma-separated memory modes")
+    parser.add_argument("--threads", default = ",".join(str(n) for n in default_threads()), help = "comma-separated numbers of threads")
+    parser.add_argument("--cells", type = int, default = 300, help = "number of cells from the centre to the edge of each plot")
+    parser.add_argument("--cellsperdegree", type = int, default = 3600, help = "resolution of the synthetic tiles")
+    parser.add_argument("--seed", type = int, default = 1, help = "seed for the synthetic tiles")
+    parser.add_argument("--repeats", type = int, default = 3, help = "number of runs of each scenario; the best is kept")
+    parser.add_argument("--with-r", action = "store_true", help = "render the plots with R instead of running headless")
+    args = parser.parse_args()
+
+    radii        = csv_list(args.radii, int)
+    plot_types   = csv_list(args.plots)
+    memory_modes = csv_list(args.memory)
+    threads      = csv_list(args.threads, int)
+
+    for p in plot_types:
+        if p not in PLOT_TYPES:
+            sys.exit(f"unknown plot type: {p}")
+
+    for m in memory_modes:
+        if m not in MEMORY_MODES:
+            sys.exit(f"unknown memory mode: {m}")
+
+# the tiles; a stamp file records the parameters, so that tiles are rewritten only when necessary
+    tile_directory = os.path.join(args.workdir, "tiles")
+    os.makedirs(tile_directory, exist_ok = True)
+    os.makedirs(os.path.join(args.workdir, "out"), exist_ok = True)
+
+    stamp_file = os.path.join(tile_directory, "stamp")
+    stamp      = f"seed={args.seed} cellsperdegree={args.cellsperdegree} radius={max(radii)}"
+
+    if not os.path.exists(stamp_file) or open(stamp_file).read() != stamp:
+        print("writing synthetic tiles", flush = True)
+        subprocess.run([ args.synth, "-datadir", tile_directory, "-lat", str(LATITUDE), "-long", str(LONGITUDE),
+                         "-radius", str(max(radii) * 1.1), "-seed", str(args.seed), "-cellsperdegree", str(args.cellsperdegree),
+                         "-terrain", "mixed" ],
+                       check = True, stdout = subprocess.DEVNULL)
+
+        with open(stamp_file, "w") as f:
+            f.write(stamp)
+
+# the scenarios
+    results = { }
+
+    for radius in radii:
+        for plot_type in plot_types:
+            for memory_mode in memory_modes:
+                for n_threads in threads:
+                    name = scenario_name(radius, plot_type, memory_mode, n_threads)
+                    print(f"{name:32}", end = "", flush = True)
+                    results[name] = run_scenario(args, radius, plot_type, memory_mode, n_threads)
+                    print(f"{results[name]['total_wall_s']:10.3f} s {results[name]['peak_rss_bytes'] / 1e6:10.1f} MB", flush = True)
+
+    with open(os.path.join(args.workdir, "results.json"), "w") as f:
+        json.dump(results, f, indent = 2, sort_keys = True)
+
+    if args.update_baseline:
+        baseline = { }
+
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+
+        baseline.update(results)
+
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent = 2, sort_keys = True)
+
+        print(f"baseline written to {args.baseline}")
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print(f"no baseline file {args.baseline}; use --update-baseline to create one")
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    regressions = compare(results, baseline, args.threshold, args.floor)
+
+    for r in regressions:
+        print("REGRESSION: " + r)
+
+    print(f"{len(regressions)} regression(s) at a threshold of {100 * args.threshold:.0f}%")
+
+    return (1 if regressions else 0)
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,139 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   block_cache.cpp
+
+    Cache of blocks read from the data files of tiles, with CLOCK eviction
+*/
+
+#include "block_cache.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// -----------  block_cache ----------------
+
+/*! \class  block_cache
+    \brief  A fixed number of equal-sized blocks of float values, indexed by file and block number, with CLOCK eviction
+*/
+
+/*! \brief                  Constructor
+    \param  block_bytes     size of each block, in bytes; rounded to a power of two between MIN_CACHE_BLOCK_BYTES and MAX_CACHE_BLOCK_BYTES
+    \param  budget_bytes    maximum memory to use for the blocks, in bytes; at least one block is always held
+*/
+block_cache::block_cache(const size_t block_bytes, const size_t budget_bytes)
+{ _block_bytes = MIN_CACHE_BLOCK_BYTES;
+
+  while (_block_bytes * 2 <= min(block_bytes, MAX_CACHE_BLOCK_BYTES))
+    _block_bytes *= 2;
+
+  _n_slots = max(budget_bytes / _block_bytes, static_cast<size_t>(1));
+
+  _values.resize(_n_slots * (_block_bytes / sizeof(float)));
+  _file_ids.resize(_n_slots, 0);
+  _block_nrs.resize(_n_slots, 0);
+  _referenced.resize(_n_slots, 0);
+
+  size_t index_size { 1 };
+
+  while (index_size < 2 * _n_slots)             // keep the load factor no more than 0.5
+    index_size *= 2;
+
+  _index.resize(index_size, -1);
+  _index_mask = index_size - 1;
+}
+
+/*! \brief          Remove a slot from _index
+    \param  slot    the slot to remove
+
+    Uses backward-shift deletion, so that no tombstones are needed
+*/
+void block_cache::_unindex(const int32_t slot)
+{ size_t posn { _home(_file_ids[slot], _block_nrs[slot]) };
+
+  while (_index[posn] != slot)
+    posn = (posn + 1) & _index_mask;
+
+  size_t hole { posn };
+  size_t next { posn };
+
+  while (true)
+  { next = (next + 1) & _index_mask;
+
+    if (_index[next] == -1)
+      break;
+
+    const size_t home { _home(_file_ids[_index[next]], _block_nrs[_index[next]]) };
+
+// an entry may fill the hole only if its home is not cyclically within (hole, next]
+    const bool stays { (hole <= next) ? ( (hole < home) and (home <= next) ) : ( (hole < home) or (home <= next) ) };
+
+    if (!stays)
+    { _index[hole] = _index[next];
+      hole = next;
+    }
+  }
+
+  _index[hole] = -1;
+}
+
+/*! \brief              Find a block
+    \param  file_id     identifier of the file (non-zero)
+    \param  block_nr    number of the block
+    \return             pointer to the values in the block; nullptr if the block is not in the cache
+*/
+const float* block_cache::find(const uint64_t file_id, const uint64_t block_nr)
+{ for (size_t posn = _home(file_id, block_nr); _index[posn] != -1; posn = (posn + 1) & _index_mask)
+  { const int32_t slot { _index[posn] };
+
+    if ( (_file_ids[slot] == file_id) and (_block_nrs[slot] == block_nr) )
+    { _referenced[slot] = 1;
+      _hits++;
+
+      return &_values[slot * (_block_bytes / sizeof(float))];
+    }
+  }
+
+  _misses++;
+
+  return nullptr;
+}
+
+/*! \brief              Make room for a block, evicting another if necessary
+    \param  file_id     identifier of the file (non-zero)
+    \param  block_nr    number of the block
+    \return             pointer to the space for the values in the block, which the caller must fill
+
+    The block MUST NOT already be in the cache
+*/
+float* block_cache::insert(const uint64_t file_id, const uint64_t block_nr)
+{ while ( (_file_ids[_hand] != 0) and _referenced[_hand] )     // give referenced blocks a second chance
+  { _referenced[_hand] = 0;
+    _hand = (_hand + 1) % _n_slots;
+  }
+
+  const int32_t slot { static_cast<int32_t>(_hand) };
+
+  _hand = (_hand + 1) % _n_slots;
+
+  if (_file_ids[slot] != 0)
+    _unindex(slot);
+
+  _file_ids[slot] = file_id;
+  _block_nrs[slot] = block_nr;
+  _referenced[slot] = 1;
+
+  size_t posn { _home(file_id, block_nr) };
+
+  while (_index[posn] != -1)
+    posn = (posn + 1) & _index_mask;
+
+  _index[posn] = slot;
+
+  return &_values[slot * (_block_bytes / sizeof(float))];
+}
@@ -0,0 +1,133 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   coverage.cpp
+
+    The number of sites from which each cell of a plot is visible
+*/
+
+#include "coverage.h"
+#include "polar.h"
+#include "trace.h"
+
+#include <cmath>
+#include <future>
+#include <iostream>
+
+using namespace std;
+
+/*! \brief                  Run a function on every row of a plot, in parallel
+    \param  n_cells         number of cells from the centre to the edge of the plot
+    \param  n_threads       the number of threads to use
+    \param  f               function to be called with the offset of each row, delta_y
+
+    Thread <i>n</i> (wrt 0) processes every <i>n_threads</i>th row, starting with row <i>n</i>
+*/
+template <typename F>
+static void for_each_row(const int n_cells, const unsigned int n_threads, F f)
+{ auto process_rows = [&](const int start)
+    { for (int delta_y = -n_cells + start; delta_y <= n_cells; delta_y += static_cast<int>(n_threads))
+        f(delta_y);
+    };
+
+  vector<future<void>> vec_futures;
+
+  for (int start = 0; start < static_cast<int>(n_threads); ++start)
+    vec_futures.emplace_back(async(launch::async, process_rows, start));
+
+  for (auto& this_future : vec_futures)
+    this_future.get();                                  // .get() blocks until the future is available
+}
+
+/*! \brief                  The distance from the centre of a plot within which the terrain is needed to calculate its coverage
+    \param  centre          latitude and longitude of the centre of the plot
+    \param  distance_scale  radius of the plot, in metres
+    \param  sites           the sites
+    \return                 the distance from the centre of the plot to the farthest site, plus the distance to a corner of the plot, in metres
+*/
+const double coverage_reach(const pair<double, double>& centre, const double distance_scale, const vector<site_candidate>& sites)
+{ double rv { 0 };
+
+  for (const site_candidate& site : sites)
+    rv = max(rv, bd_from_ll(centre, site.qth).second);
+
+  return ( rv + sqrt(2.0) * distance_scale );
+}
+
+/*! \brief              Calculate the number of sites from which each cell of a plot is visible
+    \param  tiles       the tiles that contain the plot and the terrain between it and the sites
+    \param  req         the parameters of the plot; <i>req.qth</i> is its centre, and <i>req.antenna_height</i> is used at every site
+    \param  sites       the sites
+    \param  n_threads   the number of threads to use
+    \param  geometry    the geometry of the cells of the plot
+    \return             the coverage of the plot
+
+    The location of each cell is calculated once and shared by all the sites
+*/
+const coverage_field calculate_coverage(const tile_map& tiles, const field_request& req, const vector<site_candidate>& sites, const unsigned int n_threads,
+                                        const plot_geometry& geometry)
+{ const int size { 2 * req.n_cells + 1 };
+
+  coverage_field rv(size, vector<int>(size, 0));
+
+  vector<vector<pair<double, double>>> cell_ll(size, vector<pair<double, double>>(size));
+
+  for_each_row(req.n_cells, n_threads, [&](const int delta_y)
+    { for (int delta_x = -req.n_cells; delta_x <= req.n_cells; ++delta_x)
+      { const cell_geometry cell { geometry(delta_x, delta_y) };
+
+        cell_ll[delta_y + req.n_cells][delta_x + req.n_cells] = ll_from_bd(req.qth, cell.bearing, cell.distance);
+      }
+    });
+
+  for (const site_candidate& site : sites)
+  { const trace_scope site_trace("coverage site");
+
+    float raw_site_height { -9999 };
+
+    try
+    { raw_site_height = tiles.at(llc(site.qth)).interpolated_value(site.qth);
+    }
+
+    catch (...)                       // NODATA, or outside the tiles
+    { }
+
+    if (raw_site_height <= -9000)
+    { cerr << "No terrain height at site " << site.name << "; site ignored" << endl;
+      continue;
+    }
+
+// a polar field centred on the site, with enough cells to reach the farthest corner of the plot
+    const double site_offset { bd_from_ll(req.qth, site.qth).second };
+
+    field_request site_req { req };
+
+    site_req.qth = site.qth;
+    site_req.raw_qth_height = raw_site_height;
+    site_req.n_cells = req.n_cells + static_cast<int>(ceil(site_offset / (sqrt(2.0) * req.distance_per_square)));
+    site_req.elev = false;
+    site_req.grad = false;
+    site_req.los = true;
+    site_req.fresnel_frequency = 0;           // only the visibility is used
+    site_req.diffraction = false;
+
+    const polar_field polar(tiles, site_req, n_threads);
+
+    for_each_row(req.n_cells, n_threads, [&](const int delta_y)
+      { const int row_index { delta_y + req.n_cells };
+
+        for (int column_index = 0; column_index < size; ++column_index)
+        { const pair<double, double> bd { bd_from_ll(site.qth, cell_ll[row_index][column_index]) };
+
+          if (polar.visible(bd.first, bd.second))
+            rv[row_index][column_index]++;                      // each row is written by only one thread
+        }
+      });
+  }
+
+  return rv;
+}
@@ -52,23 +52,65 @@
         The number of cells from the centre of the plot to the edges. The default is 3/8 of the width of the plot, in pixels. For
         the default width of 800, the value is therefore 300.
         
+      -coverage <filename>
+      
+        Create a coverage plot, in which each cell is coloured according to the number of sites from which it is visible (cells visible
+        from none of the sites are black). The sites are read from the file <filename>, which has the same format as the QTH database;
+        the plot is centred on the QTH, as usual. The line of sight from each site is calculated as for -polar, with the antenna at
+        each site at the height given by -ant. The counts are also written, one line per row of cells from N to S, to the file
+        drmap-<call>-<radius>-coverage.csv in the output directory, even if -headless is present.
+        
       -datadir <directory>
       
         The directory that contains USGS GridFloat tiles
         
+      -diffraction <frequency>
+      
+        Create a diffraction plot for the given frequency, in MHz: the plotted value for each cell is the loss, in dB, due to diffraction over
+        the terrain along the path from the antenna to a receiving antenna above the cell (see -fresnelrx), estimated by the Deygout
+        multiple knife-edge method, with up to three edges. The losses are calculated by sweeping along bearings from the QTH, as for -polar, whether or not -polar
+        is present. If -fresnel is also present, the two frequencies must be the same.
+        
       -elev
       
         Create an elevation plot: the plotted values are the elevation of each cell as seen from the antenna. Most are therefore negative.
         
+      -fresnel <frequency>
+      
+        Create a Fresnel-clearance plot for the given frequency, in MHz. For each cell, the plotted value is the smallest ratio,
+        anywhere along the path from the antenna to a receiving antenna above the cell (see -fresnelrx), of the clearance between the path
+        and the terrain to the radius of the first Fresnel zone. The first Fresnel zone is clear where the ratio is at least 1; the path is
+        obstructed where it is negative. Ratios are plotted between -1 and 1. The ratios are calculated by sweeping along bearings from the
+        QTH, as for -polar, whether or not -polar is present.
+        
+      -fresnelrx <height>
+      
+        The height of the receiving antenna above the terrain for -diffraction and -fresnel. If -imperial is present, the height is in feet, otherwise it is
+        in metres. The default is 1.5m or 5 feet.
+        
       -grad
       
         Create a gradient plot: the plotted values are the gradient of the terrain in the direction from the QTH.
         
-      -hzn [distance limit]
+      -gradstencil
+      
+        Calculate the gradient plot from the differences in height between neighbouring cells, rather than by sampling the terrain
+        10m either side of each cell. This is much faster, but the gradient is measured over two cells rather than over 20m, so
+        it is smoother than the default, and only an approximation of it: it differs most at the edges of the plot and on steep
+        ground whose slope changes within a cell, and it is NODATA for any cell next to a cell with no data.
+        
+      -headless
+      
+        Calculate the fields (and horizon, if -hzn is present), but do not start R and do not create any plots. This is useful for timing
+        the calculations (see -profile) on machines that do not have R.
+        
+      -hzn [distance limit1[,distance limit2...]]
       
         Plot the elevation of the horizon around the periphery of the figure. Eye-level is set in the same way as eye-level for the
         -los option. Only distances out to the distance limit are used in this calculation. If the distance limit value is not present,
-        it is assumed to be the same as the radius of the figure.
+        it is assumed to be the same as the radius of the figure. If there are several limits, they are matched to the radii in increasing
+        order; if there are fewer limits than radii, the largest limit is used for the remaining radii. The horizons for all the limits
+        are calculated together, in one walk outwards along each bearing, and are reused for every radius.
         
       -imperial
       
@@ -89,28 +131,148 @@
         Create a line-of-sight plot in addition to the standard height-field plot. Eye-level is assumed to be 1.5m or 5 feet, unless
         the -ant option is presewnt, in which case eye-level is the same as the height of the antenna.
 
+      -mhat [distance]
+      
+        Calculate the MHAT for every radius that is a multiple of the given distance, up to the radius of each plot, in units of km unless
+        -imperial is present, in which case the units are miles. The default distance is 1. The values are taken from a radial histogram of
+        the heights of the cells, built while the fields are populated, so they cost no extra sampling. They are written to standard output
+        and to the file drmap-<call>-<radius>-mhat.csv in the output directory.
+        
       -outdir <directory>
       
         The directory into which the output maps should be written
         
+      -profileformat <csv | bin>
+      
+        The format of the files written by -profiles and -targets: CSV, with one line per sample, or a compact binary format (see write_profiles_binary()
+        in terrain_profile.h). The default is csv.
+        
+      -profilerange <distance>
+      
+        The length of the terrain profiles written by -profiles, in units of km unless -imperial is present, in which case the units are
+        miles. The default is the largest radius.
+        
+      -profiles <n>
+      
+        Write the terrain profiles along n evenly spaced bearings from the QTH, starting at north, for use by antenna-modelling programs,
+        and create no plots. The samples and formats are the same as for -targets (see -profilerange, -profilestep and -profileformat);
+        the profiles are named by their bearings, and are written to the file drmap-<call>-profiles.csv (or .bin) in the output directory.
+        R is not started. May be combined with -targets.
+        
+      -profilestep <distance>
+      
+        The distance between samples of the terrain profiles written by -profiles and -targets, in metres unless -imperial is present, in which case
+        the units are feet. The default is 10m or 33 feet, which is about the spacing of the USGS data.
+        
+      -profile [filename]
+      
+        Record the wall and CPU time spent in each phase of the calculation for each radius, together with counts of calls to
+        interpolated_value() and ll_from_bd(), the number of grid_float_errors thrown, the number of bytes read from tiles, and the 
+        peak RSS. The results are written as a JSON array, one element per radius, to the file <filename>. If no filename is present,
+        the file drmap-<call>-profile.json in the output directory is used.
+        
+      -trace <filename>
+      
+        Record a per-thread timeline of the run, and write it to the file <filename> in Chrome trace event format, suitable for
+        loading into chrome://tracing or Perfetto. The timeline contains the phases recorded by -profile, the per-row work of
+        each thread, the tiles as they are downloaded, and every occasion on which a thread had to wait for a mutex.
+        
       -radius <distance1[,distance2[,distance3...]]>
       
         One or more radii for the plot(s), in units of km unless -imperial is present, in which case the units are miles. 
         
+      -polar
+      
+        Calculate the fields by sweeping outwards from the QTH along closely spaced bearings, one sample per cell width along each
+        bearing, and then interpolate the results onto the cells of the plot. Each sweep determines the line of sight for every
+        point along it, so this is much faster than the default, which traces a separate path from the QTH to every cell, especially
+        for -los plots with a large radius. The results are an approximation: heights are interpolated between samples, and the
+        line of sight takes account of all the terrain between the QTH and a cell, including that very close to either end.
+        
       -qthdb <QTH database filename>
       
         A file linking QTH information to callsigns. Each line of the file should contain three entries pertaining to
         a station, separated by white space: the callsign, the latitude and the longitude. This database will be used only
         if one or both of the -lat and -long parameters is missing from the command line.
         
+      -searchbox <south,west,north,east>
+      
+        Search for the best site among candidates spaced evenly (see -searchstep) over the area bounded by the given latitudes and
+        longitudes. Each candidate is scored from a single sweep outwards along each of 360 bearings; no fields are calculated. All
+        the candidates are scored in parallel, using the same tiles, and the scores are written, best first, to the file
+        drmap-<call>-sites.csv in the output directory. Only the best sites (see -searchtop) are then plotted in full, for each radius;
+        the name of each site is appended to the callsign in the names of its output files. -lat and -long are not needed.
+        
+      -searchby <hzn | mhat | visible>
+      
+        The score by which the candidates are ranked: the mean elevation of the horizon within the sector (see -searchsector; lower is
+        better), the MHAT or the fraction of the area within the search radius that is visible from the antenna. The default is hzn.
+        
+      -searchradius <distance>
+      
+        The radius around each candidate over which it is scored, in units of km unless -imperial is present, in which case the units
+        are miles. The default is the largest radius of the plots.
+        
+      -searchsector <bearing1,bearing2>
+      
+        The bearings, in degrees, between which the elevation of the horizon is averaged to score the candidates. The sector may include
+        north (for example, 300,60). The default is all bearings.
+        
+      -searchstep <distance>
+      
+        The distance between the candidates of -searchbox, in metres unless -imperial is present, in which case the units are feet. The
+        default is 100m or 330 feet.
+        
+      -searchtop <n>
+      
+        The number of the best candidates to be plotted in full. If n is zero, the candidates are only scored. The default is 1.
+        
+      -sites <filename>
+      
+        Search for the best site among the candidates in the file <filename>, which has the same format as the QTH database. May be
+        combined with -searchbox.
+        
       -sm
       
         USGS tiles are each about 450MB in size. This parameter ("small memory") tells drmap to use the disk files that contain
         the tiles as-is, rather than moving them into RAM where their contents can be accessed much more quickly. Using this parameter
         therefore slows access, but means that there is essentially no limit to the number of tiles that may be used to build a plot. 
-        drmap automatically stops loading tiles into RAM when there is less than about 500MB of free RAM and switches to using the tiles
-        on disk, so ordinarily there is no need to worry about whether to use the "-sm" parameter. This parameter will be removed in 
+        Without this parameter, drmap moves tiles between RAM, memory-mapped files and disk according to the pressure on memory:
+        when there is less than about 500MB of available RAM (or, when running in a cgroup with a memory limit, less than about
+        500MB of headroom below the limit), or when the kernel reports (through /proc/pressure/memory) that tasks are stalling
+        for memory, tiles are demoted; when memory becomes plentiful again, the tiles needed for the current plot are promoted.
+        So ordinarily there is no need to worry about whether to use the "-sm" parameter. This parameter will be removed in
         future versions of drmap if it seems to be unneeded in practice.
+
+      -smblock <size>
+      -smcache <size>
+
+        Values are read from tiles on disk a block at a time, and each thread keeps a cache of the blocks that it has read.
+        -smblock is the size of a block in kB (4 to 64; the default is 16); -smcache is the size of each thread's cache in MB
+        (the default is 4).
+        
+      -ssmode <mean | max>
+      
+        How the samples of a cell are combined when -supersample is present. The default is mean.
+        
+      -supersample <k>
+      
+        Set the height of each cell from k × k samples of the terrain spread evenly over the cell, rather than from a single
+        sample at its centre. This avoids aliasing when a cell is much larger than the spacing of the USGS data (a cell of a
+        20km plot with the default 300 cells is about 67m across). Where fewer than k points of the USGS data lie across a cell,
+        each is used once. The default is 1.
+        
+      -targets <filename>
+      
+        Write the terrain profile along the great-circle path from the QTH to each of the targets in the file <filename>, which has the
+        same format as the QTH database, and create no plots. Each sample of a profile contains the distance from the QTH, the height of
+        the terrain per USGS, the height corrected for curvature in the same way as the plots, and the elevation angle as seen from the
+        antenna. The profiles are extracted in parallel and written to the file drmap-<call>-targets.csv (or .bin; see -profileformat) in
+        the output directory. R is not started.
+        
+      -threads <n>
+      
+        The number of threads to use for the per-cell calculations. The default is the number of CPUs.
         
       -width <pixels>
       
@@ -176,24 +338,30 @@
 */
 
 #include "command_line.h"
+#include "coverage.h"
 #include "diskfile.h"
+#include "fields.h"
 #include "grid_float.h"
 #include "memory.h"
+#include "polar.h"
+#include "profile.h"
+#include "rank.h"
+#include "site_search.h"
+#include "terrain_profile.h"
+#include "tile_governor.h"
+#include "trace.h"
 #include "r_figure.h"
 
 #include <complex>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <set>
 #include <thread>
 
 using namespace std;
 
-enum class VISIBILITY { UNKNOWN,
-                        VISIBLE,
-                        NOT_VISIBLE
-                      };
-
 constexpr double MTOF   { 3.28084 };          // metres to feet
 constexpr double FTOM   { 1 / MTOF };         // feet to metres
 constexpr double KMTOMI { 0.62137119 };       // km to miles
@@ -209,40 +377,20 @@ int    n_cells       { 300 };
 size_t total_n_cells { static_cast<size_t>( (2 * n_cells + 1) * (2 * n_cells + 1) ) }; // total number of cells on a plot
 
 set<int> tile_llcs;                                             // identifiers for the tiles we will need; we reference tiles by their lat-long codes [lat * 1000 + (+ve)long] 
-map<int /* lat-long code */, grid_float_tile> tiles;            // container for the actual tiles we will use
+tile_map tiles;                                                 // container for the actual tiles we will use
 
 // mutexes
-mutex angle_field_mutex;
-mutex height_field_mutex;
-mutex los_field_mutex;
-mutex mean_height_mutex;
 mutex tile_llcs_mutex;
 
 // forward declarations
-void calculate_needed_tiles(const float& distance_per_square, const pair<double, double>& qth, const bool los, const int delta_y_start, const int delta_y_increment);            ///< determine the needed tiles
+void calculate_needed_tiles(const plot_geometry& geometry, const pair<double, double>& qth, const bool los, const int delta_y_start, const int delta_y_increment);              ///< determine the needed tiles
+const map<double, array<float, 360>> calculate_horizons(const pair<double, double>& qth, const float eye, const set<double>& limits);                                           ///< horizons for several limits
+const vector<double> horizon_sample_distances(const set<double>& limits);                                                                                                       ///< where the horizons are sampled
 void call_lat_long(RInside& R, const string& callsign, const double latitude, const double longitude);
 void draw_logo(RInside& R, const double& distance_scale);                                                                                                                        ///< N7DR
 void draw_horizon_quadrilaterals(RInside& R, const double& distance_scale, const array<float, 360>& horizon, const value_map<float, int>& vm_horizon, const vector<string>& cv); ///< add horizon quadrilaterals to plot
-const float elevation_angle(const double& lat1, const double& long1, const double& lat2, const double& long2, const double& h1, const double& h2);
 void label_axes(RInside& R, const vector<int>& distances_km, const vector<int>& distances_in_metres, const string& long_distance_unit_str);
 void label_horizon_gradient(RInside& R, const float min_horizon, const float max_horizon, r_colour_gradient& colour_gradient);
-void populate_fields(const float& distance_per_square, const pair<double, double>& qth, const int delta_y_start, const int delta_y_increment,
-                     vector<vector<float>>& height_field, const float antenna_height, const double& distance_scale, float& sum_terrain_height,
-                     int& n_cells_terrain_height, const bool elev, const float raw_qth_height, vector<vector<float>>& angle_field,
-                     const bool los, vector<vector<VISIBILITY>>& los_field, const bool grad, vector<vector<float>>& grad_field);
-
-/*  \brief          Calculate the elevation above zero degrees of one point as seen from another
-    \param  ll1     latitude and longitude of first point
-    \param  ll2     latitude and longitude of second point
-    \param  h1      height of first point relative to sphere/geoid
-    \param  h2      height of first point relative to sphere/geoid
-    \return         the elevation of the second point as seen from the first point
-
-   The USGS "elevation" values are referenced to a geoid. Locally, and for the purpose of this
-   calculation, it's sufficient to treat the Earth between the two points as a sphere.
-*/
-inline const float elevation_angle(const pair<double, double>& ll1, const pair<double, double>& ll2, const double& h1, const double& h2)
-  { return elevation_angle(ll1.first, ll1.second, ll2.first, ll2.second, h1, h2); }
 
 // returned in metric
 const float command_line_value(const command_line& cl, const string& parameter, const float default_value, const bool imperial)
@@ -266,15 +414,52 @@ int main(int argc, char** argv)
   const string modified_callsign { (contains(callsign, "/") ? replace(callsign, "/", "-") : callsign) };    // can't use a "/" in filenames, so need a modified version
   const string data_directory    { cl.value_present("-datadir"s) ? cl.value("-datadir"s) : "/tmp/drmap"s };
   const string out_directory     { cl.value_present("-outdir"s) ? cl.value("-outdir"s) : "."s };
+  const string profile_filename  { (cl.value_present("-profile"s) and !starts_with(cl.value("-profile"s), "-"s)) ? cl.value("-profile"s) 
+                                                                                                                  : out_directory + "/drmap-"s + modified_callsign + "-profile.json"s };
   
 // read values from the command line 
   const bool         imperial { cl.parameter_present("-imperial"s) };  
   const bool         los      { cl.parameter_present("-los"s) };
   const bool         elev     { cl.parameter_present("-elev"s)  or cl.parameter_present("-angle"s)};
   const bool         grad     { cl.parameter_present("-grad"s) };
+  const bool         grad_stencil { cl.parameter_present("-gradstencil"s) };
+  const bool         polar        { cl.parameter_present("-polar"s) };
+  const double       fresnel_frequency { cl.value_present("-fresnel"s) ? from_string<double>(cl.value("-fresnel"s)) * 1e6 : 0 };    // Hz
+  const bool         fresnel           { fresnel_frequency > 0 };
+  const double       diffraction_frequency { cl.value_present("-diffraction"s) ? from_string<double>(cl.value("-diffraction"s)) * 1e6 : 0 };    // Hz
+  const bool         diffraction           { diffraction_frequency > 0 };
+
+  if (fresnel and diffraction and (fresnel_frequency != diffraction_frequency))
+  { cerr << "Error: -fresnel and -diffraction frequencies differ" << endl;
+    exit(-1);
+  }
+
+  const double       radio_frequency { fresnel ? fresnel_frequency : diffraction_frequency };    // Hz; zero if neither field is wanted
+  const int          supersample  { cl.value_present("-supersample"s) ? max(from_string<int>(cl.value("-supersample"s)), 1) : 1 };
+  const string       ssmode_str   { cl.value_present("-ssmode"s) ? to_lower(cl.value("-ssmode"s)) : "mean"s };
+
+  if ( (ssmode_str != "mean"s) and (ssmode_str != "max"s) )
+  { cerr << "Error: unknown -ssmode: " << ssmode_str << endl;
+    exit(-1);
+  }
+
+  const SUPERSAMPLE  supersample_mode { (ssmode_str == "max"s) ? SUPERSAMPLE::MAX : SUPERSAMPLE::MEAN };
+  const bool         headless { cl.parameter_present("-headless"s) };
+
+  const unsigned int n_threads { cl.value_present("-threads"s) ? max(from_string<unsigned int>(cl.value("-threads"s)), 1u) : max(N_CPUS, 1u) };
   
   debug = cl.parameter_present("-v"s) or cl.parameter_present("-debug"s);
 
+  configure_disk_cache( (cl.value_present("-smblock"s) ? from_string<size_t>(cl.value("-smblock"s)) : 16) * 1024,
+                        (cl.value_present("-smcache"s) ? from_string<size_t>(cl.value("-smcache"s)) : 4) * 1024 * 1024 );
+  
+  PROFILER.enabled(cl.parameter_present("-profile"s));
+
+  const string trace_filename { cl.value_present("-trace"s) ? cl.value("-trace"s) : string() };
+  
+  if (!trace_filename.empty())
+    TRACER.enable();
+
   const unsigned int width    { cl.value_present("-width"s) ? from_string<unsigned int>(cl.value("-width"s)) : 800 };
   
   if (width != 800)
@@ -285,12 +470,17 @@ int main(int argc, char** argv)
   
   const float  antenna_height  { command_line_value(cl, "-ant"s, 0, imperial) };                                                                // metres
   const float  los_height      { command_line_value(cl, "-los"s, (antenna_height ? antenna_height * MTOF : (imperial ? 5 : 1.5)), imperial) };  // metres; 5 => eye_level = 5 feet
+  const float  fresnel_rx_height { command_line_value(cl, "-fresnelrx"s, (imperial ? 5 : 1.5), imperial) };                                   // metres
+  const bool   mhat              { cl.parameter_present("-mhat"s) };                                                                            // MHAT curve?
+  const double mhat_step         { ( (cl.value_present("-mhat"s) and !starts_with(cl.value("-mhat"s), "-"s)) ? from_string<double>(cl.value("-mhat"s)) : 1 ) *
+                                   1000 * (imperial ? MITOKM : 1) };                                                                           // metres
+  const string fresnel_rx_str    { imperial ? to_string(static_cast<int>(round(fresnel_rx_height * MTOF))) : to_string(fresnel_rx_height, 1) };  // without unit
   const string qth_db_filename { cl.value_present("-qthdb"s) ? cl.value("-qthdb") : string() };                                                 // currently unused
 
   const bool  hzn     { cl.parameter_present("-hzn"s) };     // do we draw the horizon?
   const float hzn_eye { hzn ? los_height : 0 };             // height of eye for drawing horizon
   
-  double hzn_distance_limit { 0 };                      // cut-off distance for horizon calculation
+  double hzn_distance_limit { 0 };                      // cut-off distance for horizon calculation for the current plot
  
   const string hzn_eye_str { imperial ? to_string(static_cast<int>(round(hzn_eye * MTOF))) : to_string(hzn_eye, 1) };   // string describing height of horizon eye (without unit)
 
@@ -304,15 +494,39 @@ int main(int argc, char** argv)
   const string long_distance_unit_str { (imperial ? "miles"s : "km"s) };
 
   memory_information mem_info;              // so we can see if we are running short of memory when we request to load a tile
+  tile_governor      governor(mem_info);    // moves tiles between RAM, mapped files and disk as the pressure on memory changes
+
+  const bool small_memory { cl.parameter_present("-sm"s) };
+  const bool site_search  { cl.value_present("-sites"s) or cl.value_present("-searchbox"s) };
+
+  vector<site_candidate> coverage_sites;        // the sites for a coverage plot
+
+  if (cl.value_present("-coverage"s))
+  { try
+    { coverage_sites = read_site_candidates(cl.value("-coverage"s));
+    }
+
+    catch (const site_search_error& e)
+    { cerr << "Error: " << e.reason() << endl;
+      exit(-1);
+    }
+
+    if (coverage_sites.empty())
+    { cerr << "Error: no sites in " << cl.value("-coverage"s) << endl;
+      exit(-1);
+    }
+  }
+
+  const bool coverage { !coverage_sites.empty() };
 
 // check that something is giving us lat and long
-  if ( (!cl.value_present("-lat"s) or !cl.value_present("-long"s)) and !cl.value_present("-qthdb"s))
+  if ( (!cl.value_present("-lat"s) or !cl.value_present("-long"s)) and !cl.value_present("-qthdb"s) and !site_search)
   { cerr << "No QTH information available; need QTH database or lat/long info" << endl;
     exit(-1);
   }
 
 // try to read lat/long info from QTH file -- only if lat/long not set
-  if ( (!cl.value_present("-lat"s) or !cl.value_present("-long"s)) and !qth_db_filename.empty())
+  if ( (!cl.value_present("-lat"s) or !cl.value_present("-long"s)) and !qth_db_filename.empty() and !site_search)
   { if (!file_exists(qth_db_filename))
     { cerr << "Error: QTH database file " << qth_db_filename << " does not exist" << endl;
       exit(-1);
@@ -366,9 +580,32 @@ int main(int argc, char** argv)
   vector<double> distances_m { ( cl.value_present("-radius"s) ? cli_distances : (imperial ? imperial_distances : metric_distances) ) };     // radii to plot (in metres)
   
   sort(distances_m.begin(), distances_m.end());         // always go from smallest to largest area
-  
-  const pair<double, double> qth { latitude, longitude };                                       // the QTH
 
+// the cut-off distance for the horizon for each radius; limits from the command line are matched to the radii in increasing order
+  map<double, double> hzn_limits;         // key = radius; both in metres
+  set<double>         all_hzn_limits;     // every limit, in metres
+
+  if (hzn)
+  { vector<double> cli_hzn_limits;
+
+    if (cl.value_present("-hzn"s) and !starts_with(cl.value("-hzn"s), "-"s))
+    { for (const auto& limit : split_string(cl.value("-hzn"s), ','))
+        cli_hzn_limits.push_back(from_string<double>(limit) * 1000 * (imperial ? MITOKM : 1));   // convert to metres
+
+      sort(cli_hzn_limits.begin(), cli_hzn_limits.end());
+    }
+
+    for (size_t n = 0; n < distances_m.size(); ++n)
+    { const double limit { cli_hzn_limits.empty() ? distances_m[n] : cli_hzn_limits[min(n, cli_hzn_limits.size() - 1)] };    // no explicit value, so use distance
+
+      hzn_limits[distances_m[n]] = limit;
+      all_hzn_limits.insert(limit);
+    }
+  }
+
+  map<double, array<float, 360>> horizons;                              // horizons for every limit, in degrees; calculated once per site
+  pair<double, double>           horizons_qth { 1000, 1000 };           // the QTH for which horizons was calculated
+  
 // debug
   if (debug)
   { for (unsigned int n = 0; n < distances_m.size(); ++n)
@@ -378,19 +615,237 @@ int main(int argc, char** argv)
     cout << "QTH = " << latitude << ", " << longitude << endl;
   }
 
-  RInside R { };        // we will need a running instance of R in order to create the plots
+  vector<string> profile_summaries;     // one JSON summary per radius
+
+// record the profile (if any) for a radius
+  auto end_of_radius = [&](const double distance_scale)
+    { if (PROFILER.enabled())
+      { profile_summaries.push_back(PROFILER.to_json(distance_scale, mem_info.peak_rss()));
+        PROFILER.reset();
+      }
+    };
  
-// the big loop -- generate the height field for a particular distance
-  for (const auto& distance_scale : distances_m)
-  { const float distance_per_square { static_cast<float>(distance_scale / n_cells) };     // width/height of a cell (in m) along curved surface
+// download the tiles in tile_llcs that we don't yet have, and make them all available; tiles from a preceding plot (if any) are retained,
+// since the plots go from smallest to largest area
+  auto make_tiles_available = [&](void)
+    {
+// download the new tiles in parallel
+      { phase_timer timer(PHASE::DOWNLOAD);
+    
+        vector<future<void>> vec_futures;    
+
+        for (const auto& tile_llc : tile_llcs)
+          vec_futures.emplace_back(async(launch::async, download_if_necessary, tile_llc, data_directory));
+    
+        for (auto& this_future : vec_futures)
+          this_future.get();                                  // .get() blocks until the future is available
+      }
+    
+// new tiles start out mapped, and the governor moves them into RAM if there is room
+      { phase_timer timer(PHASE::LOAD);
+    
+        for (const auto& tile_llc : tile_llcs)
+        { if (tiles.count(tile_llc) == 0)
+          { tiles.insert( { tile_llc, grid_float_tile(local_header_filename(tile_llc, data_directory), local_data_filename(tile_llc, data_directory), (small_memory ? TILE_STORAGE::DISK : TILE_STORAGE::MAPPED)) } );
+
+            if (!small_memory)
+              governor.rebalance(tiles, tile_llcs);
+          }
+        }
+
+        if (!small_memory)
+          governor.rebalance(tiles, tile_llcs);             // the tiles needed for this plot may have changed even if none was loaded
+      }
+    };
+
+// terrain profiles, instead of plots
+  const bool   profile_mode   { cl.value_present("-targets"s) or cl.value_present("-profiles"s) };
+  const string profile_format { cl.value_present("-profileformat"s) ? to_lower(cl.value("-profileformat"s)) : "csv"s };
+
+  if ( (profile_format != "csv"s) and (profile_format != "bin"s) )
+  { cerr << "Error: unknown -profileformat: " << profile_format << endl;
+    exit(-1);
+  }
+
+  if (profile_mode)
+  { const pair<double, double> qth  { latitude, longitude };                                                       // the QTH
+    const double               step { command_line_value(cl, "-profilestep"s, (imperial ? 33 : 10), imperial) };  // metres
+
+    vector<pair<string, vector<profile_path>>> path_sets;        // the paths, and the name of the file to which their profiles are written
+
+    if (cl.value_present("-targets"s))
+    { try
+      { path_sets.push_back( { "targets"s, target_paths(qth, read_site_candidates(cl.value("-targets"s))) } );
+      }
+
+      catch (const site_search_error& e)
+      { cerr << "Error: " << e.reason() << endl;
+        exit(-1);
+      }
+    }
+
+    if (cl.value_present("-profiles"s))
+    { const double profile_range { cl.value_present("-profilerange"s) ? from_string<double>(cl.value("-profilerange"s)) * 1000 * (imperial ? MITOKM : 1)
+                                                                      : distances_m.back() };
+
+      path_sets.push_back( { "profiles"s, bearing_paths(max(from_string<int>(cl.value("-profiles"s)), 1), profile_range) } );
+    }
+
+    tile_llcs.clear();
+
+    for (const auto& [ name, paths ] : path_sets)
+      for (const int tile_llc : profile_tiles(qth, paths, step))
+        tile_llcs.insert(tile_llc);
+
+    make_tiles_available();
+
+    const float raw_qth_height { tiles.at(llc(qth)).interpolated_value(qth) };
+
+    for (const auto& [ name, paths ] : path_sets)
+    { vector<terrain_profile> profiles;
+
+      { phase_timer timer(PHASE::TERRAIN_PROFILES);
+
+        profiles = extract_profiles(tiles, qth, raw_qth_height + antenna_height, paths, step, n_threads);
+      }
+
+      const string filename { out_directory + "/drmap-"s + modified_callsign + "-"s + name + "."s + profile_format };
+
+      try
+      { if (profile_format == "bin"s)
+          write_profiles_binary(profiles, filename);
+        else
+          write_file(profiles_to_csv(profiles), filename);
+      }
+
+      catch (const terrain_profile_error& e)
+      { cerr << "Error: " << e.reason() << endl;
+        exit(-1);
+      }
+    }
+
+    if (PROFILER.enabled())
+      write_file("[\n"s + PROFILER.to_json(0, mem_info.peak_rss()) + "\n]\n"s, profile_filename);
+  
+    if (TRACER.enabled())
+      TRACER.write(trace_filename);
+
+    return 0;
+  }
+
+// the sites to plot: the QTH, or the best candidates from a search
+  vector<site_candidate> plot_sites { { string(), { latitude, longitude } } };
+
+  if (site_search)
+  { vector<site_candidate> candidates;
+    site_search_request    search_req { (cl.value_present("-searchradius"s) ? from_string<double>(cl.value("-searchradius"s)) * 1000 * (imperial ? MITOKM : 1) : distances_m.back()),
+                                        0, antenna_height };
+
+    search_req.range_step = search_req.radius / n_cells;             // sample the terrain as finely as for a plot of the same radius
+
+    try
+    { if (cl.value_present("-sites"s))
+        candidates = read_site_candidates(cl.value("-sites"s));
+
+      if (cl.value_present("-searchbox"s))
+      { const vector<string> box { split_string(cl.value("-searchbox"s), ',') };
+
+        if (box.size() != 4)
+        { cerr << "Error: -searchbox needs four values: south,west,north,east" << endl;
+          exit(-1);
+        }
+
+        const double                 step { command_line_value(cl, "-searchstep"s, (imperial ? 330 : 100), imperial) };    // metres
+        const vector<site_candidate> grid { grid_site_candidates(from_string<double>(box[0]), -abs(from_string<double>(box[1])),
+                                                                 from_string<double>(box[2]), -abs(from_string<double>(box[3])), step) };
+
+        candidates.insert(candidates.end(), grid.begin(), grid.end());
+      }
+
+      if (cl.value_present("-searchsector"s))
+      { const vector<string> sector { split_string(cl.value("-searchsector"s), ',') };
+
+        if (sector.size() != 2)
+        { cerr << "Error: -searchsector needs two bearings" << endl;
+          exit(-1);
+        }
+
+        search_req.sector_start = from_string<double>(sector[0]);
+        search_req.sector_end = from_string<double>(sector[1]);
+      }
+
+      if (cl.value_present("-searchby"s))
+        search_req.rank_by = site_score_from_name(cl.value("-searchby"s));
+    }
+
+    catch (const site_search_error& e)
+    { cerr << "Error: " << e.reason() << endl;
+      exit(-1);
+    }
+
+    if (candidates.empty())
+    { cerr << "Error: no candidate sites" << endl;
+      exit(-1);
+    }
+
+    tile_llcs = site_search_tiles(candidates, search_req.radius);
+    make_tiles_available();
+
+    vector<site_score> scores;
+
+    { phase_timer timer(PHASE::SITE_SEARCH);
+
+      scores = search_sites(tiles, candidates, search_req, n_threads);
+    }
+
+    write_file(site_scores_to_csv(scores), out_directory + "/drmap-"s + modified_callsign + "-sites.csv"s);
+
+    const size_t n_top { cl.value_present("-searchtop"s) ? from_string<size_t>(cl.value("-searchtop"s)) : 1 };
+
+    plot_sites.clear();
+
+    for (size_t n = 0; (n < scores.size()) and (plot_sites.size() < n_top) and scores[n].valid; ++n)
+    { const site_score& score { scores[n] };
+
+      cout << "site " << (n + 1) << ": " << score.site.name << " (" << score.site.qth.first << ", " << score.site.qth.second << ")"
+           << "  hzn = " << score.mean_horizon << "°"
+           << "  MHAT = " << (imperial ? score.mhat * MTOF : score.mhat) << height_unit_str
+           << "  visible = " << (score.visible_fraction * 100) << "%" << endl;
+
+      plot_sites.push_back(score.site);
+    }
+  }
+
+  optional<RInside> r_instance;         // we will need a running instance of R in order to create the plots, unless headless
+
+  if (!headless)
+  { phase_timer r_startup_timer(PHASE::R_STARTUP);
+  
+    r_instance.emplace();
+  }
+
+// the plots: for each site, the radii from smallest to largest
+  vector<pair<site_candidate, double>> plots;
+
+  for (const auto& site : plot_sites)
+    for (const auto& distance_scale : distances_m)
+      plots.push_back( { site, distance_scale } );
+
+// the big loop -- generate the height field for a particular site and distance
+  for (const auto& plot : plots)
+  { const site_candidate&       site                { plot.first };
+    const double&                distance_scale      { plot.second };
+    const pair<double, double>&  qth                 { site.qth };                                                                  // the QTH
+    const string                 plot_name           { modified_callsign + (site.name.empty() ? string() : "-"s + site.name) };   // used in the names of the output files
+    const float                  distance_per_square { static_cast<float>(distance_scale / n_cells) };                           // width/height of a cell (in m) along curved surface
+
+    const plot_geometry geometry(n_cells, distance_per_square);                           // bearing and distance of every cell; calculated for one octant only
 
 // set the farthest limit for the horizon calculation
     if (hzn)
-    { if ( !cl.value_present("-hzn"s) or ( (cl.value_present("-hzn"s)) and (starts_with(cl.value("-hzn"s), "-")) ) )      // no explicit value, so use distance
-        hzn_distance_limit = distance_scale;
-      else
-        hzn_distance_limit = from_string<double>(cl.value("-hzn"s)) * 1000 * (imperial ? MITOKM : 1);   // convert to metres
-    }
+      hzn_distance_limit = hzn_limits.at(distance_scale);
+
+    const bool new_horizons { hzn and (qth != horizons_qth) };       // do we need to calculate the horizons?
 
     const string hzn_str { to_string(int( (hzn_distance_limit / (imperial ? (1000 * MITOKM) : 1000) ) + 0.01)) };
 
@@ -405,20 +860,25 @@ int main(int argc, char** argv)
     }
 
 // in parallel, determine the tiles that are needed
-    { vector<future<void>> vec_futures;    
+    { phase_timer timer(PHASE::TILE_NEEDS);
+    
+      vector<future<void>> vec_futures;    
+
+      const int n_tile_threads { max(static_cast<int>(n_threads) - 1, 1) };          // the main thread does the hzn calculation
 
-      for (int start = 1; start < static_cast<int>(N_CPUS); ++start)
-        vec_futures.emplace_back(async(launch::async, calculate_needed_tiles, distance_per_square, qth, los, (-n_cells + (start - 1)), (N_CPUS - 1)));
+      for (int start = 1; start <= n_tile_threads; ++start)
+        vec_futures.emplace_back(async(launch::async, calculate_needed_tiles, cref(geometry), qth, los, (-n_cells + (start - 1)), n_tile_threads));
     
-// hzn is done separately, because it is calculated only once, not per-cell 
-      if (hzn)
-      { for (int bearing = 0; bearing < 360; bearing += 1)
-        { for (int pc = 1; pc <=100; ++pc)
-          { const double               distance_to_square_n { (pc * hzn_distance_limit) / 100 };           // assumes hzn_distance_limit isn't something sillily small
-            const pair<double, double> ll_n                 { ll_from_bd(qth, bearing, distance_to_square_n) };
+// hzn is done separately, because it is calculated only once per site, not per-cell; the tiles for all the limits are needed at once
+      if (new_horizons)
+      { const vector<double> hzn_distances { horizon_sample_distances(all_hzn_limits) };
+
+        for (int bearing = 0; bearing < 360; bearing += 1)
+        { for (const double distance_to_square_n : hzn_distances)
+          { const pair<double, double> ll_n                 { ll_from_bd(qth, bearing, distance_to_square_n) };
             const auto                 lat_long_code        { llc(ll_n) };
 
-            { lock_guard<mutex> tile_llcs_lock(tile_llcs_mutex);
+            { traced_lock_guard<mutex> tile_llcs_lock(tile_llcs_mutex, "wait tile_llcs_mutex");
             
               tile_llcs.insert(lat_long_code);
             }
@@ -428,6 +888,11 @@ int main(int argc, char** argv)
     
       for (auto& this_future : vec_futures)
         this_future.get();                                  // .get() blocks until the future is available
+
+// the terrain between the coverage sites and the plot
+      if (coverage)
+        for (const int tile_llc : site_search_tiles(coverage_sites, coverage_reach(qth, distance_scale, coverage_sites)))
+          tile_llcs.insert(tile_llc);
     }
 
     if (debug)
@@ -435,32 +900,20 @@ int main(int argc, char** argv)
                                                                     // downloaded later as necessary; decreasing the bearing increment and decreasing the
                                                                     // size of steps along a bearing decreases the probability of missing tiles
 
-    tiles.clear();                                                // remove any memory of what we used on the preceding plot (if any)
-
-// download the new tiles in parallel
-    { vector<future<void>> vec_futures;    
 
-      for (const auto& tile_llc : tile_llcs)
-        vec_futures.emplace_back(async(launch::async, download_if_necessary, tile_llc, data_directory));
-    
-      for (auto& this_future : vec_futures)
-        this_future.get();                                  // .get() blocks until the future is available
-    }
-    
-// make the tiles available   
-    for (const auto& tile_llc : tile_llcs)
-      tiles.insert( { tile_llc, move(grid_float_tile(local_header_filename(tile_llc, data_directory), local_data_filename(tile_llc, data_directory), (cl.parameter_present("-sm"s) or (mem_info.mem_available(true) < 500'000'000)))) } );  // I don't know why move doesn't fix the crash
+    make_tiles_available();
     
     if (debug)
       cout << "Calculating map for distance = " << comma_separated_string(int(distance_scale + 0.5)) << endl;
     
-    vector<vector<float>>      angle_field(2 * n_cells + 1, vector<float>(2 * n_cells + 1, 0));                             // the angle-of-elevation field, set to zero
-    vector<vector<float>>      grad_field(2 * n_cells + 1, vector<float>(2 * n_cells + 1, 0));                              // the QTH-based gradient field, set to zero
-    vector<vector<float>>      height_field(2 * n_cells + 1, vector<float>(2 * n_cells + 1, 0));                            // the actual height field, set to zero; will later INCLUDE antenna in the QTH cell
-    vector<vector<VISIBILITY>> los_field(2 * n_cells + 1, vector<VISIBILITY>(2 * n_cells + 1, VISIBILITY::UNKNOWN));        // LOS field, set to UNKNOWN
+    field_set fields(n_cells);
 
-    float  sum_terrain_height     { 0 };             // used for calculating mean height
-    int    n_cells_terrain_height { 0 };             // used for calculating mean height
+    const vector<vector<float>>&      angle_field            { fields.angle };           // the angle-of-elevation field
+    const vector<vector<float>>&      grad_field             { fields.grad };            // the QTH-based gradient field
+    const vector<vector<float>>&      height_field           { fields.height };          // the actual height field; INCLUDES antenna in the QTH cell
+    const vector<vector<VISIBILITY>>& los_field              { fields.los };             // LOS field
+    const field_statistics&           stats                  { fields.stats };           // accumulated while the fields are populated
+    const int&                        n_cells_terrain_height { stats.n_cells_terrain_height };   // used for calculating mean height
 
     const float raw_qth_height { tiles.at(llc(qth)).interpolated_value(qth) };      // so we have it to use to calculate visibility as we step through the cells
 
@@ -471,40 +924,73 @@ int main(int argc, char** argv)
         cout << "LOS height = " << (imperial ? los_height * MTOF : los_height) << height_unit_str << endl;
     }
     
-// step through each cell in the display  
-    { vector<future<void>> vec_futures;    
+    const field_request req { qth, n_cells, distance_per_square, distance_scale, antenna_height, raw_qth_height, elev, los, grad,
+                              (grad_stencil ? GRADIENT_METHOD::STENCIL : GRADIENT_METHOD::SAMPLE), supersample, supersample_mode,
+                              radio_frequency, fresnel_rx_height, diffraction, (mhat ? mhat_step : 0) };
 
-      for (int start = 1; start <= static_cast<int>(N_CPUS); ++start)
-        vec_futures.emplace_back(async(launch::async, populate_fields, 
-                                distance_per_square, qth, (-n_cells + (start - 1)), (N_CPUS ),
-                                ref(height_field), antenna_height, distance_scale, ref(sum_terrain_height),
-                                ref(n_cells_terrain_height), elev, raw_qth_height, ref(angle_field),
-                                los, ref(los_field), grad, ref(grad_field)));
+// step through each cell in the display  
+    { phase_timer timer(PHASE::POPULATE_FIELDS);
     
-      for (auto& this_future : vec_futures)
-        this_future.get();                                  // .get() blocks until the future is available
+      if (polar)
+        calculate_polar_fields(tiles, req, n_threads, fields, geometry);        // includes the Fresnel clearance and diffraction
+      else
+        calculate_fields(tiles, req, n_threads, fields, &geometry);
+    }
+
+    if ( (fresnel or diffraction) and !polar)
+    { phase_timer timer(PHASE::RADIO_FIELDS);
+
+      calculate_radio_fields(tiles, req, n_threads, fields, geometry);
+    }
+
+    const string distance_str { to_string(static_cast<int>( (distance_scale + 1) * (imperial? (MTOF / 5280) : (1.0 / 1000) ) ) ) };
+
+    coverage_field coverage_counts;           // the number of coverage sites from which each cell is visible
+
+    if (coverage)
+    { phase_timer timer(PHASE::COVERAGE);
+
+      coverage_counts = calculate_coverage(tiles, req, coverage_sites, n_threads, geometry);
+
+      string coverage_csv;
+
+      for (auto row_it = coverage_counts.crbegin(); row_it != coverage_counts.crend(); ++row_it)     // N to S
+      { vector<string> counts;
+
+        for (const int count : *row_it)
+          counts.push_back(to_string(count));
+
+        coverage_csv += join(counts, ","s) + "\n"s;
+      }
+
+      write_file(coverage_csv, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + "-coverage.csv"s);
     }
     
     if (n_cells_terrain_height)         // do we have an average?
-    { const float mean_terrain_height       { sum_terrain_height / n_cells_terrain_height };            // does NOT include antenna at QTH
+    { const float mean_terrain_height       { static_cast<float>(stats.sum_terrain_height / n_cells_terrain_height) };            // does NOT include antenna at QTH
       const float mean_height_above_terrain { raw_qth_height + antenna_height - mean_terrain_height };
     
       if (debug)
         cout << "MHAT = " << (imperial ? mean_height_above_terrain * MTOF : mean_height_above_terrain) << height_unit_str << endl;
     }
 
-// find the extremes of height, for use in calculating the colour gradient; these are in I/O units    
-    float min_height { numeric_limits<float>::max() };
-    float max_height { numeric_limits<float>::lowest() };
-    
-    for (const auto& vf : height_field)
-    { for (const auto& height : vf)
-      { const auto height_wrt_antenna { height - (raw_qth_height + antenna_height) };            // sets zero to the antenna because height_field at QTH INCLUDES antenna
+    if (mhat)                           // the MHAT curve, in I/O units
+    { string mhat_csv { "radius_"s + distance_unit_str + ",mhat_"s + height_unit_str + "\n"s };
+
+      for (const auto& [radius, mhat_value] : mhat_curve(stats, raw_qth_height + antenna_height, mhat_step, distance_scale))
+      { const string radius_str { to_string(radius / (imperial ? (1000 * MITOKM) : 1000), 2) };
+        const string height_str { to_string(mhat_value * (imperial ? MTOF : 1), 1) };
 
-        min_height = min(height_wrt_antenna, min_height);
-        max_height = max(height_wrt_antenna, max_height);
+        cout << "MHAT(" << radius_str << distance_unit_str << ") = " << height_str << height_unit_str << endl;
+        mhat_csv += radius_str + ","s + height_str + "\n"s;
       }
+
+      write_file(mhat_csv, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + "-mhat.csv"s);
     }
+
+// the extremes of height, for use in calculating the colour gradient; these are in I/O units    
+    float min_height { stats.min_height - (raw_qth_height + antenna_height) };          // sets zero to the antenna because height_field at QTH INCLUDES antenna
+    float max_height { stats.max_height - (raw_qth_height + antenna_height) };
     
     if (imperial)
     { min_height *= MTOF;
@@ -552,20 +1038,14 @@ int main(int argc, char** argv)
     array<float, 360> horizon;
 
     if (hzn)
-    { for (int bearing = 0; bearing < 360; bearing += 1)
-      { horizon[bearing] = numeric_limits<float>::lowest();
-    
-        for (int pc = 1; pc <=100; ++pc)
-        { const double               distance_to_square_n { (pc * hzn_distance_limit) / (100) };
-          const pair<double, double> ll_n                 { ll_from_bd(qth, bearing, distance_to_square_n) };
-          const float                raw_value_n          { tiles.at(llc(ll_n)).interpolated_value(ll_n) };
-          const float                angle_n              { elevation_angle(qth, ll_n, raw_qth_height + antenna_height, raw_value_n) };              
-          
-          horizon[bearing] = max(horizon[bearing], angle_n);        
-        }
-      
-        horizon[bearing] *= RTOD;     // convert to degrees
+    { if (new_horizons)
+      { phase_timer timer(PHASE::HORIZON);
+    
+        horizons = calculate_horizons(qth, raw_qth_height + antenna_height, all_hzn_limits);
+        horizons_qth = qth;
       }
+
+      horizon = horizons.at(hzn_distance_limit);
     }
     
     const float min_horizon { floor(MIN_ELEMENT(horizon)) };
@@ -579,16 +1059,22 @@ int main(int argc, char** argv)
     const value_map<float, int> vm_horizon(min_horizon, max_horizon, 0 /* min index into cv */, 999 /* max index into cv */);
     
  // image(s)
+    if (headless)
+    { end_of_radius(distance_scale);
+      continue;
+    }
+
+    RInside& R { *r_instance };
+    
     const vector<array<float, 4>> screen_definitions { { 0.0, 0.75, 0.0, 1.0 },
                                                        { 0.71, 0.82, 0.0, 1.0 },        // overlap!
                                                        { 0.82, 1.0, 0.0, 1.0 }
                                                      };
 
-    const string distance_str { to_string(static_cast<int>( (distance_scale + 1) * (imperial? (MTOF / 5280) : (1.0 / 1000) ) ) ) };
-
 // the basic height map
+    phase_timer height_render_timer(PHASE::RENDER_HEIGHT);
     
-    create_figure(R, out_directory + "/drmap-"s + modified_callsign + "-" + distance_str + distance_unit_str + ".png"s, width, ( (3 * width) / 4 ));
+    create_figure(R, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + ".png"s, width, ( (3 * width) / 4 ));
     create_screens(R, screen_definitions);
     select_screen(R, 1);
     
@@ -670,13 +1156,13 @@ int main(int argc, char** argv)
     r_function(R, "par", "mar = rep(0, 4)"s);
     start_plot<int, int>(R, 0, 1);
     
-    call_lat_long(R, callsign, latitude, longitude);
+    call_lat_long(R, callsign, qth.first, qth.second);
 
     if (antenna_height != 0)
       execute_r(R, "text(x=0.50, y = 0.05, labels = c('Ant = " + cl.value("-ant"s) + height_unit_str + "'), cex = 1.2)");
 
     if (n_cells_terrain_height)
-    { const float  mean_terrain_height       { sum_terrain_height / n_cells_terrain_height };
+    { const float  mean_terrain_height       { static_cast<float>(stats.sum_terrain_height / n_cells_terrain_height) };
       const float  mean_height_above_terrain { static_cast<float>((raw_qth_height + antenna_height - mean_terrain_height) * (imperial ? MTOF : 1)) };   
       const string displayable_height        { (imperial ? to_string(static_cast<int>(mean_height_above_terrain + 0.5)) : to_string(int( (mean_height_above_terrain * 10) + 0.5) / 10)) };
       const string scale                     { to_string(int( (distance_scale / (imperial ? (1000 * MITOKM) : 1000) ) + 0.01)) };
@@ -691,11 +1177,15 @@ int main(int argc, char** argv)
 
     execute_r(R, "graphics.off()"s);
     
+    height_render_timer.stop();
+    
     if (los)
-    { if (debug)
+    { phase_timer render_timer(PHASE::RENDER_LOS);
+    
+      if (debug)
         cout << "LOS plot" << endl;
  
-      create_figure(R, out_directory + "/drmap-"s + modified_callsign + "-" + distance_str + distance_unit_str + "-los.png"s, width, ( (3 * width) / 4 ));
+      create_figure(R, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + "-los.png"s, width, ( (3 * width) / 4 ));
       create_screens(R, screen_definitions);
       select_screen(R, 1);
     
@@ -742,13 +1232,13 @@ int main(int argc, char** argv)
       r_function(R, "par", "mar = rep(0, 4)"s);
       start_plot<int, int>(R, 0, 1);
       
-      call_lat_long(R, callsign, latitude, longitude);
+      call_lat_long(R, callsign, qth.first, qth.second);
 
       if (antenna_height != 0)
         execute_r(R, "text(x=0.50, y = 0.05, labels = c('Ant = " + cl.value("-ant"s) + height_unit_str + "'), cex = 1.2)");
 
       if (n_cells_terrain_height)
-      { const float  mean_terrain_height       { sum_terrain_height / n_cells_terrain_height };
+      { const float  mean_terrain_height       { static_cast<float>(stats.sum_terrain_height / n_cells_terrain_height) };
         const float  mean_height_above_terrain { static_cast<float>((raw_qth_height + antenna_height - mean_terrain_height) * (imperial ? MTOF : 1)) };   
         const string displayable_height        { (imperial ? to_string(static_cast<int>(mean_height_above_terrain + 0.5)) : to_string(int( (mean_height_above_terrain * 10) + 0.5) / 10)) };
         const string scale                     { to_string(int( (distance_scale / (imperial ? (1000 * MITOKM) : 1000) ) + 0.01)) };
@@ -768,12 +1258,14 @@ int main(int argc, char** argv)
     }
     
     if (elev)
-    { if (debug)
+    { phase_timer render_timer(PHASE::RENDER_ELEV);
+    
+      if (debug)
         cout << "Angle plot" << endl;
         
       const value_map<float, int> vm_angle(-5, 5, 0 /* min index into cv */, 999 /* max index into cv */);        // 10 just for now
 
-      create_figure(R, out_directory + "/drmap-"s + modified_callsign + "-" + distance_str + distance_unit_str + "-elev.png"s, width, ( (3 * width) / 4 ));
+      create_figure(R, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + "-elev.png"s, width, ( (3 * width) / 4 ));
       create_screens(R, screen_definitions);
       select_screen(R, 1);
     
@@ -783,25 +1275,9 @@ int main(int argc, char** argv)
       set_rect(R, "black"s);
       
 // use ranked angles instead of absolute values in order to linearise the gradient
-      vector<float> angles;
-      
-      angles.reserve(total_n_cells);
-      
-      for (int n_row = 0; n_row < static_cast<int>(angle_field.size()); ++n_row)            // rows go from S to N
-      { const auto& row { angle_field[n_row] };
-    
-        for (int n_column = 0; n_column < static_cast<int>(row.size()); ++n_column)          // columns go from W to E
-          angles.push_back(row[n_column]);
-      }
+      constexpr int n_labels { 21 };          // need lots of labels because of the nonlinearity
 
-      sort(angles.begin(), angles.end());
-      
-      auto mapped_angle = [=](const float& a) 
-        { const auto it { lower_bound(angles.cbegin(), angles.cend(), a) };
-          const auto d  { std::distance(angles.cbegin(), it) };
-          
-          return static_cast<int>( ( (d * 1.0) / (angles.size() - 1) ) * 999  );        // element number in the gradient 
-        };
+      const field_ranks angle_ranks { rank_field(angle_field, 999 /* max index into cv */, n_labels, n_threads) };
   
       { r_rects<float> cells(R, total_n_cells);
       
@@ -809,11 +1285,9 @@ int main(int argc, char** argv)
         { const auto& row { angle_field[n_row] };
     
           for (int n_column = 0; n_column < static_cast<int>(row.size()); ++n_column)          // columns go from W to E
-          { const float& angle = row[n_column];
-            
-            cells.add(-distance_scale + (n_column - 0.5) * rect_width, -distance_scale + (n_column + 0.5) * rect_width, 
+          { cells.add(-distance_scale + (n_column - 0.5) * rect_width, -distance_scale + (n_column + 0.5) * rect_width, 
                       -distance_scale + (n_row - 0.5) * rect_height, -distance_scale + (n_row + 0.5) * rect_height,
-                      cv.at(mapped_angle(angle)) );
+                      cv.at(angle_ranks.index[n_row][n_column]) );
           }
         }
       
@@ -842,16 +1316,12 @@ int main(int argc, char** argv)
 
       colour_gradient.display();
       
-      constexpr int n_labels { 21 };          // need lots of labels because of the nonlinearity
-      
       vector<string> angle_labels_str;
       
-      for (size_t n_label = 0; n_label < n_labels; ++n_label)
-      { const size_t labels_index { static_cast<size_t>( ((n_label * 1.0) / (n_labels - 1)) * (angles.size() - 1)) };
-        
-        stringstream stream;
+      for (const float quantile : angle_ranks.quantiles)
+      { stringstream stream;
         
-        stream << fixed << setprecision(2) << angles.at(labels_index);
+        stream << fixed << setprecision(2) << quantile;
         
         angle_labels_str.push_back( stream.str() );
       }
@@ -872,13 +1342,13 @@ int main(int argc, char** argv)
       r_function(R, "par", "mar = rep(0, 4)"s);
       start_plot<int, int>(R, 0, 1);
 
-      call_lat_long(R, callsign, latitude, longitude);
+      call_lat_long(R, callsign, qth.first, qth.second);
 
       if (antenna_height != 0)
         execute_r(R, "text(x=0.50, y = 0.05, labels = c('Ant = " + cl.value("-ant"s) + height_unit_str + "'), cex = 1.2)");
 
       if (n_cells_terrain_height)
-      { const float mean_terrain_height       { sum_terrain_height / n_cells_terrain_height };
+      { const float mean_terrain_height       { static_cast<float>(stats.sum_terrain_height / n_cells_terrain_height) };
         const float mean_height_above_terrain { static_cast<float>((raw_qth_height - mean_terrain_height) * (imperial ? MTOF : 1)) };   
         const string displayable_height       { (imperial ? to_string(static_cast<int>(mean_height_above_terrain + 0.5)) : to_string(int( (mean_height_above_terrain * 10) + 0.5) / 10)) };
         const string scale                    { to_string(int( (distance_scale / (imperial ? (1000 * MITOKM) : 1000) ) + 0.01)) };
@@ -895,21 +1365,13 @@ int main(int argc, char** argv)
     }
     
     if (grad)
-    { if (debug)
+    { phase_timer render_timer(PHASE::RENDER_GRAD);
+    
+      if (debug)
         cout << "Gradient plot" << endl;
         
-      float min_gradient { numeric_limits<float>::max() };
-      float max_gradient { numeric_limits<float>::lowest() };
-
-      for (int delta_y = -n_cells; delta_y <= n_cells; ++delta_y)
-      { for (int delta_x = -n_cells; delta_x <= n_cells; ++delta_x)
-        { const int                  column_index              { delta_x + n_cells };
-          const int                  row_index                 { delta_y + n_cells };
-      
-          min_gradient = min(min_gradient, grad_field[row_index][column_index]);
-          max_gradient = max(max_gradient, grad_field[row_index][column_index]);
-        }
-      }
+      float min_gradient { stats.min_grad };
+      float max_gradient { stats.max_grad };
   
       if (debug)
       { cout << "min gradient = " << min_gradient << endl;
@@ -926,7 +1388,7 @@ int main(int argc, char** argv)
 
       const value_map<float, int> vm_gradient(min_gradient, max_gradient, 0 /* min index into cv */, 999 /* max index into cv */);
 
-      create_figure(R, out_directory + "/drmap-"s + modified_callsign + "-" + distance_str + distance_unit_str + "-grad.png"s, width, ( (3 * width) / 4 ));
+      create_figure(R, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + "-grad.png"s, width, ( (3 * width) / 4 ));
       create_screens(R, screen_definitions);
       select_screen(R, 1);
     
@@ -968,13 +1430,13 @@ int main(int argc, char** argv)
       r_function(R, "par", "mar = rep(0, 4)"s);
       start_plot<int, int>(R, 0, 1);
 
-      call_lat_long(R, callsign, latitude, longitude);
+      call_lat_long(R, callsign, qth.first, qth.second);
 
       if (antenna_height != 0)
         execute_r(R, "text(x=0.50, y = 0.05, labels = c('Ant = " + cl.value("-ant"s) + height_unit_str + "'), cex = 1.2)");
 
       if (n_cells_terrain_height)
-      { const float mean_terrain_height       { sum_terrain_height / n_cells_terrain_height };
+      { const float mean_terrain_height       { static_cast<float>(stats.sum_terrain_height / n_cells_terrain_height) };
         const float mean_height_above_terrain { static_cast<float>((raw_qth_height - mean_terrain_height) * (imperial ? MTOF : 1)) };   
         const string displayable_height       { (imperial ? to_string(static_cast<int>(mean_height_above_terrain + 0.5)) : to_string(int( (mean_height_above_terrain * 10) + 0.5) / 10)) };
         const string scale                    { to_string(int( (distance_scale / (imperial ? (1000 * MITOKM) : 1000) ) + 0.01)) };
@@ -989,13 +1451,280 @@ int main(int argc, char** argv)
       
       execute_r(R, "graphics.off()"s);
     }
+    
+    if (coverage)
+    { phase_timer render_timer(PHASE::RENDER_COVERAGE);
+    
+      if (debug)
+        cout << "Coverage plot" << endl;
+
+      const int                   n_sites     { static_cast<int>(coverage_sites.size()) };
+      const value_map<float, int> vm_coverage(0, n_sites, 0 /* min index into cv */, 999 /* max index into cv */);
+
+      create_figure(R, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + "-coverage.png"s, width, ( (3 * width) / 4 ));
+      create_screens(R, screen_definitions);
+      select_screen(R, 1);
+    
+      execute_r( R, "par(mar = c(2.5, 2.5, 2.5, 2.5))" ); // default = c(5.1, 4.1, 4.1, 2.1) ... square plot
+    
+      start_plot<int, int>(R, -distance_scale, distance_scale, -distance_scale, distance_scale);
+      set_rect(R, "black"s);
+  
+      { r_rects<float> cells(R, total_n_cells);
+      
+        for (int n_row = 0; n_row < static_cast<int>(coverage_counts.size()); ++n_row)            // rows go from S to N
+        { const auto& row { coverage_counts[n_row] };
+    
+          for (int n_column = 0; n_column < static_cast<int>(row.size()); ++n_column)          // columns go from W to E
+          { const int& count { row[n_column] };
+            
+            cells.add(-distance_scale + (n_column - 0.5) * rect_width, -distance_scale + (n_column + 0.5) * rect_width, 
+                      -distance_scale + (n_row - 0.5) * rect_height, -distance_scale + (n_row + 0.5) * rect_height,
+                      (count ? cv.at(vm_coverage(count)) : "black"s) );
+          }
+        }
+      
+        cells.draw();
+      }
+      
+      if (hzn)
+        draw_horizon_quadrilaterals(R, distance_scale, horizon, vm_horizon, cv);
+
+      draw_logo(R, distance_scale);
+      label_axes(R, distances_km, distances_in_metres, long_distance_unit_str);
+
+      execute_r(R, "require(plotrix, quietly = TRUE)");                                           // just to make it easier to draw circles
+      execute_r(R, "draw.circle(0, 0, " + to_string(distance_scale / 100) + ", col = 'ORANGE')"); // QTH marker
+      execute_r(R, "draw.circle(0, 0, " + to_string(distance_scale) + ", border = 'BLACK')");     // radius marker
+
+      for (const auto& coverage_site : coverage_sites)                                           // site markers
+      { const pair<double, double> bd { bd_from_ll(qth, coverage_site.qth) };
+      
+        execute_r(R, "draw.circle(" + to_string(bd.second * sin(bd.first * DTOR)) + ", " + to_string(bd.second * cos(bd.first * DTOR)) + ", " +
+                     to_string(distance_scale / 100) + ", col = 'WHITE')");
+      }
+      
+      colour_gradient.display_all_on_second_screen("Sites", colour_gradient.labels(0, n_sites));
+
+      if (hzn)
+        label_horizon_gradient(R, min_horizon, max_horizon, colour_gradient);
+
+      select_screen(R, 3);
+      r_function(R, "par", "mar = rep(0, 4)"s);
+      start_plot<int, int>(R, 0, 1);
+
+      call_lat_long(R, callsign, qth.first, qth.second);
+
+      if (antenna_height != 0)
+        execute_r(R, "text(x=0.50, y = 0.05, labels = c('Ant = " + cl.value("-ant"s) + height_unit_str + "'), cex = 1.2)");
+
+      execute_r(R, "text(x=0.50, y = 0.10, labels = c('Sites = " + to_string(n_sites) + "'), cex = 1.2)");
+      
+      execute_r(R, "graphics.off()"s);
+    }
+    
+    if (fresnel)
+    { phase_timer render_timer(PHASE::RENDER_FRESNEL);
+    
+      if (debug)
+        cout << "Fresnel-clearance plot" << endl;
+
+      const value_map<float, int> vm_fresnel(-1, 1, 0 /* min index into cv */, 999 /* max index into cv */);
+
+      create_figure(R, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + "-fresnel.png"s, width, ( (3 * width) / 4 ));
+      create_screens(R, screen_definitions);
+      select_screen(R, 1);
+    
+      execute_r( R, "par(mar = c(2.5, 2.5, 2.5, 2.5))" ); // default = c(5.1, 4.1, 4.1, 2.1) ... square plot
+    
+      start_plot<int, int>(R, -distance_scale, distance_scale, -distance_scale, distance_scale);
+      set_rect(R, "black"s);
+  
+      { r_rects<float> cells(R, total_n_cells);
+      
+        for (int n_row = 0; n_row < static_cast<int>(fields.fresnel.size()); ++n_row)            // rows go from S to N
+        { const auto& row { fields.fresnel[n_row] };
+    
+          for (int n_column = 0; n_column < static_cast<int>(row.size()); ++n_column)          // columns go from W to E
+          { const float& ratio { row[n_column] };
+            
+            cells.add(-distance_scale + (n_column - 0.5) * rect_width, -distance_scale + (n_column + 0.5) * rect_width, 
+                      -distance_scale + (n_row - 0.5) * rect_height, -distance_scale + (n_row + 0.5) * rect_height,
+                      ( (ratio > -9000) ? cv.at(vm_fresnel(min(max(ratio, -1.0f), 1.0f))) : "black"s) );       // NODATA is black
+          }
+        }
+      
+        cells.draw();
+      }
+      
+      if (hzn)
+        draw_horizon_quadrilaterals(R, distance_scale, horizon, vm_horizon, cv);
+
+      draw_logo(R, distance_scale);
+      label_axes(R, distances_km, distances_in_metres, long_distance_unit_str);
+
+      execute_r(R, "require(plotrix, quietly = TRUE)");                                           // just to make it easier to draw circles
+      execute_r(R, "draw.circle(0, 0, " + to_string(distance_scale / 100) + ", col = 'ORANGE')"); // QTH marker
+      execute_r(R, "draw.circle(0, 0, " + to_string(distance_scale) + ", border = 'BLACK')");     // radius marker
+      
+      colour_gradient.display_all_on_second_screen("F1\nClr", colour_gradient.labels(-1, 1));
+
+      if (hzn)
+        label_horizon_gradient(R, min_horizon, max_horizon, colour_gradient);
+
+      select_screen(R, 3);
+      r_function(R, "par", "mar = rep(0, 4)"s);
+      start_plot<int, int>(R, 0, 1);
+
+      call_lat_long(R, callsign, qth.first, qth.second);
+
+      if (antenna_height != 0)
+        execute_r(R, "text(x=0.50, y = 0.05, labels = c('Ant = " + cl.value("-ant"s) + height_unit_str + "'), cex = 1.2)");
+
+      execute_r(R, "text(x=0.50, y = 0.10, labels = c('Freq = " + cl.value("-fresnel"s) + "MHz'), cex = 1.2)");
+      execute_r(R, "text(x=0.50, y = 0.15, labels = c('Rx = " + fresnel_rx_str + height_unit_str + "'), cex = 1.2)");
+      
+      execute_r(R, "graphics.off()"s);
+    }
+    
+    if (diffraction)
+    { phase_timer render_timer(PHASE::RENDER_DIFFRACTION);
+    
+      if (debug)
+        cout << "Diffraction plot" << endl;
+
+      float max_loss { 0 };
+
+      for (const auto& row : fields.diffraction)
+        max_loss = max(max_loss, MAX_ELEMENT(row));
+
+      max_loss = max(ceil(max_loss / 10) * 10, 10.0f);          // scale is 0 to a multiple of 10 dB
+
+      const value_map<float, int> vm_diffraction(0, max_loss, 0 /* min index into cv */, 999 /* max index into cv */);
+
+      create_figure(R, out_directory + "/drmap-"s + plot_name + "-" + distance_str + distance_unit_str + "-diffraction.png"s, width, ( (3 * width) / 4 ));
+      create_screens(R, screen_definitions);
+      select_screen(R, 1);
+    
+      execute_r( R, "par(mar = c(2.5, 2.5, 2.5, 2.5))" ); // default = c(5.1, 4.1, 4.1, 2.1) ... square plot
+    
+      start_plot<int, int>(R, -distance_scale, distance_scale, -distance_scale, distance_scale);
+      set_rect(R, "black"s);
+  
+      { r_rects<float> cells(R, total_n_cells);
+      
+        for (int n_row = 0; n_row < static_cast<int>(fields.diffraction.size()); ++n_row)            // rows go from S to N
+        { const auto& row { fields.diffraction[n_row] };
+    
+          for (int n_column = 0; n_column < static_cast<int>(row.size()); ++n_column)          // columns go from W to E
+          { const float& loss { row[n_column] };
+            
+            cells.add(-distance_scale + (n_column - 0.5) * rect_width, -distance_scale + (n_column + 0.5) * rect_width, 
+                      -distance_scale + (n_row - 0.5) * rect_height, -distance_scale + (n_row + 0.5) * rect_height,
+                      ( (loss > -9000) ? cv.at(vm_diffraction(loss)) : "black"s) );       // NODATA is black
+          }
+        }
+      
+        cells.draw();
+      }
+      
+      if (hzn)
+        draw_horizon_quadrilaterals(R, distance_scale, horizon, vm_horizon, cv);
+
+      draw_logo(R, distance_scale);
+      label_axes(R, distances_km, distances_in_metres, long_distance_unit_str);
+
+      execute_r(R, "require(plotrix, quietly = TRUE)");                                           // just to make it easier to draw circles
+      execute_r(R, "draw.circle(0, 0, " + to_string(distance_scale / 100) + ", col = 'ORANGE')"); // QTH marker
+      execute_r(R, "draw.circle(0, 0, " + to_string(distance_scale) + ", border = 'BLACK')");     // radius marker
+      
+      colour_gradient.display_all_on_second_screen("Diff\nLoss(dB)", colour_gradient.labels(0.0f, max_loss));
+
+      if (hzn)
+        label_horizon_gradient(R, min_horizon, max_horizon, colour_gradient);
+
+      select_screen(R, 3);
+      r_function(R, "par", "mar = rep(0, 4)"s);
+      start_plot<int, int>(R, 0, 1);
+
+      call_lat_long(R, callsign, qth.first, qth.second);
+
+      if (antenna_height != 0)
+        execute_r(R, "text(x=0.50, y = 0.05, labels = c('Ant = " + cl.value("-ant"s) + height_unit_str + "'), cex = 1.2)");
+
+      execute_r(R, "text(x=0.50, y = 0.10, labels = c('Freq = " + cl.value("-diffraction"s) + "MHz'), cex = 1.2)");
+      execute_r(R, "text(x=0.50, y = 0.15, labels = c('Rx = " + fresnel_rx_str + height_unit_str + "'), cex = 1.2)");
+      
+      execute_r(R, "graphics.off()"s);
+    }
+    
+    end_of_radius(distance_scale);
   }
   
+  if (PROFILER.enabled())
+    write_file("[\n"s + join(profile_summaries, ",\n"s) + "\n]\n"s, profile_filename);
+  
+  if (TRACER.enabled())
+    TRACER.write(trace_filename);
+  
   return 0;
 }
 
+/*! \brief          The distances at which the terrain is sampled along each bearing for the horizons
+    \param  limits  the cut-off distances of the horizons, in metres
+    \return         the distances, in increasing order, in metres
+
+    There are 100 evenly spaced samples out to each limit, the last of which is at the limit itself
+*/
+const vector<double> horizon_sample_distances(const set<double>& limits)
+{ set<double> rv;
+
+  for (const double limit : limits)
+  { for (int pc = 1; pc < 100; ++pc)
+      rv.insert( (pc * limit) / 100 );                      // assumes limit isn't something sillily small
+
+    rv.insert(limit);
+  }
+
+  return vector<double>(rv.cbegin(), rv.cend());
+}
+
+/*! \brief          Calculate the horizons for several cut-off distances
+    \param  qth     latitude and longitude of the QTH
+    \param  eye     height of the eye, in metres
+    \param  limits  the cut-off distances, in metres
+    \return         for each limit, the elevation of the horizon at each integral bearing, in degrees
+
+    Each bearing is walked once, out to the largest limit, through the samples of all the limits; the running maximum of the
+    elevation is recorded as each limit is reached
+*/
+const map<double, array<float, 360>> calculate_horizons(const pair<double, double>& qth, const float eye, const set<double>& limits)
+{ const vector<double> distances { horizon_sample_distances(limits) };
+
+  map<double, array<float, 360>> rv;
+
+  for (int bearing = 0; bearing < 360; bearing += 1)
+  { float max_angle { numeric_limits<float>::lowest() };
+
+    auto limit_it { limits.cbegin() };
+
+    for (const double distance_to_square_n : distances)
+    { const pair<double, double> ll_n        { ll_from_bd(qth, bearing, distance_to_square_n) };
+      const float                raw_value_n { tiles.at(llc(ll_n)).interpolated_value(ll_n) };
+      const float                angle_n     { elevation_angle(qth, ll_n, eye, raw_value_n) };
+
+      max_angle = max(max_angle, angle_n);
+
+      for ( ; (limit_it != limits.cend()) and (*limit_it <= distance_to_square_n); ++limit_it)
+        rv[*limit_it][bearing] = max_angle * RTOD;          // convert to degrees
+    }
+  }
+
+  return rv;
+}
+
 /*! \brief                          Determine, in parallel, the needed tiles
-    \param  distance_per_square     size of a cell, in metres
+    \param  geometry                the geometry of the cells of the plot
     \param  qth                     latitude and longitude of the QTH
     \param  los                     whether to perform line-of-sight calculation
     \param  delta_y_start           the starting y offset (the plot starts at -cells)
@@ -1003,15 +1732,18 @@ int main(int argc, char** argv)
     
     Calculations relating to hzn are not performed, as those need to be done only once, not per-cell
 */
-void calculate_needed_tiles(const float& distance_per_square, const pair<double, double>& qth, const bool los, const int delta_y_start, const int delta_y_increment)
+void calculate_needed_tiles(const plot_geometry& geometry, const pair<double, double>& qth, const bool los, const int delta_y_start, const int delta_y_increment)
 { for (int delta_y = delta_y_start; delta_y <= n_cells; delta_y += delta_y_increment)
-  { for (int delta_x = -n_cells; delta_x <= n_cells; ++delta_x)
-    { const double               bearing_from_north        { bearing(delta_x, delta_y) };
-      const double               distance_to_square        { sqrt(1.0 * delta_x * delta_x + 1.0 * delta_y * delta_y) * distance_per_square };    // along curved surface
+  { const trace_scope row_trace("tile_needs row", "row", delta_y);
+  
+    for (int delta_x = -n_cells; delta_x <= n_cells; ++delta_x)
+    { const cell_geometry        cell                      { geometry(delta_x, delta_y) };
+      const double&              bearing_from_north        { cell.bearing };
+      const double&              distance_to_square        { cell.distance };                   // along curved surface
       const pair<double, double> ll                        { ll_from_bd(qth, bearing_from_north, distance_to_square) };
       const auto                 lat_long_code             { llc(ll) };
       
-      { lock_guard<mutex> tile_llcs_lock(tile_llcs_mutex);
+      { traced_lock_guard<mutex> tile_llcs_lock(tile_llcs_mutex, "wait tile_llcs_mutex");
       
         tile_llcs.insert(lat_long_code);
       }
@@ -1029,7 +1761,7 @@ void calculate_needed_tiles(const float& distance_per_square, const pair<double,
             const pair<double, double> ll_n                        { ll_from_bd(qth, bearing_from_north, distance_to_square_n) };
             const auto                 lat_long_code               { llc(ll_n) };
 
-            { lock_guard<mutex> tile_llcs_lock(tile_llcs_mutex);
+            { traced_lock_guard<mutex> tile_llcs_lock(tile_llcs_mutex, "wait tile_llcs_mutex");
             
               tile_llcs.insert(lat_long_code);
             }
@@ -1146,203 +1878,6 @@ void draw_logo(RInside& R, const double& distance_scale)
   execute_r(R, "text(x = "s + to_string(x) + ", y = "s + to_string(y) + ", labels = '"s + "N7DR" + "', col = 'dark green', cex = 1.2, font = 2, family = 'Noto Mono')"s);  // bold
 }
 
-/*  \brief          Calculate the elevation above zero degrees of one point as seen from another
-    \param  lat1    latitude of first point
-    \param  long1   longitude of first point
-    \param  lat2    latitude of second point
-    \param  long2   longitude of second point
-    \param  h1      height of first point relative to sphere/geoid
-    \param  h2      height of first point relative to sphere/geoid
-    \return         the elevation of the second point as seen from the first point
-
-   The USGS "elevation" values are referenced to a geoid. Locally, and for the purpose of this
-   calculation, it's sufficient to treat the Earth between the two points as a sphere.
-   
-   Assuming a negative elevation angle (i.e. OD = OB + BD, both +ve)
-   O = centre of Earth
-   RE = radius of Earth
-   A = top of antenna (RE + h1)
-   OD = RE + h2 [== OB] projected on to horizontal plane through A
-   B = top of point 2 (i.e., r + h2)
-   theta = distance along surface between the points / radius of Earth
-*/
-const float elevation_angle(const double& lat1, const double& long1, const double& lat2, const double& long2, const double& h1, const double& h2)
-{ const double d     { distance(lat1, long1, lat2, long2) };
-  const double theta { d / RE };   // radians; annoyoingly, g++ doesn't properly support Unicode in the names of variables
-  const double OD    { (RE + h1) / cos(theta) };
-  const double AD    { (RE + h1) * tan(theta) };
-  const double BD    { OD - (RE + h2) };
-  const double AB    { sqrt(AD * AD + BD * BD - 2 * AD * BD * sin(theta)) };     // cosine rule
-  const double alpha { -asin( (BD * cos(theta)) / AB ) };                     // sine rule; the - sign corrects for above/below horizontal
-  
-  return static_cast<float>(alpha);
-}
-
-/*! \brief                          Populate all the fields
-    \param  distance_per_square     size of a cell, in metres
-    \param  qth                     latitude and longitude of the QTH
-    \param  delta_y_start           the starting y offset (the plot starts at -cells)
-    \param  delta_y_increment       the number of rows by which to increment y
-    \param  height_field            the height field
-    \param  antenna_height          the height of the antenna (in metres)
-    \param  distance_scale          the radius of the plot, in metres
-    \param  sum_terrain_height      the sum of the terrain height for the cells 
-    \param  n_cells_terrain_height  the number of cells whose height is included in <i>sum_terrain_height</i>
-    \param  elev                    whether to create an elevation plot
-    \param  raw_qth_height          the USGS value for the QTH
-    \param  angle_field             the elev/angle field
-    \param  los                     whether to create a line-of-sight plot
-    \param  los_field               the line-of-sight field
-    \param  grad                    whether to create a gradient plot
-    \param  grad_field              the gradient field
-    
-    This function is thread-safe. It does not yet handle the NODATA case reasonably.
-*/
-void populate_fields(const float& distance_per_square, const pair<double, double>& qth, const int delta_y_start, const int delta_y_increment,
-                     vector<vector<float>>& height_field, const float antenna_height, const double& distance_scale, float& sum_terrain_height,
-                     int& n_cells_terrain_height, const bool elev, const float raw_qth_height, vector<vector<float>>& angle_field,
-                     const bool los, vector<vector<VISIBILITY>>& los_field, const bool grad, vector<vector<float>>& grad_field)
-{ for (int delta_y = delta_y_start; delta_y <= n_cells; delta_y += delta_y_increment)
-  { for (int delta_x = -n_cells; delta_x <= n_cells; ++delta_x)
-    { const int                  column_index              { delta_x + n_cells };
-      const int                  row_index                 { delta_y + n_cells };
-      const double               bearing_from_north        { bearing(delta_x, delta_y) };
-      const double               distance_to_square        { sqrt(1.0 * delta_x * delta_x + 1.0 * delta_y * delta_y) * distance_per_square };    // along curved surface
-      const pair<double, double> ll                        { ll_from_bd(qth, bearing_from_north, distance_to_square) };        
-      const double               correction                { curvature_correction(distance_to_square) };
-
-      float raw_value { -9999 };        // default value is NODATA
-      
-      try
-      { raw_value = tiles.at(llc(ll)).interpolated_value(ll);                 // height per USGS
-
-// see note near the top of the file regarding modification of the received heights
-        { lock_guard<mutex> height_field_lock(height_field_mutex);                    // should not be necessary, but be paranoid
-      
-          height_field[row_index][column_index] = raw_value * cos(distance_to_square / RE) - correction;
-        
-          if ( (delta_x == 0) and (delta_y == 0) )
-            height_field[row_index][column_index] += antenna_height;              // add the antenna to the central square
-        }
-        
-        if (distance_to_square <= distance_scale)                           // accumulate for calculation of MHAT
-        { lock_guard<mutex> mean_height_lock(mean_height_mutex);
-      
-          sum_terrain_height += height_field[row_index][column_index];      // adds antenna height to QTH square
-        
-          if ( (delta_x == 0) and (delta_y == 0) )
-            sum_terrain_height -= antenna_height;                           // remove the antenna from the central square, so it's RAW terrain
-
-          n_cells_terrain_height++;
-        }
-      }
-      
-      catch (const grid_float_error& e)
-      { cerr << "Caught grid float error while calculating height field: " << e.reason() << endl;
-          
-        lock_guard<mutex> height_field_lock(height_field_mutex);                    // should not be necessary, but be paranoid
-      
-        height_field[row_index][column_index] = -9999;
-      }
-        
-      double elevation_angle_in_degrees { 0 };
-      
-      if (elev)
-      { if (raw_value > -9000)
-        { elevation_angle_in_degrees = elevation_angle(qth, ll, raw_qth_height + antenna_height, raw_value) * RTOD;
-        
-          { lock_guard<mutex> angle_field_lock(angle_field_mutex);                    // should not be necessary, but be paranoid
-        
-            angle_field[row_index][column_index] = elevation_angle_in_degrees;
-          }
-        }
-        else    // NODATA
-        { lock_guard<mutex> angle_field_lock(angle_field_mutex);                    // should not be necessary, but be paranoid
-        
-          angle_field[row_index][column_index] = -9999;
-        }
-      }
- 
-      if (grad)
-      { if ( (delta_x == 0) and (delta_y == 0) )
-          grad_field[row_index][column_index] = 0;
-        else
-        { try
-          { const float delta_distance { 10 };        // gradient is measured over ±10 metres
-
-            const double distance_m { distance_to_square - delta_distance };
-            const double distance_p { distance_to_square + delta_distance };
-          
-            const pair<double, double> ll_m { ll_from_bd(qth, bearing_from_north, distance_m) };        
-            const pair<double, double> ll_p { ll_from_bd(qth, bearing_from_north, distance_p) };        
-
-            const float raw_value_m { tiles.at(llc(ll_m)).interpolated_value(ll_m) };                 // height per USGS
-            const float raw_value_p { tiles.at(llc(ll_p)).interpolated_value(ll_p) };                 // height per USGS
-
-            const double correction_m { curvature_correction(distance_m) };
-            const double correction_p { curvature_correction(distance_p) };
-
-            const double height_m { raw_value_m * cos(distance_m / RE) - correction_m };
-            const double height_p { raw_value_p * cos(distance_p / RE) - correction_p };
-          
-            grad_field[row_index][column_index] = (height_p - height_m) / (2 * delta_distance);
-          }
-          
-          catch (const grid_float_error& e)
-          { cerr << "Caught grid float error while calculating grad field: " << e.reason() << endl;
-          
-            grad_field[row_index][column_index] = -9999;
-          }
-        }
-      }
-      
-// visibility of this cell     
-      if (los)
-      { if (delta_x != 0 or delta_y != 0)                     // for everything except the QTH cell
-        { const float angle { static_cast<float>(elev ? (elevation_angle_in_degrees * DTOR) : elevation_angle(qth, ll, raw_qth_height + antenna_height, raw_value)) }; 
-
-          bool visible { true };
-            
-// walk along a bearing, looking to see if visibility is maintained
-          int decrement { 1 };
-            
-// a bit of a fudge for very close-in terminating points
-          if (distance_to_square < 250)               // 250m
-            decrement = max(int(distance_to_square / 4), 1);  // ~25% per step
-            
-          try
-          { for (int n = 95; visible and n >= 5; n -= decrement)                                            // skip points near ends to avoid rounding problems
-            { const double               distance_to_square_n { (n * distance_to_square) / (100) };
-              const pair<double, double> ll_n                 { ll_from_bd(qth, bearing_from_north, distance_to_square_n) };
-              const float                raw_value_n          { tiles.at(llc(ll_n)).interpolated_value(ll_n) };
-              const float                angle_n              { elevation_angle(qth, ll_n, raw_qth_height + antenna_height, raw_value_n) };              
-              
-             visible = (angle_n < angle);
-            }
-  
-            { lock_guard<mutex> los_field_lock(los_field_mutex);                    // should not be necessary, but be paranoid
-
-              los_field[row_index][column_index] = (visible ? VISIBILITY::VISIBLE : VISIBILITY::NOT_VISIBLE);
-            }  
-          }
-
-          catch (...)  // default to NOT VISIBLE
-          { cerr << "Exception handled when calculating LOS" << endl;
-          
-            lock_guard<mutex> los_field_lock(los_field_mutex);                    // should not be necessary, but be paranoid
-
-            los_field[row_index][column_index] = VISIBILITY::NOT_VISIBLE;
-          } 
-        }
-        else                                                  // QTH is always visible
-        { lock_guard<mutex> los_field_lock(los_field_mutex);                    // should not be necessary, but be paranoid
-
-          los_field[n_cells][n_cells] = VISIBILITY::VISIBLE;
-        }
-      }
-    }
-  }
-}
 
 /*! \brief                          Label the axes
     \param  R                       the R instance
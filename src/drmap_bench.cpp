@@ -0,0 +1,305 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   drmap_bench.cpp
+
+    Micro-benchmarks for the geometry and sampling kernels used by drmap
+*/
+
+/*
+    drmap-bench
+      -cellsperdegree <n>
+
+        The number of cells per degree in the synthetic tile used by the sampling benchmarks. The default is 3600.
+
+      -datadir <directory>
+
+        The directory in which the synthetic tile is kept. It is created if it does not exist, and the tile is written only if it is not
+        already present. The default is /tmp/drmap-bench.
+
+      -filter <string>
+
+        Run only the benchmarks whose names contain <string>.
+
+      -mintime <seconds>
+
+        The minimum time for each repetition of each benchmark. The default is 0.2.
+
+      -reps <n>
+
+        The number of repetitions of each benchmark; the fastest is reported. The default is 3.
+
+      -seed <n>
+
+        The seed for the synthetic tile and for the sample points. The default is 1.
+*/
+
+#include "command_line.h"
+#include "diskfile.h"
+#include "grid_float.h"
+#include "plot_geometry.h"
+#include "r_figure.h"
+#include "rank.h"
+#include "string_functions.h"
+#include "synth.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace std;
+using namespace   chrono;
+
+bool debug { false };
+
+constexpr size_t N_SAMPLES { 1 << 16 };             ///< number of different inputs over which each benchmark cycles
+
+/*! \brief      Prevent the compiler from discarding a value
+    \param  v   value that must be computed
+*/
+template <typename T>
+inline void keep(const T& v)
+  { asm volatile("" : : "g"(&v) : "memory"); }
+
+/// the result of one benchmark
+struct bench_result
+{ string   name;            ///< name of the benchmark
+  double   ns_per_op;       ///< time per operation, in ns
+  uint64_t n_ops;           ///< number of operations in the fastest repetition
+};
+
+/*! \brief                  Time a benchmark
+    \param  name            name of the benchmark
+    \param  ops_per_batch   number of operations performed by each call to <i>batch</i>
+    \param  batch           function that performs <i>ops_per_batch</i> operations
+    \param  min_time        minimum duration of each repetition, in seconds
+    \param  reps            number of repetitions
+    \return                 the result of the fastest repetition
+*/
+template <typename F>
+const bench_result run_benchmark(const string& name, const size_t ops_per_batch, F&& batch, const double min_time, const int reps)
+{ bench_result rv { name, numeric_limits<double>::max(), 0 };
+
+  batch();                                  // warm up
+
+  for (int rep = 0; rep < reps; ++rep)
+  { uint64_t   n_ops { 0 };
+    const auto start { steady_clock::now() };
+    double     elapsed;
+
+    do
+    { batch();
+      n_ops += ops_per_batch;
+      elapsed = duration<double>(steady_clock::now() - start).count();
+    } while (elapsed < min_time);
+
+    const double ns_per_op { (elapsed * 1e9) / n_ops };
+
+    if (ns_per_op < rv.ns_per_op)
+    { rv.ns_per_op = ns_per_op;
+      rv.n_ops = n_ops;
+    }
+  }
+
+  return rv;
+}
+
+int main(int argc, char** argv)
+{ const command_line cl(argc, argv);
+
+  const string   data_directory   { cl.value_present("-datadir"s) ? cl.value("-datadir"s) : "/tmp/drmap-bench"s };
+  const int      cells_per_degree { cl.value_present("-cellsperdegree"s) ? from_string<int>(cl.value("-cellsperdegree"s)) : 3600 };
+  const string   filter           { cl.value_present("-filter"s) ? cl.value("-filter"s) : string() };
+  const double   min_time         { cl.value_present("-mintime"s) ? from_string<double>(cl.value("-mintime"s)) : 0.2 };
+  const int      reps             { cl.value_present("-reps"s) ? max(from_string<int>(cl.value("-reps"s)), 1) : 3 };
+  const uint64_t seed             { cl.value_present("-seed"s) ? from_string<uint64_t>(cl.value("-seed"s)) : 1 };
+
+  constexpr int    LLC       { 41106 };                     // n41w106
+  constexpr double LAT_SOUTH { 40.0 };
+  constexpr double LONG_WEST { -106.0 };
+
+  debug = cl.parameter_present("-v"s) or cl.parameter_present("-debug"s);
+
+// the synthetic tile
+  directory_create_if_necessary(data_directory);
+
+  if (!file_exists(local_header_filename(LLC, data_directory)) or !file_exists(local_data_filename(LLC, data_directory)))
+  { cout << "writing synthetic tile to " << data_directory << endl;
+    write_synthetic_tile(synthetic_terrain(seed, SYNTH_TERRAIN::MOUNTAINS), LLC, data_directory, cells_per_degree);
+  }
+
+  const grid_float_tile tile_ram(local_header_filename(LLC, data_directory), local_data_filename(LLC, data_directory));
+  const grid_float_tile tile_mapped(local_header_filename(LLC, data_directory), local_data_filename(LLC, data_directory), TILE_STORAGE::MAPPED);
+  const grid_float_tile tile_sm(local_header_filename(LLC, data_directory), local_data_filename(LLC, data_directory), TILE_STORAGE::DISK);
+
+// the inputs
+  mt19937_64                        rng(seed);
+  uniform_real_distribution<double> unit(0.0, 1.0);
+  uniform_int_distribution<int>     delta(-300, 300);
+
+  vector<pair<double, double>> points;
+  vector<pair<double, double>> other_points;
+  vector<pair<int, int>>       deltas;
+  vector<double>               bearings;
+  vector<double>               distances;
+  vector<float>                heights;
+
+  for (size_t n = 0; n < N_SAMPLES; ++n)
+  { points.push_back( { LAT_SOUTH + 0.01 + 0.98 * unit(rng), LONG_WEST + 0.01 + 0.98 * unit(rng) } );
+    other_points.push_back( { LAT_SOUTH + 0.01 + 0.98 * unit(rng), LONG_WEST + 0.01 + 0.98 * unit(rng) } );
+    deltas.push_back( { delta(rng), delta(rng) } );
+    bearings.push_back(360 * unit(rng));
+    distances.push_back(100000 * unit(rng));
+    heights.push_back(static_cast<float>(300 + 3000 * unit(rng)));
+  }
+
+  vector<string> colours;
+
+  for (int n = 0; n < 1000; ++n)
+    colours.push_back("grey"s + to_string(n % 100));
+
+// the benchmarks
+  vector<bench_result> results;
+
+  auto bench = [&](const string& name, auto&& batch)
+    { if (filter.empty() or contains(name, filter))
+        results.push_back(run_benchmark(name, N_SAMPLES, batch, min_time, reps));
+    };
+
+  bench("distance"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(distance(points[n], other_points[n]));
+    });
+
+  bench("ll_from_bd"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(ll_from_bd(points[n], bearings[n], distances[n]));
+    });
+
+  bench("bearing"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(bearing(deltas[n].first, deltas[n].second));
+    });
+
+  bench("cell_geometry [direct]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(direct_cell_geometry(deltas[n].first, deltas[n].second, 100.0f));
+    });
+
+  const plot_geometry geometry(300, 100.0f);
+
+  bench("cell_geometry [octant]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(geometry(deltas[n].first, deltas[n].second));
+    });
+
+  bench("elevation_angle"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(elevation_angle(points[n], other_points[n], heights[n], heights[N_SAMPLES - 1 - n]));
+    });
+
+  bench("cell_value [RAM]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(tile_ram.cell_value(points[n].first, points[n].second));
+    });
+
+  bench("cell_value [mapped]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(tile_mapped.cell_value(points[n].first, points[n].second));
+    });
+
+  bench("cell_value [sm]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(tile_sm.cell_value(points[n].first, points[n].second));
+    });
+
+  bench("interpolated_value [RAM]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(tile_ram.interpolated_value(points[n]));
+    });
+
+  bench("interpolated_value [mapped]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(tile_mapped.interpolated_value(points[n]));
+    });
+
+  bench("interpolated_value [sm]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(tile_sm.interpolated_value(points[n]));
+    });
+
+  const double half_cell { 50 / RE * RTOD };                // half of a 100m cell, in degrees of latitude
+
+  bench("area_value [k=4, 100m]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(tile_ram.area_value(points[n].first - half_cell, points[n].second - half_cell, points[n].first + half_cell, points[n].second + half_cell, 4, SUPERSAMPLE::MEAN));
+    });
+
+  bench("area_value [k=8, 100m]"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(tile_ram.area_value(points[n].first - half_cell, points[n].second - half_cell, points[n].first + half_cell, points[n].second + half_cell, 8, SUPERSAMPLE::MEAN));
+    });
+
+// a 256 x 256 field, with ties
+  vector<vector<float>> field(256, vector<float>(256));
+
+  for (size_t n = 0; n < N_SAMPLES; ++n)
+    field[n / 256][n % 256] = static_cast<float>(static_cast<int>(heights[n] * 10)) / 10;
+
+  bench("rank_field [sort]"s, [&](void)
+    { vector<float> sorted;
+
+      sorted.reserve(N_SAMPLES);
+
+      for (const auto& row : field)
+        sorted.insert(sorted.end(), row.cbegin(), row.cend());
+
+      sort(sorted.begin(), sorted.end());
+
+      for (const auto& row : field)
+        for (const float v : row)
+          keep(static_cast<int>( ( (std::distance(sorted.cbegin(), lower_bound(sorted.cbegin(), sorted.cend(), v)) * 1.0) / (sorted.size() - 1) ) * 999 ));
+    });
+
+  bench("rank_field [radix]"s, [&](void)
+    { keep(rank_field(field, 999, 21, 1)); });
+
+  bench("rank_field [radix, threads]"s, [&](void)
+    { keep(rank_field(field, 999, 21, max(thread::hardware_concurrency(), 2u))); });
+
+  const value_map<float, int> vm(300, 3300, 0, 999);
+
+  bench("value_map::map_value"s, [&](void)
+    { for (size_t n = 0; n < N_SAMPLES; ++n)
+        keep(vm.map_value(heights[n]));
+    });
+
+  if (filter.empty() or contains("r_rects::add"s, filter))
+  { RInside R { };
+
+    bench("r_rects::add"s, [&](void)
+      { r_rects<float> rects(R, N_SAMPLES);
+
+        for (size_t n = 0; n < N_SAMPLES; ++n)
+          rects.add(points[n].second, points[n].second + 0.001, points[n].first, points[n].first + 0.001, colours[n % colours.size()]);
+
+        keep(rects);
+      });
+  }
+
+// the report
+  cout << left << setw(28) << "benchmark" << right << setw(14) << "ns/op" << setw(18) << "samples/s" << endl;
+
+  for (const auto& result : results)
+    cout << left << setw(28) << result.name << right << setw(14) << fixed << setprecision(2) << result.ns_per_op
+         << setw(18) << comma_separated_string(static_cast<uint64_t>(1e9 / result.ns_per_op)) << endl;
+
+  return 0;
+}
@@ -0,0 +1,130 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   drmap_synth.cpp
+
+    Write synthetic GridFloat tiles, so that drmap may be benchmarked and tested without access to the USGS
+*/
+
+/*
+    drmap-synth
+      -cellsperdegree <n>
+
+        The number of cells per degree of latitude or longitude. The default is 10800, which is the resolution of the USGS ⅓″ data.
+        Smaller values produce smaller tiles more quickly, which is useful for quick tests.
+
+      -datadir <directory>
+
+        The directory into which the tiles are written. The default is /tmp/drmap, which is also drmap's default.
+
+      -holes <probability>
+
+        The probability that any 0.1° × 0.1° block of terrain contains a circular NODATA hole. The default is zero.
+
+      -lat <latitude>
+      -long <longitude>
+
+        A location within the area to be covered. The default is 40.5, -105.5.
+
+      -radius <distance>
+
+        The distance in km from the location to the edges of the area to be covered. All the tiles that intersect the area are written.
+        The default is zero, which writes just the tile that contains the location.
+
+      -seed <n>
+
+        The seed from which the terrain is derived. A given seed always produces identical tiles. The default is 1.
+
+      -terrain <type>
+
+        The kind of terrain: mountains, plains or mixed. The default is mixed.
+
+      -tiles <name1[,name2...]>
+
+        Write the named tiles (e.g., n41w106) instead of the tiles around a location.
+*/
+
+#include "command_line.h"
+#include "diskfile.h"
+#include "grid_float.h"
+#include "string_functions.h"
+#include "synth.h"
+
+#include <iostream>
+#include <set>
+
+using namespace std;
+
+bool debug { false };
+
+int main(int argc, char** argv)
+{ const command_line cl(argc, argv);
+
+  const string        data_directory   { cl.value_present("-datadir"s) ? cl.value("-datadir"s) : "/tmp/drmap"s };
+  const int           cells_per_degree { cl.value_present("-cellsperdegree"s) ? from_string<int>(cl.value("-cellsperdegree"s)) : USGS_CELLS_PER_DEGREE };
+  const double        hole_probability { cl.value_present("-holes"s) ? from_string<double>(cl.value("-holes"s)) : 0.0 };
+  const double        latitude         { cl.value_present("-lat"s) ? from_string<double>(cl.value("-lat"s)) : 40.5 };
+  const double        longitude        { cl.value_present("-long"s) ? from_string<double>(cl.value("-long"s)) : -105.5 };
+  const double        radius_km        { cl.value_present("-radius"s) ? from_string<double>(cl.value("-radius"s)) : 0.0 };
+  const uint64_t      seed             { cl.value_present("-seed"s) ? from_string<uint64_t>(cl.value("-seed"s)) : 1 };
+
+  debug = cl.parameter_present("-v"s) or cl.parameter_present("-debug"s);
+
+  if (cells_per_degree <= 0)
+  { cerr << "Error: number of cells per degree must be positive" << endl;
+    exit(-1);
+  }
+
+  if (!directory_exists(data_directory))
+  { cerr << "Error: directory " << data_directory << " does not exist" << endl;
+    exit(-1);
+  }
+
+  SYNTH_TERRAIN terrain_type { SYNTH_TERRAIN::MIXED };
+
+  try
+  { if (cl.value_present("-terrain"s))
+      terrain_type = synth_terrain_from_name(cl.value("-terrain"s));
+  }
+
+  catch (const synth_error& e)
+  { cerr << "Error: " << e.reason() << endl;
+    exit(-1);
+  }
+
+  set<int> llcodes;
+
+  if (cl.value_present("-tiles"s))
+  { for (const string& name : split_string(cl.value("-tiles"s), ","s))
+      llcodes.insert(llc(to_lower(remove_peripheral_spaces(name))));
+  }
+  else
+  { const double delta_lat  { (radius_km * 1000) / (RE * DTOR) };                  // degrees
+    const double delta_long { delta_lat / cos(latitude * DTOR) };
+
+    for (int south = static_cast<int>(floor(latitude - delta_lat)); south <= static_cast<int>(floor(latitude + delta_lat)); ++south)
+      for (int west = static_cast<int>(floor(longitude - delta_long)); west <= static_cast<int>(floor(longitude + delta_long)); ++west)
+        llcodes.insert(llc(south + 0.5, west + 0.5));
+  }
+
+  const synthetic_terrain terrain(seed, terrain_type, hole_probability);
+
+  try
+  { for (const int llcode : llcodes)
+    { const uint64_t n_nodata { write_synthetic_tile(terrain, llcode, data_directory, cells_per_degree) };
+
+      cout << local_data_filename(llcode, data_directory) << " : " << comma_separated_string(n_nodata) << " NODATA cells" << endl;
+    }
+  }
+
+  catch (const synth_error& e)
+  { cerr << "Error: " << e.reason() << endl;
+    exit(-1);
+  }
+
+  return 0;
+}
@@ -0,0 +1,422 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   drmap_validate.cpp
+
+    Compare the fields produced by each fast path with those produced by the reference implementation
+*/
+
+/*
+    drmap-validate
+      -ant <height>
+
+        The height of the antenna, in metres. The default is 10.
+
+      -cells <number of cells>
+
+        The number of cells from the centre of each plot to the edges. The default is 100.
+
+      -cellsperdegree <n>
+
+        The number of cells per degree in the synthetic tiles. The default is 1200.
+
+      -datadir <directory>
+
+        The directory in which the synthetic tiles are kept. It is created if it does not exist. The default is /tmp/drmap-validate.
+
+      -holes <probability>
+
+        The probability that any 0.1° × 0.1° block of terrain contains a NODATA hole. The default is zero.
+
+      -lat <latitude>
+      -long <longitude>
+
+        The QTH. The default is 40.5, -105.5.
+
+      -paths <name1[,name2...]>
+
+        Validate only the named fast paths. The default is to validate all of them.
+
+      -radius <distance1[,distance2...]>
+
+        The radii, in km, of the plots to compare. The default is 1,5,20.
+
+      -seed <n>
+
+        The seed for the synthetic tiles. The default is 1.
+
+      -terrain <type>
+
+        The kind of synthetic terrain: mountains, plains or mixed. The default is mixed.
+
+      -tolangle <degrees>
+      -tolgrad <gradient>
+      -tolheight <metres>
+
+        The largest acceptable absolute difference from the reference in the elevation-angle, gradient and height fields.
+        The defaults are 0.001°, 0.001 and 0.01m. For a field that a fast path approximates (every field of polar, the
+        gradient of stencil), the mean, rather than the largest, absolute difference is compared with the tolerance (see also -tolp99angle, -tolp99grad
+        and -tolp99height).
+
+      -tolp99angle <degrees>
+      -tolp99grad <gradient>
+      -tolp99height <metres>
+
+        For a field that a fast path approximates, the largest acceptable 99th percentile of the absolute difference from the
+        reference in the elevation-angle, gradient and height fields, so that errors confined to a few cells, which barely change the
+        mean, are still detected. The defaults are 0.02°, 0.01 and 0.1m.
+
+      -tollos <fraction>
+
+        The largest acceptable fraction of cells whose LOS visibility differs from the reference. The default is 0.001.
+
+      -tollosapprox <fraction>
+
+        The largest acceptable fraction of cells whose LOS visibility differs from the reference, for a fast path that approximates
+        the reference. The default is 0.025, just above the rate of the polar fast path on the default synthetic terrain (about
+        0.02), so that a regression that makes its LOS appreciably worse is detected. The rate depends on the terrain (between
+        about 0.003 and 0.16 for seeds 1 to 20), so a suitable value should be given when -seed or -terrain is used.
+
+    The statistics that each fast path accumulates while populating the fields (the extremes of height and gradient, and the number of
+    cells used for MHAT) are also checked against the fields themselves.
+
+    The exit status is zero only if every field of every fast path is within tolerance for every radius.
+*/
+
+#include "command_line.h"
+#include "diskfile.h"
+#include "fields.h"
+#include "grid_float.h"
+#include "polar.h"
+#include "string_functions.h"
+#include "synth.h"
+
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <thread>
+
+using namespace std;
+
+bool debug { false };
+
+constexpr float NODATA { -9999 };
+
+/// a way of calculating the fields other than the reference
+struct fast_path
+{ string                                                                  name;          ///< name of the fast path
+  string                                                                  description;   ///< what it does
+  function<void(const tile_map&, const field_request&, field_set&)>      calculate;     ///< populate the fields
+  set<string>                                                             approximate_fields { };   ///< names of the fields that deliberately differ from the reference
+
+/// whether the field <i>field_name</i> deliberately differs from the reference
+  inline const bool approximate(const string& field_name) const
+    { return (approximate_fields.count(field_name) != 0); }
+};
+
+/// the fast paths to be compared with the reference
+const vector<fast_path> FAST_PATHS { { "threads"s, "reference algorithm, rows divided among several threads"s,
+                                       [](const tile_map& tiles, const field_request& req, field_set& fields)
+                                         { calculate_fields(tiles, req, max(thread::hardware_concurrency(), 2u), fields); }
+                                     },
+                                     { "octant"s, "geometry of one octant of cells, reflected into the others"s,
+                                       [](const tile_map& tiles, const field_request& req, field_set& fields)
+                                         { const plot_geometry geometry(req.n_cells, req.distance_per_square);
+
+                                           calculate_fields(tiles, req, 1, fields, &geometry);
+                                         }
+                                     },
+                                     { "sm"s, "reference algorithm, several threads, tiles read from disk"s,
+                                       [](const tile_map& tiles, const field_request& req, field_set& fields)
+                                         { tile_map disk_tiles { tiles };
+
+                                           for (auto& [ tile_llc, tile ] : disk_tiles)
+                                             tile.storage(TILE_STORAGE::DISK);
+
+                                           calculate_fields(disk_tiles, req, max(thread::hardware_concurrency(), 2u), fields);
+                                         }
+                                     },
+                                     { "stencil"s, "gradient from the height field rather than from extra terrain samples"s,
+                                       [](const tile_map& tiles, const field_request& req, field_set& fields)
+                                         { field_request stencil_req { req };
+
+                                           stencil_req.grad_method = GRADIENT_METHOD::STENCIL;
+                                           calculate_fields(tiles, stencil_req, max(thread::hardware_concurrency(), 2u), fields);
+                                         },
+                                       set<string> { "grad"s }                       // only the gradient is taken from the stencil
+                                     },
+                                     { "kernels"s, "each field from the kernel compiled for it alone, several threads"s,
+                                       [](const tile_map& tiles, const field_request& req, field_set& fields)
+                                         { const unsigned int n_threads { max(thread::hardware_concurrency(), 2u) };
+
+                                           field_request elev_req { req };
+                                           field_request grad_req { req };
+                                           field_request los_req  { req };
+
+                                           elev_req.grad = elev_req.los = false;
+                                           grad_req.elev = grad_req.los = false;
+                                           los_req.elev = los_req.grad = false;
+
+                                           field_set elev_fields(req.n_cells);
+                                           field_set grad_fields(req.n_cells);
+
+                                           calculate_fields(tiles, elev_req, n_threads, elev_fields);
+                                           calculate_fields(tiles, grad_req, n_threads, grad_fields);
+                                           calculate_fields(tiles, los_req, n_threads, fields);         // also the height field
+
+                                           fields.angle = elev_fields.angle;
+                                           fields.grad = grad_fields.grad;
+                                           fields.stats.min_grad = grad_fields.stats.min_grad;
+                                           fields.stats.max_grad = grad_fields.stats.max_grad;
+                                         }
+                                     },
+                                     { "polar"s, "fields swept along bearings from the QTH, then reprojected to the cells"s,
+                                       [](const tile_map& tiles, const field_request& req, field_set& fields)
+                                         { const plot_geometry geometry(req.n_cells, req.distance_per_square);
+
+                                           calculate_polar_fields(tiles, req, max(thread::hardware_concurrency(), 2u), fields, geometry);
+                                         },
+                                       set<string> { "height"s, "angle"s, "grad"s, "los"s }
+                                     }
+                                   };
+
+/// the result of comparing one field with the reference
+struct field_comparison
+{ double   max_abs_error       { 0 };   ///< largest absolute difference
+  double   sum_abs_error       { 0 };   ///< sum of the absolute differences
+  uint64_t n_compared          { 0 };   ///< number of cells for which both values are valid
+  uint64_t n_nodata_mismatches { 0 };   ///< number of cells for which one value is NODATA and the other is not
+  double   p99_abs_error       { 0 };   ///< 99th percentile of the absolute differences
+
+/// mean absolute difference
+  inline const double mean_abs_error(void) const
+    { return (n_compared ? sum_abs_error / n_compared : 0); }
+};
+
+/*! \brief          Compare a field with the reference field
+    \param  ref     the reference field
+    \param  cand    the field to be compared
+    \return         the comparison
+*/
+const field_comparison compare_fields(const vector<vector<float>>& ref, const vector<vector<float>>& cand)
+{ field_comparison rv;
+  vector<double>   abs_errors;            // for the percentile
+
+  for (size_t r = 0; r < ref.size(); ++r)
+  { for (size_t c = 0; c < ref[r].size(); ++c)
+    { const bool ref_nodata  { ref[r][c] == NODATA };
+      const bool cand_nodata { cand[r][c] == NODATA };
+
+      if (ref_nodata != cand_nodata)
+        rv.n_nodata_mismatches++;
+      else
+      { if (!ref_nodata)
+        { const double abs_error { fabs(static_cast<double>(cand[r][c]) - ref[r][c]) };
+
+          rv.max_abs_error = max(rv.max_abs_error, abs_error);
+          rv.sum_abs_error += abs_error;
+          rv.n_compared++;
+          abs_errors.push_back(abs_error);
+        }
+      }
+    }
+  }
+
+  if (!abs_errors.empty())
+  { const auto p99_it { abs_errors.begin() + static_cast<ptrdiff_t>( ( (abs_errors.size() - 1) * 99 ) / 100 ) };
+
+    nth_element(abs_errors.begin(), p99_it, abs_errors.end());
+    rv.p99_abs_error = *p99_it;
+  }
+
+  return rv;
+}
+
+/*! \brief          Fraction of cells whose visibility differs from the reference
+    \param  ref     the reference LOS field
+    \param  cand    the LOS field to be compared
+    \return         the fraction of cells for which <i>cand</i> and <i>ref</i> disagree
+*/
+const double los_disagreement(const vector<vector<VISIBILITY>>& ref, const vector<vector<VISIBILITY>>& cand)
+{ uint64_t n_cells    { 0 };
+  uint64_t n_disagree { 0 };
+
+  for (size_t r = 0; r < ref.size(); ++r)
+  { for (size_t c = 0; c < ref[r].size(); ++c)
+    { n_cells++;
+
+      if (ref[r][c] != cand[r][c])
+        n_disagree++;
+    }
+  }
+
+  return (n_cells ? static_cast<double>(n_disagree) / n_cells : 0);
+}
+
+/*! \brief          Are the statistics accumulated while populating a set of fields consistent with the fields themselves?
+    \param  fields  the populated fields
+    \param  ref     the reference fields
+    \return         whether the extremes match the fields, the number of MHAT cells matches the reference, and the radial histogram
+                    accounts for every MHAT cell
+*/
+const bool statistics_consistent(const field_set& fields, const field_set& ref)
+{ field_statistics recalculated;
+
+  for (const auto& row : fields.height)
+    for (const float h : row)
+      recalculated.add_height(h);
+
+  for (const auto& row : fields.grad)
+    for (const float g : row)
+      recalculated.add_grad(g);
+
+  int n_binned { 0 };
+
+  for (const int count : fields.stats.radial_count)
+    n_binned += count;
+
+  return ( (recalculated.min_height == fields.stats.min_height) and (recalculated.max_height == fields.stats.max_height) and
+           (recalculated.min_grad == fields.stats.min_grad) and (recalculated.max_grad == fields.stats.max_grad) and
+           (fields.stats.n_cells_terrain_height == ref.stats.n_cells_terrain_height) and (n_binned == fields.stats.n_cells_terrain_height) );
+}
+
+int main(int argc, char** argv)
+{ const command_line cl(argc, argv);
+
+  const string   data_directory   { cl.value_present("-datadir"s) ? cl.value("-datadir"s) : "/tmp/drmap-validate"s };
+  const int      cells_per_degree { cl.value_present("-cellsperdegree"s) ? from_string<int>(cl.value("-cellsperdegree"s)) : 1200 };
+  const int      n_cells          { cl.value_present("-cells"s) ? from_string<int>(cl.value("-cells"s)) : 100 };
+  const float    antenna_height   { cl.value_present("-ant"s) ? from_string<float>(cl.value("-ant"s)) : 10.0f };
+  const double   hole_probability { cl.value_present("-holes"s) ? from_string<double>(cl.value("-holes"s)) : 0.0 };
+  const double   latitude         { cl.value_present("-lat"s) ? from_string<double>(cl.value("-lat"s)) : 40.5 };
+  const double   longitude        { cl.value_present("-long"s) ? -(abs(from_string<double>(cl.value("-long"s)))) : -105.5 };
+  const uint64_t seed             { cl.value_present("-seed"s) ? from_string<uint64_t>(cl.value("-seed"s)) : 1 };
+  const double   tol_angle        { cl.value_present("-tolangle"s) ? from_string<double>(cl.value("-tolangle"s)) : 0.001 };
+  const double   tol_grad         { cl.value_present("-tolgrad"s) ? from_string<double>(cl.value("-tolgrad"s)) : 0.001 };
+  const double   tol_height       { cl.value_present("-tolheight"s) ? from_string<double>(cl.value("-tolheight"s)) : 0.01 };
+  const double   tol_p99_angle    { cl.value_present("-tolp99angle"s) ? from_string<double>(cl.value("-tolp99angle"s)) : 0.02 };
+  const double   tol_p99_grad     { cl.value_present("-tolp99grad"s) ? from_string<double>(cl.value("-tolp99grad"s)) : 0.01 };
+  const double   tol_p99_height   { cl.value_present("-tolp99height"s) ? from_string<double>(cl.value("-tolp99height"s)) : 0.1 };
+  const double   tol_los          { cl.value_present("-tollos"s) ? from_string<double>(cl.value("-tollos"s)) : 0.001 };
+  const double   tol_los_approx   { cl.value_present("-tollosapprox"s) ? from_string<double>(cl.value("-tollosapprox"s)) : 0.025 };
+
+  debug = cl.parameter_present("-v"s) or cl.parameter_present("-debug"s);
+
+  vector<double> radii_km { 1, 5, 20 };
+
+  if (cl.value_present("-radius"s))
+  { radii_km.clear();
+
+    for (const string& r : split_string(cl.value("-radius"s), ","s))
+      radii_km.push_back(from_string<double>(r));
+  }
+
+  set<string> selected_paths;
+
+  if (cl.value_present("-paths"s))
+    for (const string& name : split_string(cl.value("-paths"s), ","s))
+      selected_paths.insert(name);
+
+  SYNTH_TERRAIN terrain_type { SYNTH_TERRAIN::MIXED };
+
+  try
+  { if (cl.value_present("-terrain"s))
+      terrain_type = synth_terrain_from_name(cl.value("-terrain"s));
+  }
+
+  catch (const synth_error& e)
+  { cerr << "Error: " << e.reason() << endl;
+    exit(-1);
+  }
+
+// write and load the tiles that cover the largest plot, plus a margin for the gradient calculation
+  const pair<double, double> qth        { latitude, longitude };
+  const double               max_radius { MAX_ELEMENT(radii_km) * 1000 + 1000 };
+  const double               delta_lat  { max_radius / (RE * DTOR) };
+  const double               delta_long { delta_lat / cos(latitude * DTOR) };
+
+  directory_create_if_necessary(data_directory);
+
+  const synthetic_terrain terrain(seed, terrain_type, hole_probability);
+
+  tile_map tiles;
+
+  for (int south = static_cast<int>(floor(latitude - delta_lat)); south <= static_cast<int>(floor(latitude + delta_lat)); ++south)
+  { for (int west = static_cast<int>(floor(longitude - delta_long)); west <= static_cast<int>(floor(longitude + delta_long)); ++west)
+    { const int llcode { llc(south + 0.5, west + 0.5) };
+
+      write_synthetic_tile(terrain, llcode, data_directory, cells_per_degree);
+      tiles.insert( { llcode, grid_float_tile(local_header_filename(llcode, data_directory), local_data_filename(llcode, data_directory)) } );
+    }
+  }
+
+  const float raw_qth_height { tiles.at(llc(qth)).interpolated_value(qth) };
+
+// compare
+  bool all_pass { true };
+
+// an approximate path must be within tolerance on the mean, and within the looser tolerance on the 99th percentile
+  auto report = [&all_pass](const string& path, const string& field, const field_comparison& fc, const double tolerance, const double p99_tolerance,
+                            const bool approximate = false)
+    { const bool pass { ( (approximate ? fc.mean_abs_error() : fc.max_abs_error) <= tolerance) and
+                        (!approximate or (fc.p99_abs_error <= p99_tolerance)) and (fc.n_nodata_mismatches == 0) };
+
+      cout << "  " << left << setw(16) << path << setw(8) << field << right << setw(14) << setprecision(6) << fc.max_abs_error
+           << setw(14) << fc.mean_abs_error() << setw(14) << fc.p99_abs_error << setw(10) << fc.n_nodata_mismatches << setw(10) << tolerance
+           << setw(10) << (approximate ? to_string(p99_tolerance, 3) : string()) << "  " << (pass ? "PASS" : "FAIL") << endl;
+
+      all_pass = all_pass and pass;
+    };
+
+  for (const double radius_km : radii_km)
+  { const double distance_scale { radius_km * 1000 };
+
+    const field_request req { qth, n_cells, static_cast<float>(distance_scale / n_cells), distance_scale, antenna_height, raw_qth_height, true, true, true };
+
+    field_set reference(n_cells);
+
+    calculate_fields(tiles, req, 1, reference);
+
+    cout << "radius " << radius_km << " km; " << (2 * n_cells + 1) << " x " << (2 * n_cells + 1) << " cells" << endl;
+    cout << "  " << left << setw(16) << "path" << setw(8) << "field" << right << setw(14) << "max |err|" << setw(14) << "mean |err|"
+         << setw(14) << "p99 |err|" << setw(10) << "nodata" << setw(10) << "tol" << setw(10) << "p99 tol" << endl;
+
+    for (const auto& fp : FAST_PATHS)
+    { if (!selected_paths.empty() and (selected_paths.count(fp.name) == 0))
+        continue;
+
+      field_set candidate(n_cells);
+
+      fp.calculate(tiles, req, candidate);
+
+      report(fp.name, "height"s, compare_fields(reference.height, candidate.height), tol_height, tol_p99_height, fp.approximate("height"s));
+      report(fp.name, "angle"s, compare_fields(reference.angle, candidate.angle), tol_angle, tol_p99_angle, fp.approximate("angle"s));
+      report(fp.name, "grad"s, compare_fields(reference.grad, candidate.grad), tol_grad, tol_p99_grad, fp.approximate("grad"s));
+
+      const double los_rate      { los_disagreement(reference.los, candidate.los) };
+      const double los_tolerance { fp.approximate("los"s) ? tol_los_approx : tol_los };
+      const bool   los_pass      { los_rate <= los_tolerance };
+
+      cout << "  " << left << setw(16) << fp.name << setw(8) << "los" << right << setw(13) << setprecision(4) << (100 * los_rate) << "%"
+           << setw(48) << los_tolerance << setw(10) << "" << "  " << (los_pass ? "PASS" : "FAIL") << endl;
+
+      all_pass = all_pass and los_pass;
+
+      const bool stats_pass { statistics_consistent(candidate, reference) };
+
+      cout << "  " << left << setw(16) << fp.name << setw(8) << "stats" << right << setw(78) << (stats_pass ? "PASS" : "FAIL") << endl;
+
+      all_pass = all_pass and stats_pass;
+    }
+  }
+
+  cout << (all_pass ? "all fast paths within tolerance" : "FAILURES") << endl;
+
+  return (all_pass ? 0 : 1);
+}
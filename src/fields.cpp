@@ -0,0 +1,393 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   fields.cpp
+
+    Calculation of the per-cell fields (height, elevation angle, gradient and line of sight) for a plot
+*/
+
+#include "fields.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <future>
+#include <iostream>
+#include <mutex>
+
+using namespace std;
+
+// mutexes
+static mutex angle_field_mutex;
+static mutex height_field_mutex;
+static mutex los_field_mutex;
+static mutex statistics_mutex;
+
+/*! \brief          The height of the terrain in a cell, from k × k samples spread over the cell
+    \param  tiles   the tiles that contain the plot
+    \param  ll      latitude and longitude of the centre of the cell
+    \param  req     the parameters of the plot
+    \return         the combined height of the samples, per USGS
+
+    Cells that lie within one tile are sampled by that tile in a single call; cells that straddle tiles are sampled point by point
+*/
+static const float supersampled_value(const tile_map& tiles, const pair<double, double>& ll, const field_request& req)
+{ const double half_lat  { (req.distance_per_square / 2) / RE * RTOD };
+  const double half_long { half_lat / cos(ll.first * DTOR) };
+  const double south     { ll.first - half_lat };
+  const double north     { ll.first + half_lat };
+  const double west      { ll.second - half_long };
+  const double east      { ll.second + half_long };
+
+  if (llc(south, west) == llc(north, east))
+    return tiles.at(llc(ll)).area_value(south, west, north, east, req.supersample, req.supersample_mode);
+
+  double sum     { 0 };
+  float  highest { numeric_limits<float>::lowest() };
+  int    n_valid { 0 };
+
+  for (int r = 0; r < req.supersample; ++r)
+  { const double latitude { south + (r + 0.5) * (north - south) / req.supersample };
+
+    for (int c = 0; c < req.supersample; ++c)
+    { const double longitude { west + (c + 0.5) * (east - west) / req.supersample };
+      const float  v         { tiles.at(llc(latitude, longitude)).cell_value(latitude, longitude) };
+
+      if (v > -9000)
+      { sum += v;
+        highest = max(highest, v);
+        n_valid++;
+      }
+    }
+  }
+
+  if (n_valid == 0)
+    throw grid_float_error(GRID_FLOAT_NODATA, "No valid data in cell at "s + to_string(ll.first) + ", "s + to_string(ll.second));
+
+  return ( (req.supersample_mode == SUPERSAMPLE::MAX) ? highest : static_cast<float>(sum / n_valid) );
+}
+
+/*! \brief                          Populate the fields for some of the rows of a plot, for one combination of the optional fields
+    \tparam ELEV                    whether to populate the angle-of-elevation field
+    \tparam GRAD                    whether to populate the gradient field by sampling the terrain either side of each cell
+    \tparam LOS                     whether to populate the LOS field
+    \param  tiles                   the tiles that contain the plot
+    \param  req                     the parameters of the plot
+    \param  delta_y_start           the starting y offset (the plot starts at -n_cells)
+    \param  delta_y_increment       the number of rows by which to increment y
+    \param  fields                  the fields to populate
+    \param  geometry                the geometry of the cells; if nullptr, the geometry of each cell is calculated directly
+
+    The optional fields are chosen at compile time, so the loop over the cells of each instantiation contains no tests
+    of <i>req.elev</i>, <i>req.grad</i> or <i>req.los</i>. This function is thread-safe.
+*/
+template <bool ELEV, bool GRAD, bool LOS>
+static void populate_fields_kernel(const tile_map& tiles, const field_request& req, const int delta_y_start, const int delta_y_increment, field_set& fields,
+                                   const plot_geometry* geometry)
+{ field_statistics stats;                                                      // for this thread's rows; merged into fields at the end
+
+  for (int delta_y = delta_y_start; delta_y <= req.n_cells; delta_y += delta_y_increment)
+  { const trace_scope row_trace("populate_fields row", "row", delta_y);
+  
+    for (int delta_x = -req.n_cells; delta_x <= req.n_cells; ++delta_x)
+    { const int                  column_index              { delta_x + req.n_cells };
+      const int                  row_index                 { delta_y + req.n_cells };
+      const cell_geometry        cell                      { geometry ? (*geometry)(delta_x, delta_y) : direct_cell_geometry(delta_x, delta_y, req.distance_per_square) };
+      const double&              bearing_from_north        { cell.bearing };
+      const double&              distance_to_square        { cell.distance };                   // along curved surface
+      const pair<double, double> ll                        { ll_from_bd(req.qth, bearing_from_north, distance_to_square) };        
+      const double&              correction                { cell.correction };
+
+      float raw_value { -9999 };        // default value is NODATA
+      
+      try
+      { raw_value = ( (req.supersample > 1) ? supersampled_value(tiles, ll, req) : tiles.at(llc(ll)).interpolated_value(ll) );     // height per USGS
+
+// see note near the top of the file regarding modification of the received heights
+        { traced_lock_guard<mutex> height_field_lock(height_field_mutex, "wait height_field_mutex");                    // should not be necessary, but be paranoid
+      
+          fields.height[row_index][column_index] = raw_value * cell.cos_factor - correction;
+        
+          if ( (delta_x == 0) and (delta_y == 0) )
+            fields.height[row_index][column_index] += req.antenna_height;              // add the antenna to the central square
+        }
+        
+        if (distance_to_square <= req.distance_scale)                           // accumulate for calculation of MHAT
+          stats.add_terrain_height(fields.height[row_index][column_index] - ( ( (delta_x == 0) and (delta_y == 0) ) ? req.antenna_height : 0 ),  // RAW terrain
+                                   distance_to_square, req.mhat_bin_width);
+      }
+      
+      catch (const grid_float_error& e)
+      { cerr << "Caught grid float error while calculating height field: " << e.reason() << endl;
+          
+        traced_lock_guard<mutex> height_field_lock(height_field_mutex, "wait height_field_mutex");                    // should not be necessary, but be paranoid
+      
+        fields.height[row_index][column_index] = -9999;
+      }
+
+      stats.add_height(fields.height[row_index][column_index]);
+        
+      double elevation_angle_in_degrees { 0 };
+      
+      if constexpr (ELEV)
+      { if (raw_value > -9000)
+        { elevation_angle_in_degrees = elevation_angle(req.qth, ll, req.raw_qth_height + req.antenna_height, raw_value) * RTOD;
+        
+          { traced_lock_guard<mutex> angle_field_lock(angle_field_mutex, "wait angle_field_mutex");                    // should not be necessary, but be paranoid
+        
+            fields.angle[row_index][column_index] = elevation_angle_in_degrees;
+          }
+        }
+        else    // NODATA
+        { traced_lock_guard<mutex> angle_field_lock(angle_field_mutex, "wait angle_field_mutex");                    // should not be necessary, but be paranoid
+        
+          fields.angle[row_index][column_index] = -9999;
+        }
+      }
+ 
+      if constexpr (GRAD)
+      { if ( (delta_x == 0) and (delta_y == 0) )
+          fields.grad[row_index][column_index] = 0;
+        else
+        { try
+          { const float delta_distance { 10 };        // gradient is measured over ±10 metres
+
+            const double distance_m { distance_to_square - delta_distance };
+            const double distance_p { distance_to_square + delta_distance };
+          
+            const pair<double, double> ll_m { ll_from_bd(req.qth, bearing_from_north, distance_m) };        
+            const pair<double, double> ll_p { ll_from_bd(req.qth, bearing_from_north, distance_p) };        
+
+            const float raw_value_m { tiles.at(llc(ll_m)).interpolated_value(ll_m) };                 // height per USGS
+            const float raw_value_p { tiles.at(llc(ll_p)).interpolated_value(ll_p) };                 // height per USGS
+
+            const double correction_m { curvature_correction(distance_m) };
+            const double correction_p { curvature_correction(distance_p) };
+
+            const double height_m { raw_value_m * cos(distance_m / RE) - correction_m };
+            const double height_p { raw_value_p * cos(distance_p / RE) - correction_p };
+          
+            fields.grad[row_index][column_index] = (height_p - height_m) / (2 * delta_distance);
+          }
+          
+          catch (const grid_float_error& e)
+          { cerr << "Caught grid float error while calculating grad field: " << e.reason() << endl;
+          
+            fields.grad[row_index][column_index] = -9999;
+          }
+        }
+
+        stats.add_grad(fields.grad[row_index][column_index]);
+      }
+      
+// visibility of this cell     
+      if constexpr (LOS)
+      { if (delta_x != 0 or delta_y != 0)                     // for everything except the QTH cell
+        { const float angle { static_cast<float>(ELEV ? (elevation_angle_in_degrees * DTOR) : elevation_angle(req.qth, ll, req.raw_qth_height + req.antenna_height, raw_value)) }; 
+
+          bool visible { true };
+            
+// walk along a bearing, looking to see if visibility is maintained
+          int decrement { 1 };
+            
+// a bit of a fudge for very close-in terminating points
+          if (distance_to_square < 250)               // 250m
+            decrement = max(int(distance_to_square / 4), 1);  // ~25% per step
+            
+          try
+          { for (int n = 95; visible and n >= 5; n -= decrement)                                            // skip points near ends to avoid rounding problems
+            { const double               distance_to_square_n { (n * distance_to_square) / (100) };
+              const pair<double, double> ll_n                 { ll_from_bd(req.qth, bearing_from_north, distance_to_square_n) };
+              const float                raw_value_n          { tiles.at(llc(ll_n)).interpolated_value(ll_n) };
+              const float                angle_n              { elevation_angle(req.qth, ll_n, req.raw_qth_height + req.antenna_height, raw_value_n) };              
+              
+             visible = (angle_n < angle);
+            }
+  
+            { traced_lock_guard<mutex> los_field_lock(los_field_mutex, "wait los_field_mutex");                    // should not be necessary, but be paranoid
+
+              fields.los[row_index][column_index] = (visible ? VISIBILITY::VISIBLE : VISIBILITY::NOT_VISIBLE);
+            }  
+          }
+
+          catch (...)  // default to NOT VISIBLE
+          { cerr << "Exception handled when calculating LOS" << endl;
+          
+            traced_lock_guard<mutex> los_field_lock(los_field_mutex, "wait los_field_mutex");                    // should not be necessary, but be paranoid
+
+            fields.los[row_index][column_index] = VISIBILITY::NOT_VISIBLE;
+          } 
+        }
+        else                                                  // QTH is always visible
+        { traced_lock_guard<mutex> los_field_lock(los_field_mutex, "wait los_field_mutex");                    // should not be necessary, but be paranoid
+
+          fields.los[req.n_cells][req.n_cells] = VISIBILITY::VISIBLE;
+        }
+      }
+    }
+  }
+
+  traced_lock_guard<mutex> statistics_lock(statistics_mutex, "wait statistics_mutex");
+
+  fields.stats.merge(stats);
+}
+
+/// the signature of populate_fields() and of each instantiation of populate_fields_kernel()
+using fields_kernel = void (*)(const tile_map&, const field_request&, const int, const int, field_set&, const plot_geometry*);
+
+/// the instantiations of populate_fields_kernel(), indexed by (ELEV << 2) | (GRAD << 1) | LOS
+static constexpr array<fields_kernel, 8> FIELDS_KERNELS { populate_fields_kernel<false, false, false>, populate_fields_kernel<false, false, true>,
+                                                          populate_fields_kernel<false, true, false>,  populate_fields_kernel<false, true, true>,
+                                                          populate_fields_kernel<true, false, false>,  populate_fields_kernel<true, false, true>,
+                                                          populate_fields_kernel<true, true, false>,   populate_fields_kernel<true, true, true>
+                                                        };
+
+/*! \brief          The instantiation of populate_fields_kernel() for the fields requested in a plot
+    \param  req     the parameters of the plot
+    \return         the kernel that populates the fields requested in <i>req</i>
+
+    The gradient is populated by the kernel only if it is to be calculated by sampling
+*/
+static inline const fields_kernel select_fields_kernel(const field_request& req)
+{ const bool sample_grad { req.grad and (req.grad_method == GRADIENT_METHOD::SAMPLE) };
+
+  return FIELDS_KERNELS[ (static_cast<int>(req.elev) << 2) | (static_cast<int>(sample_grad) << 1) | static_cast<int>(req.los) ];
+}
+
+/*! \brief                          Populate the fields for some of the rows of a plot
+    \param  tiles                   the tiles that contain the plot
+    \param  req                     the parameters of the plot
+    \param  delta_y_start           the starting y offset (the plot starts at -n_cells)
+    \param  delta_y_increment       the number of rows by which to increment y
+    \param  fields                  the fields to populate
+    \param  geometry                the geometry of the cells; if nullptr, the geometry of each cell is calculated directly
+
+    This function is thread-safe. It does not yet handle the NODATA case reasonably.
+*/
+void populate_fields(const tile_map& tiles, const field_request& req, const int delta_y_start, const int delta_y_increment, field_set& fields,
+                     const plot_geometry* geometry)
+{ select_fields_kernel(req)(tiles, req, delta_y_start, delta_y_increment, fields, geometry);
+}
+
+/*! \brief          Calculate the gradient field from the height field
+    \param  req     the parameters of the plot
+    \param  fields  the fields; the height field must be complete
+
+    The gradient of each cell is the derivative of height along the bearing from the QTH, from central differences
+    between the neighbouring cells (one-sided differences at the edges of the plot). No terrain is sampled. The
+    interior of each row is a branch-free loop over contiguous values, which the compiler can vectorise.
+*/
+void stencil_gradient_field(const field_request& req, field_set& fields)
+{ const int   n_cells { req.n_cells };
+  const int   size    { 2 * n_cells + 1 };
+  const float dps     { req.distance_per_square };
+
+  fields.height[n_cells][n_cells] -= req.antenna_height;        // the stencil uses the terrain, not the antenna
+
+// the general case, for the first and last columns
+  auto edge_gradient = [&](const int row, const int column)
+    { const int   row_lo    { max(row - 1, 0) };
+      const int   row_hi    { min(row + 1, size - 1) };
+      const int   column_lo { max(column - 1, 0) };
+      const int   column_hi { min(column + 1, size - 1) };
+      const float h_w       { fields.height[row][column_lo] };
+      const float h_e       { fields.height[row][column_hi] };
+      const float h_s       { fields.height[row_lo][column] };
+      const float h_n       { fields.height[row_hi][column] };
+
+      if (min( { h_w, h_e, h_s, h_n } ) <= -9000)
+        return -9999.0f;
+
+      const float gx { (h_e - h_w) / ((column_hi - column_lo) * dps) };
+      const float gy { (h_n - h_s) / ((row_hi - row_lo) * dps) };
+      const float dx { static_cast<float>(column - n_cells) };
+      const float dy { static_cast<float>(row - n_cells) };
+
+      return (gx * dx + gy * dy) / sqrt(dx * dx + dy * dy);
+    };
+
+  for (int row = 0; row < size; ++row)
+  { const float* __restrict h_s { fields.height[max(row - 1, 0)].data() };
+    const float* __restrict h   { fields.height[row].data() };
+    const float* __restrict h_n { fields.height[min(row + 1, size - 1)].data() };
+    float* __restrict       g   { fields.grad[row].data() };
+
+    const float inv_x_spacing { 1.0f / (2 * dps) };
+    const float inv_y_spacing { 1.0f / (((row == 0) or (row == size - 1) ? 1 : 2) * dps) };
+    const float dy            { static_cast<float>(row - n_cells) };
+
+    for (int column = 1; column < size - 1; ++column)
+    { const float gx     { (h[column + 1] - h[column - 1]) * inv_x_spacing };
+      const float gy     { (h_n[column] - h_s[column]) * inv_y_spacing };
+      const float dx     { static_cast<float>(column - n_cells) };
+      const float lowest { min(min(h[column - 1], h[column + 1]), min(h_s[column], h_n[column])) };
+      const float value  { (gx * dx + gy * dy) / sqrt(dx * dx + dy * dy) };
+
+      g[column] = ( (lowest > -9000) ? value : -9999.0f );
+    }
+
+    g[0] = edge_gradient(row, 0);
+    g[size - 1] = edge_gradient(row, size - 1);
+
+    if (row == n_cells)
+      g[n_cells] = 0;                                           // the bearing is undefined at the QTH
+
+    for (int column = 0; column < size; ++column)               // while the row is still in cache
+      fields.stats.add_grad(g[column]);
+  }
+
+  fields.height[n_cells][n_cells] += req.antenna_height;
+}
+
+/*! \brief                  Populate all the fields of a plot, in parallel
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields to populate
+    \param  geometry        the geometry of the cells; if nullptr, the geometry of each cell is calculated directly
+
+    Thread <i>n</i> (wrt 0) populates every <i>n_threads</i>th row, starting with row <i>n</i>. The kernel for the requested fields
+    is chosen once, before the threads start. A stencil gradient field is calculated after all the threads have finished.
+*/
+void calculate_fields(const tile_map& tiles, const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry* geometry)
+{ const fields_kernel kernel { select_fields_kernel(req) };
+
+  vector<future<void>> vec_futures;    
+
+  for (int start = 1; start <= static_cast<int>(n_threads); ++start)
+    vec_futures.emplace_back(async(launch::async, kernel, cref(tiles), cref(req), (-req.n_cells + (start - 1)), static_cast<int>(n_threads), ref(fields), geometry));
+    
+  for (auto& this_future : vec_futures)
+    this_future.get();                                  // .get() blocks until the future is available
+
+  if (req.grad and (req.grad_method == GRADIENT_METHOD::STENCIL))
+    stencil_gradient_field(req, fields);
+}
+
+/*! \brief                  The MHAT for every radius that is a multiple of the width of the bins of the radial histogram
+    \param  stats           the statistics of a populated set of fields
+    \param  antenna_top     height of the top of the antenna, in metres (raw height of the QTH + height of the antenna)
+    \param  bin_width       width of the bins of the radial histogram, in metres
+    \param  max_radius      the radius of the plot, in metres
+    \return                 pairs of radius, in metres, and MHAT, in metres, for increasing radii; the last radius is <i>max_radius</i>
+*/
+const vector<pair<double, float>> mhat_curve(const field_statistics& stats, const float antenna_top, const double bin_width, const double max_radius)
+{ vector<pair<double, float>> rv;
+
+  double sum   { 0 };
+  int    count { 0 };
+
+  for (size_t bin = 0; bin < stats.radial_sum.size(); ++bin)
+  { sum += stats.radial_sum[bin];
+    count += stats.radial_count[bin];
+
+    if (count)
+      rv.push_back( { min( (bin + 1) * bin_width, max_radius ), static_cast<float>(antenna_top - sum / count) } );
+  }
+
+  return rv;
+}
@@ -7,15 +7,24 @@
 // Copyright owners:
 //    N7DR
 
+#include "block_cache.h"
 #include "diskfile.h"
 #include "grid_float.h"
 #include "string_functions.h"
 
 //#include <cmath>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <streambuf>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace std;
 
 extern bool debug;
@@ -29,7 +38,9 @@ extern bool debug;
     \param  local_directory     the local directory containing USGS files
 */ 
 void download_if_necessary(const int llc, const string& local_directory)
-{ bool need_to_download { false };
+{ const trace_scope download_trace("download_if_necessary", "llc", llc);
+
+  bool need_to_download { false };
 
   const string local_dirname    { local_directory + ( (last_char(local_directory) == '/') ? ""s : "/"s ) };       // ensure a terminating slash
   const string full_header_name { local_dirname + "usgs_ned_13_" + base_filename(llc) + "_gridfloat.hdr"s };    // full name of local header file
@@ -82,6 +93,8 @@ void download_if_necessary(const int llc, const string& local_directory)
   }
   
 // we get here only if the download succeeded
+  phase_timer unzip_timer(PHASE::UNZIP);
+
   const string default_header_name { "usgs_ned_13_" + base_filename(llc) + "_gridfloat.hdr"s };
 
   command = "unzip -qq -o -d "s + local_directory + " "s + local_filename + " " + default_header_name;  // overwrite!!
@@ -133,6 +146,59 @@ void download_if_necessary(const int llc, const string& local_directory)
   }
 }
 
+/*! \brief      The name of a kind of tile storage
+    \param  s   the kind of storage
+    \return     the name of <i>s</i>
+*/
+const string storage_name(const TILE_STORAGE s)
+{ switch (s)
+  { case TILE_STORAGE::RAM :
+      return "RAM"s;
+
+    case TILE_STORAGE::MAPPED :
+      return "mapped"s;
+
+    default :
+      return "disk"s;
+  }
+}
+
+constexpr size_t COUNT_BUFFER_FLOATS { 262144 };                          ///< number of values read at once when counting NODATA cells on disk (1MB)
+
+static size_t disk_block_bytes  { 16384 };                  ///< size of the blocks in the per-thread caches
+static size_t disk_cache_budget { 4 * 1024 * 1024 };        ///< memory for the blocks in each per-thread cache
+
+/// the block cache of a thread; its count of hits is passed to PROFILER when the thread exits
+struct thread_block_cache
+{ std::unique_ptr<block_cache> cache;           ///< the cache; created when the thread first reads from a tile on disk
+
+/// destructor
+  inline ~thread_block_cache(void)
+  { if (cache)
+      PROFILER.increment(COUNTER::BLOCK_CACHE_HITS, cache -> take_hits());
+  }
+};
+
+static thread_local thread_block_cache disk_cache;          ///< the cache of blocks read by this thread
+static atomic<uint64_t>                next_file_id { 1 };  ///< the next value of grid_float_tile::_file_id
+
+/*! \brief                  Set the parameters of the per-thread caches of blocks read from tiles on disk
+    \param  block_bytes     size of each block, in bytes; rounded to a power of two between 4096 and 65536
+    \param  budget_bytes    maximum memory to use for the blocks in each thread's cache, in bytes
+
+    MUST be called before any thread has read from a tile on disk
+*/
+void configure_disk_cache(const size_t block_bytes, const size_t budget_bytes)
+{ disk_block_bytes = block_bytes;
+  disk_cache_budget = budget_bytes;
+}
+
+// -----------  grid_float_tile ----------------
+
+/*! \class  grid_float_tile
+    \brief  Encapsulate a USGS GridFloat tile
+*/
+
 /*! \brief              Map a latitude to a row number
     \param  latitude    latitude to map
     \return             row number that contains latitude <i>latitude</i>
@@ -187,10 +253,11 @@ const grid_float_tile::QUADRANT grid_float_tile::_quadrant(const double& latitud
 /*! \brief                      Constructor
     \param  header_filename     name of the header file
     \param  data_filename       name of the data file
+    \param  storage             where to hold the data
 */
-grid_float_tile::grid_float_tile(const std::string& header_filename, const std::string& data_filename, const bool small_memory) :
-  _data_filename(data_filename),
-  _sm(small_memory)
+grid_float_tile::grid_float_tile(const std::string& header_filename, const std::string& data_filename, const TILE_STORAGE storage) :
+  _storage(storage),
+  _data_filename(data_filename)
 { if (debug)
     cout << "data_filename = " << data_filename << endl;
   
@@ -253,67 +320,43 @@ grid_float_tile::grid_float_tile(const std::string& header_filename, const std::
     _yt = _yllcorner + _cellsize * _n_rows;
   }
   
-// set the capacity of the data vectors
-  if (!small_memory)
-  { _data.reserve(_n_rows);
-
 // import the elevation data
-    { ifstream ifs { data_filename };
-  
-      const int row_length { static_cast<int>(sizeof(float) * _n_columns) };
-    
-      for (int n = 0; n < _n_rows; ++n)
-      { vector<float> row(_n_columns);
-    
-        char* cp { reinterpret_cast<char*>(row.data()) };
-      
-        ifs.read (cp, row_length);
-      
-        _data.push_back(row);
-      }
-    }                             // finished importing data
-  
-// count the bad data
-    for (int n1 = 0; n1 < _n_rows; ++n1)
-    { const auto& row { _data[n1] };
-  
-      for (int n2 = 0; n2 < _n_columns; ++ n2)
-        if (row[n2] < (_nodata + 1))
-          _n_invalid_data++;
-    }
-    
-    if (debug)  
-      cout << "Number of invalid data elements = " << comma_separated_string(_n_invalid_data) << " out of " << comma_separated_string(_n_rows * _n_columns) << endl;
-  }
-  else    // small memory
-  { _ifsp = new ifstream(data_filename);
-  
-    if (! _ifsp -> good())
-    { cerr << "ERROR IFSTREAM IN BAD STATE" << endl;
-      exit(-1);
-    }
-    
+  switch (storage)
+  { case TILE_STORAGE::RAM :
+      _load_into_ram();
+      _count_invalid_data(_data.data());
+      break;
+
+    case TILE_STORAGE::MAPPED :
+      _map();
+      _count_invalid_data(_mapping.get());                                // this reads every page of the file
+      PROFILER.increment(COUNTER::BYTES_READ, data_bytes());
+      break;
+
+    case TILE_STORAGE::DISK :
+      { _open();
+
 // count the bad data
+        vector<float> buffer(COUNT_BUFFER_FLOATS);
+        uint64_t      counter { 0 };
+        ssize_t       n_read;
 
-    float value;
-    long counter { 0 };
-    
-    while (! _ifsp -> eof())
-    { _ifsp -> read(reinterpret_cast<char*>(&value), sizeof(value));
-      
-      if (! _ifsp ->eof())
-      { counter++;
-    
-        if (value < (_nodata + 1))
-          _n_invalid_data++;
-      }
-    }
+        while ( (n_read = ::pread(*_fd, buffer.data(), buffer.size() * sizeof(float), counter * sizeof(float))) > 0 )
+        { const size_t n_values { static_cast<size_t>(n_read) / sizeof(float) };
 
-    if (debug)    
-      cout << "Number of invalid data elements [sm] = " << comma_separated_string(_n_invalid_data) << " out of " << comma_separated_string(counter) << endl;
+          for (size_t n = 0; n < n_values; ++n)
+            if (buffer[n] < (_nodata + 1))
+              _n_invalid_data++;
+
+          counter += n_values;
+        }
 
-    delete(_ifsp);
-    _ifsp = nullptr;    
+        PROFILER.increment(COUNTER::BYTES_READ, counter * sizeof(float));
+
+        if (debug)    
+          cout << "Number of invalid data elements [sm] = " << comma_separated_string(_n_invalid_data) << " out of " << comma_separated_string(counter) << endl;
+      }
+      break;
   }
 }
 
@@ -335,7 +378,8 @@ const string grid_float_tile::to_string(void) const
   rv += "Bottom Y               = "s + ::to_string(_yb) + EOL;
   rv += "Top Y                  = "s + ::to_string(_yt) + EOL;
 
-  rv += "Number of invalid data = "s + ::to_string(_n_invalid_data);
+  rv += "Number of invalid data = "s + ::to_string(_n_invalid_data) + EOL;
+  rv += "Storage                = "s + storage_name(_storage);
   
   return rv;
 }
@@ -349,39 +393,7 @@ const string grid_float_tile::to_string(void) const
 */ 
 const float grid_float_tile::cell_value(const double& latitude, const double& longitude) const
 { if (is_in_tile(latitude, longitude))
-  { const int row_nr    { _map_latitude_to_index(latitude) };
-    const int column_nr { _map_longitude_to_index(longitude) };    
-    const int row_size  { _n_columns * 4 };
-    
-    if (_sm)
-    { if (_ifsp == nullptr)
-        _ifsp = new ifstream(_data_filename);
-      
-      long posn = (row_nr * row_size) + (column_nr * 4);
-    
-      _ifsp -> seekg (0, _ifsp -> end);
-      long length = _ifsp -> tellg();
-    
-      _ifsp ->seekg( (row_nr * row_size) + column_nr * 4);
-    
-      if (! _ifsp -> good())
-      { cerr << "ERROR IFSTREAM IN BAD STATE #1 IN CELL_VALUE WHEN SEEKING TO " << posn << ", length = " << length << endl;
-        exit(-1);
-      }
-    
-      float value;
-      _ifsp -> read(reinterpret_cast<char*>(&value), sizeof(value));
-      
-      if (! _ifsp -> good())
-      { cerr << "ERROR IFSTREAM IN BAD STATE #2 IN CELL_VALUE" << endl;
-        exit(-1);
-      }
-
-      return value;
-    } 
-    else
-      return _data[row_nr][column_nr];
-  }
+    return _value(_map_latitude_to_index(latitude), _map_longitude_to_index(longitude));
   else
     return _nodata;
 }
@@ -393,33 +405,202 @@ const float grid_float_tile::cell_value(const double& latitude, const double& lo
     Performs no bounds checking
 */
 const float grid_float_tile::cell_value(const std::pair<int, int>& ip) const  // pair is lat index, long index
-{ if (_sm)
-  { if (_ifsp == nullptr)
-      _ifsp = new std::ifstream(_data_filename);
-      
-    const int  row_size { _n_columns * 4 };      // in bytes
-    const long posn     { (ip.first * row_size) + (ip.second * 4) };    // in bytes
-    
-    _ifsp ->seekg(posn);
-    
-    if (! _ifsp -> good())
-    { cerr << "ERROR IFSTREAM IN BAD STATE #1 IN CELL_VALUE WHEN SEEKING TO " << posn << endl;
-      exit(-1);
+  { return _value(ip.first, ip.second); }
+
+/*! \brief          Combine up to k × k cells spread evenly over a rectangle
+    \param  south   latitude of the southern edge of the rectangle
+    \param  west    longitude of the western edge of the rectangle
+    \param  north   latitude of the northern edge of the rectangle
+    \param  east    longitude of the eastern edge of the rectangle
+    \param  k       number of samples along each side of the rectangle
+    \param  mode    how to combine the samples
+    \return         the mean or the maximum of the valid samples
+
+    The rectangle MUST be within the tile. If fewer than <i>k</i> cells of the tile span a side of the rectangle,
+    each of those cells is sampled once, rather than some being sampled more than once.
+    Throws a grid_float_error if none of the samples is valid.
+
+    The indices of the samples are calculated once per row and column, and each row of samples is read in
+    order of increasing column, so the cost is dominated by reading the samples themselves.
+*/
+const float grid_float_tile::area_value(const double& south, const double& west, const double& north, const double& east, const int k, const SUPERSAMPLE mode) const
+{ PROFILER.increment(COUNTER::AREA_VALUE);
+
+  const int row_first    { max(_map_latitude_to_index(north), 0) };                  // rows go from N to S
+  const int row_last     { min(_map_latitude_to_index(south), _n_rows - 1) };
+  const int column_first { max(_map_longitude_to_index(west), 0) };
+  const int column_last  { min(_map_longitude_to_index(east), _n_columns - 1) };
+
+  const int row_span     { row_last - row_first + 1 };
+  const int column_span  { column_last - column_first + 1 };
+  const int n_rows       { min(max(k, 1), row_span) };
+  const int n_columns    { min(max(k, 1), column_span) };
+
+  double sum     { 0 };
+  float  highest { numeric_limits<float>::lowest() };
+  int    n_valid { 0 };
+
+  for (int r = 0; r < n_rows; ++r)
+  { const int row_nr { row_first + ((2 * r + 1) * row_span) / (2 * n_rows) };       // the centres of n_rows equal divisions of the span
+
+    for (int c = 0; c < n_columns; ++c)
+    { const float v { _value(row_nr, column_first + ((2 * c + 1) * column_span) / (2 * n_columns)) };
+
+      if (valid_height(v))
+      { sum += v;
+        highest = max(highest, v);
+        n_valid++;
+      }
     }
-    
-    float value;
-    
-    _ifsp -> read(reinterpret_cast<char*>(&value), sizeof(value));
-      
-    if (! _ifsp -> good())
-    { cerr << "ERROR IFSTREAM IN BAD STATE #2 IN CELL_VALUE" << endl;
+  }
+
+  PROFILER.increment(COUNTER::AREA_SAMPLES, static_cast<uint64_t>(n_rows) * n_columns);
+
+  if (n_valid == 0)
+    throw grid_float_error(GRID_FLOAT_NODATA, ( "No valid data in area "s + ::to_string(south) + ", "s + ::to_string(west) + " to "s + ::to_string(north) + ", "s + ::to_string(east)) );
+
+  return ( (mode == SUPERSAMPLE::MAX) ? highest : static_cast<float>(sum / n_valid) );
+}
+
+/*! \brief              Read the value of a cell from the data file
+    \param  row_nr      row number
+    \param  column_nr   column number
+    \return             the value of the cell [row_nr][column_nr]
+
+    Thread-safe: the file is read with pread(), through a cache of blocks (with CLOCK eviction) that belongs to the calling thread
+*/
+const float grid_float_tile::_disk_value(const int row_nr, const int column_nr) const
+{ if (!disk_cache.cache)
+    disk_cache.cache = make_unique<block_cache>(disk_block_bytes, disk_cache_budget);
+
+  block_cache&   cache       { *disk_cache.cache };
+  const uint64_t block_bytes { cache.block_bytes() };
+  const uint64_t offset      { (static_cast<uint64_t>(row_nr) * _n_columns + column_nr) * sizeof(float) };    // in bytes
+  const uint64_t block_nr    { offset / block_bytes };
+  const float*   values      { cache.find(_file_id, block_nr) };
+
+  if (!values)
+  { float*        new_values { cache.insert(_file_id, block_nr) };
+    const ssize_t n_read     { ::pread(*_fd, new_values, block_bytes, block_nr * block_bytes) };    // the last block may be short
+
+    if (n_read < static_cast<ssize_t>( (offset % block_bytes) + sizeof(float)) )
+    { cerr << "ERROR READING " << _data_filename << " AT OFFSET " << offset << endl;
       exit(-1);
     }
 
-    return value;      
+    PROFILER.increment(COUNTER::BYTES_READ, n_read);
+    PROFILER.increment(COUNTER::BLOCK_CACHE_MISSES);
+    PROFILER.increment(COUNTER::BLOCK_CACHE_HITS, cache.take_hits());
+
+    values = new_values;
   }
-  else
-    return _data[ip.first][ip.second]; 
+
+  return values[(offset % block_bytes) / sizeof(float)];
+}
+
+/// open the data file for reading with pread()
+void grid_float_tile::_open(void)
+{ const int fd { ::open(_data_filename.c_str(), O_RDONLY | O_CLOEXEC) };
+
+  if (fd < 0)
+  { cerr << "ERROR: cannot open data file " << _data_filename << endl;
+    exit(-1);
+  }
+
+  _fd = shared_ptr<const int>(new int(fd), [](const int* p) { ::close(*p); delete p; });
+  _file_id = next_file_id++;
+}
+
+/// read the data file into _data
+void grid_float_tile::_load_into_ram(void)
+{ ifstream ifs { _data_filename, ios::binary };
+
+  _data.resize(static_cast<size_t>(_n_rows) * _n_columns);
+
+  ifs.read(reinterpret_cast<char*>(_data.data()), data_bytes());
+
+  PROFILER.increment(COUNTER::BYTES_READ, data_bytes());
+}
+
+/// map the data file into _mapping
+void grid_float_tile::_map(void)
+{ const int fd { ::open(_data_filename.c_str(), O_RDONLY | O_CLOEXEC) };
+
+  struct stat stat_buf;
+
+  if ( (fd < 0) or (::fstat(fd, &stat_buf) != 0) or (static_cast<uint64_t>(stat_buf.st_size) < data_bytes()) )
+  { cerr << "ERROR: cannot map data file " << _data_filename << endl;
+    exit(-1);
+  }
+
+  const size_t n_bytes { data_bytes() };
+  void*        vp      { ::mmap(nullptr, n_bytes, PROT_READ, MAP_PRIVATE, fd, 0) };
+
+  ::close(fd);                                  // the mapping remains valid
+
+  if (vp == MAP_FAILED)
+  { cerr << "ERROR: mmap failed for data file " << _data_filename << endl;
+    exit(-1);
+  }
+
+  _mapping = shared_ptr<const float>(static_cast<const float*>(vp), [n_bytes](const float* p) { ::munmap(const_cast<float*>(p), n_bytes); });
+}
+
+/*! \brief      Count the NODATA cells
+    \param  vp  pointer to all the values in the tile
+*/
+void grid_float_tile::_count_invalid_data(const float* vp)
+{ const size_t n_values { static_cast<size_t>(_n_rows) * _n_columns };
+
+  for (size_t n = 0; n < n_values; ++n)
+    if (vp[n] < (_nodata + 1))
+      _n_invalid_data++;
+
+  if (debug)
+    cout << "Number of invalid data elements = " << comma_separated_string(_n_invalid_data) << " out of " << comma_separated_string(n_values) << endl;
+}
+
+/*! \brief                  Move the data to a different kind of storage
+    \param  new_storage     where to hold the data
+
+    Demotion to MAPPED or DISK releases the memory used by the data. This function MUST NOT
+    be called while another thread is reading from the tile.
+*/
+void grid_float_tile::storage(const TILE_STORAGE new_storage)
+{ if (new_storage == _storage)
+    return;
+
+  switch (new_storage)
+  { case TILE_STORAGE::RAM :
+      if (_storage == TILE_STORAGE::MAPPED)                             // copy from the pages that are already mapped
+      { _data.assign(_mapping.get(), _mapping.get() + static_cast<size_t>(_n_rows) * _n_columns);
+        PROFILER.increment(COUNTER::BYTES_READ, data_bytes());
+      }
+      else
+        _load_into_ram();
+
+      _mapping.reset();
+      _fd.reset();
+      break;
+
+    case TILE_STORAGE::MAPPED :
+      _map();
+      vector<float>().swap(_data);                                      // release the memory
+      _fd.reset();
+      break;
+
+    case TILE_STORAGE::DISK :
+      _open();
+
+      if (_storage == TILE_STORAGE::MAPPED)                             // tell the kernel that it may drop the cached pages
+        ::posix_fadvise(*_fd, 0, 0, POSIX_FADV_DONTNEED);
+
+      _mapping.reset();
+      vector<float>().swap(_data);
+      break;
+  }
+
+  _storage = new_storage;
 }
 
 /*! \brief          The latitude and longitude of the cell with particular indices
@@ -447,7 +628,9 @@ const pair<double, double> grid_float_tile::cell_centre(const pair<int, int>& ip
     to return a valid response.
 */
 const float grid_float_tile::interpolated_value(const double& latitude, const double& longitude) const
-{ const pair<double, double> ll_centre { cell_centre(latitude, longitude) };
+{ PROFILER.increment(COUNTER::INTERPOLATED_VALUE);
+
+  const pair<double, double> ll_centre { cell_centre(latitude, longitude) };
   const QUADRANT             q         { _quadrant(latitude, longitude) };
   
   switch (q)
@@ -717,7 +900,9 @@ in radians)
 lon2: =lon1 + ATAN2(COS(d/R)-SIN(lat1)*SIN(lat2), SIN(brng)*SIN(d/R)*COS(lat1)) 
 */
 const pair<double, double> ll_from_bd(const double& lat1 /* deg */, const double& long1 /* deg */ , const double& bearing_d /* degrees clockwise from north */, const double& distance_m /* metres */)
-{ const double delta   { distance_m / RE };
+{ PROFILER.increment(COUNTER::LL_FROM_BD);
+
+  const double delta   { distance_m / RE };
   const double lat1_r  { lat1 * DTOR };
   const double long1_r { long1 * DTOR };
   const double theta   { bearing_d * DTOR };
@@ -729,6 +914,88 @@ const pair<double, double> ll_from_bd(const double& lat1 /* deg */, const double
   return { lat2_d, long2_d };
 }
 
+/*! \brief          Obtain the bearing and distance of one point from another
+    \param  ll1     latitude and longitude of source, in degrees
+    \param  ll2     latitude and longitude of target, in degrees
+    \return         bearing of target from source, in degrees clockwise from north [0, 360), and distance along the Earth's surface, in metres
+
+    The inverse of ll_from_bd(). The offset of the target is taken as east and north components x = d sin θ, y = d cos θ, starting
+    from a flat-earth estimate; each Newton step evaluates ll_from_bd() at the estimate and 1m east and north of it, so the result
+    is consistent with ll_from_bd() to well under a centimetre at the distances of a plot.
+*/
+const pair<double, double> bd_from_ll(const pair<double, double>& ll1, const pair<double, double>& ll2)
+{ constexpr double h        { 1 };           // step for the derivatives, in metres
+  constexpr int    MAX_ITER { 5 };
+
+  auto forward = [&ll1](const double x, const double y)
+    { return ll_from_bd(ll1, atan2(x, y) * RTOD, sqrt(x * x + y * y)); };
+
+  double x { (ll2.second - ll1.second) * DTOR * RE * cos(ll1.first * DTOR) };     // east, in metres
+  double y { (ll2.first - ll1.first) * DTOR * RE };                              // north, in metres
+
+  for (int n = 0; n < MAX_ITER; ++n)
+  { const pair<double, double> p  { forward(x, y) };
+    const pair<double, double> px { forward(x + h, y) };
+    const pair<double, double> py { forward(x, y + h) };
+
+    const double d_lat  { ll2.first - p.first };
+    const double d_long { ll2.second - p.second };
+    const double lat_x  { (px.first - p.first) / h };
+    const double lat_y  { (py.first - p.first) / h };
+    const double long_x { (px.second - p.second) / h };
+    const double long_y { (py.second - p.second) / h };
+    const double det    { lat_x * long_y - lat_y * long_x };
+
+    if (det == 0)
+      break;
+
+    const double dx { (d_lat * long_y - d_long * lat_y) / det };
+    const double dy { (d_long * lat_x - d_lat * long_x) / det };
+
+    x += dx;
+    y += dy;
+
+    if ( (fabs(dx) + fabs(dy)) < 1e-4 )
+      break;
+  }
+
+  const double b { atan2(x, y) * RTOD };
+
+  return { ( (b < 0) ? b + 360 : b ), sqrt(x * x + y * y) };
+}
+
+/*  \brief          Calculate the elevation above zero degrees of one point as seen from another
+    \param  lat1    latitude of first point
+    \param  long1   longitude of first point
+    \param  lat2    latitude of second point
+    \param  long2   longitude of second point
+    \param  h1      height of first point relative to sphere/geoid
+    \param  h2      height of first point relative to sphere/geoid
+    \return         the elevation of the second point as seen from the first point
+
+   The USGS "elevation" values are referenced to a geoid. Locally, and for the purpose of this
+   calculation, it's sufficient to treat the Earth between the two points as a sphere.
+   
+   Assuming a negative elevation angle (i.e. OD = OB + BD, both +ve)
+   O = centre of Earth
+   RE = radius of Earth
+   A = top of antenna (RE + h1)
+   OD = RE + h2 [== OB] projected on to horizontal plane through A
+   B = top of point 2 (i.e., r + h2)
+   theta = distance along surface between the points / radius of Earth
+*/
+const float elevation_angle(const double& lat1, const double& long1, const double& lat2, const double& long2, const double& h1, const double& h2)
+{ const double d     { distance(lat1, long1, lat2, long2) };
+  const double theta { d / RE };   // radians; annoyoingly, g++ doesn't properly support Unicode in the names of variables
+  const double OD    { (RE + h1) / cos(theta) };
+  const double AD    { (RE + h1) * tan(theta) };
+  const double BD    { OD - (RE + h2) };
+  const double AB    { sqrt(AD * AD + BD * BD - 2 * AD * BD * sin(theta)) };     // cosine rule
+  const double alpha { -asin( (BD * cos(theta)) / AB ) };                     // sine rule; the - sign corrects for above/below horizontal
+  
+  return static_cast<float>(alpha);
+}
+
 /*! \brief              Obtain the bearing (from north) associated with displacement by an amount horizontally and vertically
     \param  delta_x     number and direction of horizontal units
     \param  delta_y     number and direction of vertical units
@@ -6,54 +6,265 @@
 #include "memory.h"
 #include "string_functions.h"
 
+#include <cstdlib>
+#include <cstring>
 #include <string>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace std;
 using namespace   chrono;
 
+/// the names of the fields of /proc/meminfo, in the same order as MEMINFO
+constexpr array<const char*, static_cast<size_t>(MEMINFO::N_FIELDS)> MEMINFO_NAMES { "MemTotal",
+                                                                                     "MemFree",
+                                                                                     "MemAvailable",
+                                                                                     "Buffers",
+                                                                                     "Cached",
+                                                                                     "SwapCached",
+                                                                                     "Active",
+                                                                                     "Inactive",
+                                                                                     "Active(anon)",
+                                                                                     "Inactive(anon)",
+                                                                                     "Active(file)",
+                                                                                     "Inactive(file)",
+                                                                                     "Unevictable",
+                                                                                     "Mlocked",
+                                                                                     "SwapTotal",
+                                                                                     "SwapFree",
+                                                                                     "Dirty",
+                                                                                     "Writeback",
+                                                                                     "AnonPages",
+                                                                                     "Mapped",
+                                                                                     "Shmem",
+                                                                                     "Slab",
+                                                                                     "SReclaimable",
+                                                                                     "SUnreclaim",
+                                                                                     "KernelStack",
+                                                                                     "PageTables",
+                                                                                     "NFS_Unstable",
+                                                                                     "Bounce",
+                                                                                     "WritebackTmp",
+                                                                                     "CommitLimit",
+                                                                                     "Committed_AS",
+                                                                                     "VmallocTotal",
+                                                                                     "VmallocUsed",
+                                                                                     "VmallocChunk",
+                                                                                     "HardwareCorrupted",
+                                                                                     "AnonHugePages",
+                                                                                     "ShmemHugePages",
+                                                                                     "ShmemPmdMapped",
+                                                                                     "HugePages_Total",
+                                                                                     "HugePages_Free",
+                                                                                     "HugePages_Rsvd",
+                                                                                     "HugePages_Surp",
+                                                                                     "Hugepagesize",
+                                                                                     "DirectMap4k",
+                                                                                     "DirectMap2M"
+                                                                                   };
+
+constexpr uint64_t BYTES_PER_KB     { 1024 };     // https://unix.stackexchange.com/questions/263881/convert-meminfo-kb-to-bytes
+constexpr size_t   PROC_BUFFER_SIZE { 8192 };     // big enough for /proc/meminfo, /proc/self/status and memory.stat
+
+/*! \brief              Read a small file (such as one in /proc or /sys) into a buffer, without allocating memory
+    \param  filename    name of the file
+    \param  buf         buffer into which the file is read
+    \param  buf_size    size of <i>buf</i>
+    \return             whether the file was read
+
+    The contents of <i>buf</i> are terminated with a null. Anything that does not fit in <i>buf</i> is ignored.
+    Files in /proc report a length of zero, so the file is simply read until EOF.
+*/
+static const bool read_small_file(const char* filename, char* buf, const size_t buf_size)
+{ const int fd { ::open(filename, O_RDONLY | O_CLOEXEC) };
+
+  if (fd < 0)
+  { buf[0] = '\0';
+    return false;
+  }
+
+  size_t n_read { 0 };
+
+  while (n_read < buf_size - 1)
+  { const ssize_t status { ::read(fd, buf + n_read, buf_size - 1 - n_read) };
+
+    if (status <= 0)
+      break;
+
+    n_read += status;
+  }
+
+  ::close(fd);
+  buf[n_read] = '\0';
+
+  return true;
+}
+
+/*! \brief          Parse an unsigned integer, skipping leading blanks
+    \param  cp      pointer to the start of the text; on exit, points to the first character after the integer
+    \return         the value of the integer; zero if there are no digits
+*/
+static const uint64_t parse_uint(const char*& cp)
+{ while ( (*cp == ' ') or (*cp == '\t') )
+    cp++;
+
+  uint64_t rv { 0 };
+
+  while ( (*cp >= '0') and (*cp <= '9') )
+    rv = rv * 10 + (*cp++ - '0');
+
+  return rv;
+}
+
+/*! \brief          Move to the start of the next line
+    \param  cp      pointer into a null-terminated buffer
+    \return         pointer to the character after the next LF; or to the terminating null
+*/
+static const char* next_line(const char* cp)
+{ while ( (*cp != '\0') and (*cp != '\n') )
+    cp++;
+
+  return (*cp == '\n' ? cp + 1 : cp);
+}
+
+/*! \brief              Read an unsigned value from a cgroup file that contains a single number or "max"
+    \param  filename    name of the file
+    \param  if_max      value to return if the file contains "max"
+    \return             the value in the file; <i>if_max</i> if the file cannot be read
+*/
+static const uint64_t read_cgroup_value(const char* filename, const uint64_t if_max)
+{ char buf[64];
+
+  if (!read_small_file(filename, buf, sizeof(buf)) or (strncmp(buf, "max", 3) == 0))
+    return if_max;
+
+  const char* cp { buf };
+
+  return parse_uint(cp);
+}
+
 // -----------  memory_information ----------------
 
 /*! \class  memory_information
     \brief  Obtain and make available memory information
 */
 
-/*! \brief          Possibly read /proc/meminfo
-    \param  force   whether to force reading of /proc/meminfo regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+/*! \brief          Possibly read /proc/meminfo and the cgroup memory files
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+
+    Does not allocate memory
 */
 void memory_information::_get_meminfo(const bool force)
-{ constexpr uint64_t BYTES_PER_KB { 1024 };             // https://unix.stackexchange.com/questions/263881/convert-meminfo-kb-to-bytes
+{ const system_clock::time_point now { system_clock::now() };
+
+  lock_guard<mutex> memory_lock(_memory_mutex);
 
-  const system_clock::time_point now { system_clock::now() };
+  if ( !force and ( (now - _last_update_time) <= _minimum_interval) )      // update only if forced or if enough time has passed
+    return;
 
-  if ( force or ( (now - _last_update_time) >  _minimum_interval) )      // update only if forced or if enough time has passed
-  { const vector<string> file_lines { to_lines(squash(read_file("/proc/meminfo"s))) };
+  _last_update_time = now;                                // update the time of last update
 
-    _last_update_time = now;                                // update the time of last update
+  char buf[PROC_BUFFER_SIZE];
 
-    lock_guard<mutex> memory_lock(_memory_mutex);
+  if (!read_small_file("/proc/meminfo", buf, sizeof(buf)))
+  { cerr << "Fatal error in memory_information::_get_meminfo(void): cannot read /proc/meminfo" << endl;
+    exit(-1);
+  }
 
-    for (const auto& line : file_lines)
-    { const vector<string> fields { split_string(line, SPACE_STR) };
+// each line is "name: value [kB]"; the kernel lists the fields in a fixed order, so try the field after the last match first
+  size_t next_field { 0 };
 
-      if ( (fields.size() < 2) or (fields.size() > 3) )
-      { cerr << "Fatal error in memory_information::_get_meminfo(void)" << endl;
-        exit(-1);
-      }
+  for (const char* line = buf; *line != '\0'; line = next_line(line))
+  { const char* colon { strchr(line, ':') };
+
+    if (!colon)
+      break;
 
-      const string   name  { substring(fields[0], 0, fields[0].length() - 1) };    // remove the terminating colon
-      const string   unit  { (fields.size() == 3) ? fields[2] : string() };
+    const size_t name_length { static_cast<size_t>(colon - line) };
 
-      if (!unit.empty() and unit != "kB"s)
-      { cerr << "Fatal unit error in memory_information::_get_meminfo(void)" << endl;
-        exit(-1);
+    auto matches = [=](const size_t n)
+      { return (strncmp(line, MEMINFO_NAMES[n], name_length) == 0) and (MEMINFO_NAMES[n][name_length] == '\0'); };
+
+    size_t field { MEMINFO_NAMES.size() };
+
+    if ( (next_field < MEMINFO_NAMES.size()) and matches(next_field) )
+      field = next_field;
+    else
+    { for (size_t n = 0; n < MEMINFO_NAMES.size(); ++n)
+        if (matches(n))
+          field = n;
+    }
+
+    if (field == MEMINFO_NAMES.size())            // a field that we don't know about
+      continue;
+
+    const char* cp    { colon + 1 };
+    uint64_t    value { parse_uint(cp) };
+
+    if (strncmp(cp, " kB", 3) == 0)
+      value *= BYTES_PER_KB;
+
+    _values[field] = value;
+    next_field = field + 1;
+  }
+
+// the cgroup, if there is one
+  if (!_cgroup_max_filename.empty())
+  { _cgroup_max = read_cgroup_value(_cgroup_max_filename.c_str(), CGROUP_NO_LIMIT);
+    _cgroup_current = read_cgroup_value(_cgroup_current_filename.c_str(), 0);
+    _cgroup_inactive_file = 0;
+
+    if (read_small_file(_cgroup_stat_filename.c_str(), buf, sizeof(buf)))
+    { for (const char* line = buf; *line != '\0'; line = next_line(line))
+      { if (strncmp(line, "inactive_file ", 14) == 0)
+        { const char* cp { line + 14 };
+
+          _cgroup_inactive_file = parse_uint(cp);
+          break;
+        }
       }
+    }
+  }
+}
+
+/// locate the cgroup (v2) memory files for this process
+void memory_information::_find_cgroup(void)
+{ char buf[PROC_BUFFER_SIZE];
+
+  if (!read_small_file("/proc/self/cgroup", buf, sizeof(buf)))
+    return;
+
+// the v2 hierarchy is the line "0::<path>"
+  for (const char* line = buf; *line != '\0'; line = next_line(line))
+  { if (strncmp(line, "0::", 3) == 0)
+    { const char* end { line + 3 };
+
+      while ( (*end != '\0') and (*end != '\n') )
+        end++;
+
+      string path(line + 3, end);
+
+      if (path == "/"s)
+        path.clear();
 
-      uint64_t value { from_string<uint64_t>(fields[1]) };
+// the v2 hierarchy is normally mounted on /sys/fs/cgroup, or on /sys/fs/cgroup/unified on hybrid systems
+      for (const string& mount_point : { "/sys/fs/cgroup"s, "/sys/fs/cgroup/unified"s })
+      { const string directory { mount_point + path + "/"s };
 
-      if (!unit.empty())
-        value *= BYTES_PER_KB;
+        if (::access((directory + "memory.max"s).c_str(), R_OK) == 0)    // the root cgroup has no memory.max
+        { _cgroup_max_filename = directory + "memory.max"s;
+          _cgroup_current_filename = directory + "memory.current"s;
+          _cgroup_stat_filename = directory + "memory.stat"s;
 
-      _values[name] = value;        // creates if necessary
+          if (::access((directory + "memory.pressure"s).c_str(), R_OK) == 0)
+            _pressure_filename = directory + "memory.pressure"s;
+
+          return;
+        }
+      }
+
+      return;
     }
   }
 }
@@ -64,7 +275,97 @@ void memory_information::_get_meminfo(const bool force)
 memory_information::memory_information(const std::chrono::system_clock::duration min_int) :
   _minimum_interval(min_int),
   _last_update_time { std::chrono::system_clock::now() - 2 * _minimum_interval }        // force update when _get_meminfo() is called
-{ _get_meminfo(); }
+{ _find_cgroup();
+
+  if (_pressure_filename.empty() and (::access("/proc/pressure/memory", R_OK) == 0))
+    _pressure_filename = "/proc/pressure/memory"s;
+
+  _get_meminfo();
+}
+
+/*! \brief          Get the memory limit of this process's cgroup
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+    \return         memory.max, in bytes; CGROUP_NO_LIMIT if there is no limit
+*/
+const uint64_t memory_information::cgroup_max(const bool force)
+{ _get_meminfo(force);
+
+  lock_guard<mutex> memory_lock(_memory_mutex);
+
+  return _cgroup_max;
+}
+
+/*! \brief          Get the memory charged to this process's cgroup
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+    \return         memory.current, in bytes; zero if there is no cgroup
+*/
+const uint64_t memory_information::cgroup_current(const bool force)
+{ _get_meminfo(force);
+
+  lock_guard<mutex> memory_lock(_memory_mutex);
+
+  return _cgroup_current;
+}
+
+/*! \brief          Get the memory that this process may still use without causing swapping or an OOM kill
+    \param  force   whether to force reading regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
+    \return         the available memory, in bytes
+
+    The lesser of MemAvailable and the headroom within the cgroup limit (which counts inactive page cache as reclaimable)
+*/
+const uint64_t memory_information::available(const bool force)
+{ _get_meminfo(force);
+
+  lock_guard<mutex> memory_lock(_memory_mutex);
+
+  const uint64_t system_available { _values[static_cast<size_t>(MEMINFO::MEM_AVAILABLE)] };
+
+  if (_cgroup_max == CGROUP_NO_LIMIT)
+    return system_available;
+
+  const uint64_t used_unreclaimable { (_cgroup_current > _cgroup_inactive_file) ? _cgroup_current - _cgroup_inactive_file : 0 };
+  const uint64_t cgroup_available   { (_cgroup_max > used_unreclaimable) ? _cgroup_max - used_unreclaimable : 0 };
+
+  return min(system_available, cgroup_available);
+}
+
+/*! \brief      Get the current memory pressure
+    \return     the "some avg10" value from the PSI file, in per cent; -1 if PSI is not available
+
+    This is the percentage of the last ten seconds during which at least one task was stalled waiting for memory.
+    The cgroup's memory.pressure is used if the process is in a cgroup (v2); otherwise /proc/pressure/memory.
+    Does not allocate memory.
+*/
+const double memory_information::memory_pressure(void) const
+{ char buf[256];                                // "some avg10=0.00 avg60=0.00 avg300=0.00 total=0" and a similar "full" line
+
+  if (_pressure_filename.empty() or !read_small_file(_pressure_filename.c_str(), buf, sizeof(buf)) or (strncmp(buf, "some avg10=", 11) != 0))
+    return -1;
+
+  return strtod(buf + 11, nullptr);
+}
+
+/*! \brief      Get the peak resident set size of this process
+    \return     VmHWM from /proc/self/status, in bytes
+
+    Returns zero if the value cannot be determined
+*/
+const uint64_t memory_information::peak_rss(void) const
+{ char buf[PROC_BUFFER_SIZE];
+
+  if (!read_small_file("/proc/self/status", buf, sizeof(buf)))
+    return 0;
+
+  for (const char* line = buf; *line != '\0'; line = next_line(line))
+  { if (strncmp(line, "VmHWM:", 6) == 0)
+    { const char* cp { line + 6 };
+
+      return parse_uint(cp) * BYTES_PER_KB;
+    }
+  }
+
+  return 0;
+}
 
 /*! \brief          Convert to printable string
     \param  force   whether to force reading of /proc/meminfo regardless of <i>_last_update_time</i> and <i>_minimum_interval</i>
@@ -117,7 +418,10 @@ const string memory_information::to_string(const bool force)
                     + "HugePages_Surp    = "s + comma_separated_string(huge_pages_surp()) + EOL
                     + "Hugepagesize      = "s + comma_separated_string(hugepagesize()) + EOL
                     + "DirectMap4k       = "s + comma_separated_string(direct_map_4k()) + EOL
-                    + "DirectMap2M       = "s + comma_separated_string(direct_map_2m());
+                    + "DirectMap2M       = "s + comma_separated_string(direct_map_2m())
+                    + (cgroup_limited() ? EOL + "cgroup max        = "s + comma_separated_string(cgroup_max()) + EOL
+                                              + "cgroup current    = "s + comma_separated_string(cgroup_current()) : string())
+                    + EOL + "Available to us   = "s + comma_separated_string(available());
 
   return rv;
 }
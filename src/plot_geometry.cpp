@@ -0,0 +1,87 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   plot_geometry.cpp
+
+    The bearing and distance from the QTH of every cell of a plot, computed once per plot
+*/
+
+#include "plot_geometry.h"
+
+using namespace std;
+
+/*! \brief                          Calculate the geometry of a cell directly
+    \param  delta_x                 number of cells east of the QTH
+    \param  delta_y                 number of cells north of the QTH
+    \param  distance_per_square     size of a cell, in metres
+    \return                         the geometry of the cell [delta_y][delta_x]
+*/
+const cell_geometry direct_cell_geometry(const int delta_x, const int delta_y, const float distance_per_square)
+{ const double distance_to_square { sqrt(1.0 * delta_x * delta_x + 1.0 * delta_y * delta_y) * distance_per_square };    // along curved surface
+
+  return { bearing(delta_x, delta_y), distance_to_square, cos(distance_to_square / RE), curvature_correction(distance_to_square) };
+}
+
+// -----------  plot_geometry ----------------
+
+/*! \class  plot_geometry
+    \brief  The geometry of every cell of a plot
+*/
+
+/*! \brief                          Constructor
+    \param  n_cells                 number of cells from the centre to the edge of the plot
+    \param  distance_per_square     size of a cell, in metres
+*/
+plot_geometry::plot_geometry(const int n_cells, const float distance_per_square) :
+  _n_cells(n_cells)
+{ _entries.resize(_index(n_cells, n_cells) + 1);
+
+  for (int major = 0; major <= n_cells; ++major)
+  { for (int minor = 0; minor <= major; ++minor)
+    { const double distance_to_square { sqrt(1.0 * major * major + 1.0 * minor * minor) * distance_per_square };    // along curved surface
+
+      octant_entry& entry { _entries[_index(major, minor)] };
+
+// the angle is calculated in the same way as in bearing(), so that the results are identical
+      entry.base_angle = (major ? atan(static_cast<float>(minor) / static_cast<float>(major)) * RTOD : 0);
+      entry.distance = distance_to_square;
+      entry.cos_factor = cos(distance_to_square / RE);
+      entry.correction = curvature_correction(distance_to_square);
+    }
+  }
+}
+
+/*! \brief              The geometry of a cell
+    \param  delta_x     number of cells east of the QTH
+    \param  delta_y     number of cells north of the QTH
+    \return             the geometry of the cell [delta_y][delta_x]
+
+    Performs no bounds checking. The reflections follow the branches of bearing().
+*/
+const cell_geometry plot_geometry::operator()(const int delta_x, const int delta_y) const
+{ const int           ax    { abs(delta_x) };
+  const int           ay    { abs(delta_y) };
+  const octant_entry& entry { _entries[ (ax >= ay) ? _index(ax, ay) : _index(ay, ax) ] };
+  const double&       t     { entry.base_angle };
+
+  double bearing_from_north;
+
+  if (delta_x == 0)
+    bearing_from_north = ( (delta_y >= 0) ? 0 : 180 );
+  else
+  { if (delta_y == 0)
+      bearing_from_north = ( (delta_x < 0) ? 270 : 90 );
+    else
+    { if (delta_x > 0)
+        bearing_from_north = ( (delta_y > 0) ? ( (ay > ax) ? t : 90 - t ) : ( (ax > ay) ? 90 + t : 180 - t ) );
+      else
+        bearing_from_north = ( (delta_y < 0) ? ( (ax < ay) ? 180 + t : 270 - t ) : ( (ax > ay) ? 270 + t : 360 - t ) );
+    }
+  }
+
+  return { bearing_from_north, entry.distance, entry.cos_factor, entry.correction };
+}
@@ -0,0 +1,451 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   polar.cpp
+
+    Calculation of the fields for a plot on a grid of bearing × range, with one sweep along each bearing
+*/
+
+#include "polar.h"
+#include "trace.h"
+
+#include <cmath>
+#include <future>
+#include <limits>
+#include <mutex>
+
+using namespace std;
+
+static mutex statistics_mutex;          ///< mutex for merging the statistics of the threads
+
+/*! \brief              Interpolate between the values at four samples
+    \param  v00         value at the lower bearing and lower range
+    \param  v01         value at the lower bearing and higher range
+    \param  v10         value at the higher bearing and lower range
+    \param  v11         value at the higher bearing and higher range
+    \param  wb          weight of the higher bearing (0 to 1)
+    \param  wr          weight of the higher range (0 to 1)
+    \return             the interpolated value
+
+    If any of the values is NODATA, returns the value of the nearest sample
+*/
+static inline const float bilinear(const float v00, const float v01, const float v10, const float v11, const double wb, const double wr)
+{ if ( (v00 > -9000) and (v01 > -9000) and (v10 > -9000) and (v11 > -9000) )
+    return static_cast<float>( (1 - wb) * ( (1 - wr) * v00 + wr * v01 ) + wb * ( (1 - wr) * v10 + wr * v11 ) );
+
+  return ( (wb < 0.5) ? ( (wr < 0.5) ? v00 : v01 ) : ( (wr < 0.5) ? v10 : v11 ) );
+}
+
+/*! \brief      The loss due to a single knife edge
+    \param  v   the Fresnel-Kirchhoff diffraction parameter of the edge
+    \return     the loss, in dB
+
+    The approximation in ITU-R P.526
+*/
+static inline const float knife_edge_loss(const double v)
+{ return ( (v > -0.78) ? static_cast<float>(6.9 + 20 * log10( sqrt( (v - 0.1) * (v - 0.1) + 1) + v - 0.1 )) : 0.0f );
+}
+
+// -----------  polar_field ----------------
+
+/*! \class  polar_field
+    \brief  The terrain along evenly spaced bearings from the QTH, sampled at evenly spaced ranges
+*/
+
+/*! \brief                  Constructor
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+
+    The bearings are spaced so that adjacent samples at the corners of the plot are no more than one cell apart, and the
+    ranges are spaced one cell apart. The Fresnel-clearance ratios are calculated only if <i>req.fresnel_frequency</i> is
+    non-zero, and the diffraction losses only if <i>req.diffraction</i> is also true.
+*/
+polar_field::polar_field(const tile_map& tiles, const field_request& req, const unsigned int n_threads) :
+  _range_step(req.distance_per_square)
+{ const double max_distance { sqrt(2.0) * req.n_cells * req.distance_per_square };        // to the corners of the plot
+
+  _n_ranges = static_cast<int>(ceil(max_distance / _range_step)) + 2;                    // range zero, and one beyond the corners for interpolation
+  _n_bearings = max(static_cast<int>(ceil(2 * PI * max_distance / req.distance_per_square)), 4);
+
+  const size_t n_samples { static_cast<size_t>(_n_bearings) * _n_ranges };
+
+  _height.resize(n_samples);
+  _angle.resize(n_samples);
+  _visible.resize(n_samples);
+
+  if (req.fresnel_frequency > 0)
+  { _clearance.resize(n_samples);
+
+    if (req.diffraction)
+      _loss.resize(n_samples);
+  }
+
+  auto sweep_bearings = [&](const int start)
+    { for (int bearing_nr = start; bearing_nr < _n_bearings; bearing_nr += static_cast<int>(n_threads))
+      { _sweep(tiles, req, bearing_nr);
+
+        if (!_clearance.empty())
+          _clear(req, bearing_nr);
+
+        if (!_loss.empty())
+          _diffract(req, bearing_nr);
+      }
+    };
+
+  vector<future<void>> vec_futures;
+
+  for (int start = 0; start < static_cast<int>(n_threads); ++start)
+    vec_futures.emplace_back(async(launch::async, sweep_bearings, start));
+
+  for (auto& this_future : vec_futures)
+    this_future.get();                                  // .get() blocks until the future is available
+}
+
+/*! \brief                  Sweep along one bearing
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot
+    \param  bearing_nr      the number of the bearing
+
+    A sample is visible if its elevation angle is greater than that of every sample nearer to the QTH
+*/
+void polar_field::_sweep(const tile_map& tiles, const field_request& req, const int bearing_nr)
+{ const trace_scope bearing_trace("polar sweep", "bearing", bearing_nr);
+
+  const double bearing_from_north { (bearing_nr * 360.0) / _n_bearings };
+  const double eye                { req.raw_qth_height + req.antenna_height };
+
+  float max_angle { numeric_limits<float>::lowest() };           // the highest angle nearer to the QTH, in radians
+
+  _height[_index(bearing_nr, 0)] = req.raw_qth_height;
+  _angle[_index(bearing_nr, 0)] = elevation_angle(req.qth, req.qth, eye, req.raw_qth_height) * RTOD;
+  _visible[_index(bearing_nr, 0)] = 1;
+
+  for (int range_nr = 1; range_nr < _n_ranges; ++range_nr)
+  { const size_t               index    { _index(bearing_nr, range_nr) };
+    const double               distance { range_nr * _range_step };                       // along curved surface
+    const pair<double, double> ll       { ll_from_bd(req.qth, bearing_from_north, distance) };
+
+    float raw_value { -9999 };        // default value is NODATA
+
+    try
+    { raw_value = tiles.at(llc(ll)).interpolated_value(ll);                 // height per USGS
+    }
+
+    catch (...)                       // NODATA, or outside the tiles
+    { }
+
+    const float angle { elevation_angle(req.qth, ll, eye, raw_value) };
+
+    _height[index] = ( (raw_value > -9000) ? static_cast<float>(raw_value * cos(distance / RE) - curvature_correction(distance)) : -9999 );
+    _angle[index] = ( (raw_value > -9000) ? angle * static_cast<float>(RTOD) : -9999 );
+    _visible[index] = (angle > max_angle);
+
+    max_angle = max(max_angle, angle);
+  }
+}
+
+/*! \brief                  Calculate the Fresnel-clearance ratios along one bearing, once its heights are known
+    \param  req             the parameters of the plot
+    \param  bearing_nr      the number of the bearing
+
+    The heights are already corrected for curvature, so the path from the antenna to each sample is a straight line in
+    (distance, height). For an obstacle n ranges along a path of j ranges, the radius of the first Fresnel zone is
+    sqrt(wavelength * step * n * (j - n) / j), so the ratio is the clearance times 1/sqrt(n) times 1/sqrt(j - n), scaled by
+    sqrt(j / (wavelength * step)); the inner loop therefore needs only multiplications. This uses only the heights of the
+    samples, so costs no more terrain lookups than the sweep itself.
+*/
+void polar_field::_clear(const field_request& req, const int bearing_nr)
+{ const trace_scope bearing_trace("fresnel clearance", "bearing", bearing_nr);
+
+  const float  eye        { static_cast<float>(req.raw_qth_height + req.antenna_height) };
+  const double wavelength { SPEED_OF_LIGHT / req.fresnel_frequency };
+  const size_t base       { _index(bearing_nr, 0) };
+
+  vector<float> inv_root(_n_ranges);            // 1 / sqrt(k)
+  vector<float> eye_above(_n_ranges);           // height of the antenna above each sample
+
+  for (int k = 1; k < _n_ranges; ++k)
+  { const float h { _height[base + k] };
+
+    inv_root[k] = static_cast<float>(1 / sqrt(k));
+    eye_above[k] = ( (h > -9000) ? (eye - h) : numeric_limits<float>::max() / 4 );     // NODATA never limits the clearance
+  }
+
+  _clearance[base] = MAX_CLEARANCE_RATIO;
+
+  for (int range_nr = 1; range_nr < _n_ranges; ++range_nr)
+  { const float target_height { _height[base + range_nr] };
+
+    if (target_height <= -9000)
+    { _clearance[base + range_nr] = -9999;
+      continue;
+    }
+
+    const float slope { (target_height + req.fresnel_rx_height - eye) / range_nr };      // change in height of the path per range
+    const float scale { static_cast<float>(sqrt(range_nr / (wavelength * _range_step))) };
+
+    float min_ratio { MAX_CLEARANCE_RATIO / scale };
+
+    for (int n = 1; n < range_nr; ++n)
+      min_ratio = min(min_ratio, (eye_above[n] + slope * n) * inv_root[n] * inv_root[range_nr - n]);
+
+    _clearance[base + range_nr] = max(min_ratio * scale, -MAX_CLEARANCE_RATIO);
+  }
+}
+
+/*! \brief                  Calculate the diffraction losses along one bearing, once its Fresnel-clearance ratios are known
+    \param  req             the parameters of the plot
+    \param  bearing_nr      the number of the bearing
+
+    The string from the antenna to the receiving antenna above a sample follows the upper convex hull of the antenna and the
+    terrain nearer than the sample, as far as the point at which a line from the receiving antenna is tangent to the hull. The
+    hull is extended by one sample as each sample is passed, and the tangent point is found by binary search, so the path to every
+    sample along the bearing is evaluated without walking it again; only the edges along the string are examined.
+*/
+void polar_field::_diffract(const field_request& req, const int bearing_nr)
+{ const trace_scope bearing_trace("diffraction", "bearing", bearing_nr);
+
+  const float  eye        { static_cast<float>(req.raw_qth_height + req.antenna_height) };
+  const double wavelength { SPEED_OF_LIGHT / req.fresnel_frequency };
+  const size_t base       { _index(bearing_nr, 0) };
+
+  auto height = [&](const int range_nr)                 // range zero is the antenna
+    { return (range_nr ? _height[base + range_nr] : eye); };
+
+// is the point (x3, y3) on or above the line through (x1, y1) and (x2, y2)? x1 < x2 < x3
+  auto on_or_above = [](const double x1, const double y1, const double x2, const double y2, const double x3, const double y3)
+    { return ( (y2 - y1) * (x3 - x1) <= (y3 - y1) * (x2 - x1) ); };
+
+  vector<int> hull { 0 };                               // range numbers of the vertices of the upper hull, from the antenna outwards
+
+  _loss[base] = 0;
+
+  for (int range_nr = 1; range_nr < _n_ranges; ++range_nr)
+  { const float target_height { _height[base + range_nr] };
+
+    if (target_height <= -9000)
+    { _loss[base + range_nr] = -9999;
+      continue;
+    }
+
+    const float rx { target_height + req.fresnel_rx_height };
+
+// find the tangent point: the first vertex at which the receiving antenna is on or above the extension of the next edge of the hull
+    int lo { 0 };
+    int hi { static_cast<int>(hull.size()) - 1 };
+
+    while (lo < hi)
+    { const int mid { (lo + hi) / 2 };
+
+      if (on_or_above(hull[mid], height(hull[mid]), hull[mid + 1], height(hull[mid + 1]), range_nr, rx))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+    if (lo == 0)                                        // the string touches no terrain
+      _loss[base + range_nr] = knife_edge_loss(-sqrt(2.0) * _clearance[base + range_nr]);
+    else                                                // Deygout, over the edges hull[1] ... hull[lo]
+    { auto end_height = [&](const int range) { return ( (range == range_nr) ? static_cast<double>(rx) : height(range) ); };
+
+// the largest diffraction parameter of the edges hull[first] ... hull[last], relative to the line from <i>from</i> to <i>to</i>; the
+// number in the hull of the edge is written to <i>worst</i>
+      auto worst_edge = [&](const int first, const int last, const int from, const int to, int& worst)
+        { double rv { numeric_limits<double>::lowest() };
+
+          for (int n = first; n <= last; ++n)
+          { const int    edge { hull[n] };
+            const double d1   { (edge - from) * _range_step };
+            const double d2   { (to - edge) * _range_step };
+            const double h    { height(edge) - ( end_height(from) + (end_height(to) - end_height(from)) * d1 / (d1 + d2) ) };
+            const double v    { h * sqrt( (2 * (d1 + d2)) / (wavelength * d1 * d2) ) };
+
+            if (v > rv)
+            { rv = v;
+              worst = n;
+            }
+          }
+
+          return rv;
+        };
+
+      int principal { 1 };                              // number in the hull of the principal edge
+      int unused    { 0 };
+
+      float loss { knife_edge_loss(worst_edge(1, lo, 0, range_nr, principal)) };
+
+      if (principal > 1)
+        loss += knife_edge_loss(worst_edge(1, principal - 1, 0, hull[principal], unused));
+
+      if (principal < lo)
+        loss += knife_edge_loss(worst_edge(principal + 1, lo, hull[principal], range_nr, unused));
+
+      _loss[base + range_nr] = loss;
+    }
+
+// add this sample to the hull
+    while ( (hull.size() >= 2) and on_or_above(hull[hull.size() - 2], height(hull[hull.size() - 2]), hull.back(), height(hull.back()), range_nr, target_height) )
+      hull.pop_back();
+
+    hull.push_back(range_nr);
+  }
+}
+
+/*! \brief                  Fill the Cartesian fields of a plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields to fill
+    \param  geometry        the geometry of the cells
+
+    Heights, angles, gradients, Fresnel-clearance ratios and diffraction losses are interpolated between the four surrounding samples;
+    visibility is taken from the nearest sample
+*/
+void polar_field::reproject(const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry& geometry) const
+{ const double bearing_step { 360.0 / _n_bearings };
+
+// the radial gradient at a sample; -9999 if either neighbour is NODATA
+  auto gradient = [&](const int bearing_nr, const int range_nr)
+    { const int   range_lo { max(range_nr - 1, 1) };                       // range zero is the QTH, whose height is not on this bearing's slope
+      const int   range_hi { min(range_nr + 1, _n_ranges - 1) };
+      const float h_lo     { _height[_index(bearing_nr, range_lo)] };
+      const float h_hi     { _height[_index(bearing_nr, range_hi)] };
+
+      return ( ( (h_lo > -9000) and (h_hi > -9000) ) ? static_cast<float>( (h_hi - h_lo) / ((range_hi - range_lo) * _range_step) ) : -9999.0f );
+    };
+
+  auto reproject_rows = [&](const int start)
+    { field_statistics stats;
+
+      for (int delta_y = -req.n_cells + start; delta_y <= req.n_cells; delta_y += static_cast<int>(n_threads))
+      { for (int delta_x = -req.n_cells; delta_x <= req.n_cells; ++delta_x)
+        { const int           row_index    { delta_y + req.n_cells };
+          const int           column_index { delta_x + req.n_cells };
+          const cell_geometry cell         { geometry(delta_x, delta_y) };
+          const double        fb           { cell.bearing / bearing_step };
+          const double        fr           { cell.distance / _range_step };
+          const int           b0           { static_cast<int>(fb) };
+          const int           r0           { min(static_cast<int>(fr), _n_ranges - 2) };
+          const double        wb           { fb - b0 };
+          const double        wr           { fr - r0 };
+          const bool          is_qth       { (delta_x == 0) and (delta_y == 0) };
+
+          auto interpolate = [&](const vector<float>& v)
+            { return bilinear(v[_index(b0, r0)], v[_index(b0, r0 + 1)], v[_index(b0 + 1, r0)], v[_index(b0 + 1, r0 + 1)], wb, wr); };
+
+          const float terrain_height { interpolate(_height) };
+
+          fields.height[row_index][column_index] = terrain_height + ( (is_qth and (terrain_height > -9000)) ? req.antenna_height : 0 );
+          stats.add_height(fields.height[row_index][column_index]);
+
+          if ( (terrain_height > -9000) and (cell.distance <= req.distance_scale) )     // accumulate for calculation of MHAT
+            stats.add_terrain_height(terrain_height, cell.distance, req.mhat_bin_width);
+
+          if (req.elev)
+            fields.angle[row_index][column_index] = interpolate(_angle);
+
+          if (req.grad)
+          { fields.grad[row_index][column_index] = ( is_qth ? 0 : bilinear(gradient(b0, r0), gradient(b0, r0 + 1), gradient(b0 + 1, r0), gradient(b0 + 1, r0 + 1), wb, wr) );
+            stats.add_grad(fields.grad[row_index][column_index]);
+          }
+
+          if (req.los)
+          { const int bearing_nr { static_cast<int>(lround(fb)) };
+            const int range_nr   { min(static_cast<int>(lround(fr)), _n_ranges - 1) };
+
+            fields.los[row_index][column_index] = ( (is_qth or _visible[_index(bearing_nr, range_nr)]) ? VISIBILITY::VISIBLE : VISIBILITY::NOT_VISIBLE );
+          }
+
+          if (!_clearance.empty())
+            fields.fresnel[row_index][column_index] = ( is_qth ? MAX_CLEARANCE_RATIO : interpolate(_clearance) );
+
+          if (!_loss.empty())
+            fields.diffraction[row_index][column_index] = ( is_qth ? 0 : interpolate(_loss) );
+        }
+      }
+
+      lock_guard<mutex> statistics_lock(statistics_mutex);
+
+      fields.stats.merge(stats);
+    };
+
+  vector<future<void>> vec_futures;
+
+  for (int start = 0; start < static_cast<int>(n_threads); ++start)
+    vec_futures.emplace_back(async(launch::async, reproject_rows, start));
+
+  for (auto& this_future : vec_futures)
+    this_future.get();                                  // .get() blocks until the future is available
+}
+
+/*! \brief                  Fill only the Fresnel-clearance and diffraction fields of a plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields; only <i>fields.fresnel</i> and <i>fields.diffraction</i> are changed
+    \param  geometry        the geometry of the cells
+*/
+void polar_field::reproject_radio_fields(const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry& geometry) const
+{ const double bearing_step { 360.0 / _n_bearings };
+
+  auto reproject_rows = [&](const int start)
+    { for (int delta_y = -req.n_cells + start; delta_y <= req.n_cells; delta_y += static_cast<int>(n_threads))
+      { for (int delta_x = -req.n_cells; delta_x <= req.n_cells; ++delta_x)
+        { const int           row_index    { delta_y + req.n_cells };
+          const int           column_index { delta_x + req.n_cells };
+          const cell_geometry cell         { geometry(delta_x, delta_y) };
+          const double        fb           { cell.bearing / bearing_step };
+          const double        fr           { cell.distance / _range_step };
+          const int           b0           { static_cast<int>(fb) };
+          const int           r0           { min(static_cast<int>(fr), _n_ranges - 2) };
+          const bool          is_qth       { (delta_x == 0) and (delta_y == 0) };
+
+          auto interpolate = [&](const vector<float>& v)
+            { return bilinear(v[_index(b0, r0)], v[_index(b0, r0 + 1)], v[_index(b0 + 1, r0)], v[_index(b0 + 1, r0 + 1)], fb - b0, fr - r0); };
+
+          if (!_clearance.empty())
+            fields.fresnel[row_index][column_index] = ( is_qth ? MAX_CLEARANCE_RATIO : interpolate(_clearance) );
+
+          if (!_loss.empty())
+            fields.diffraction[row_index][column_index] = ( is_qth ? 0 : interpolate(_loss) );
+        }
+      }
+    };
+
+  vector<future<void>> vec_futures;
+
+  for (int start = 0; start < static_cast<int>(n_threads); ++start)
+    vec_futures.emplace_back(async(launch::async, reproject_rows, start));
+
+  for (auto& this_future : vec_futures)
+    this_future.get();                                  // .get() blocks until the future is available
+}
+
+/*! \brief                  Populate all the fields of a plot on a polar grid, and reproject them to the Cartesian fields
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields to populate
+    \param  geometry        the geometry of the cells
+*/
+void calculate_polar_fields(const tile_map& tiles, const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry& geometry)
+{ const polar_field polar(tiles, req, n_threads);
+
+  polar.reproject(req, n_threads, fields, geometry);
+}
+
+/*! \brief                  Populate the Fresnel-clearance and diffraction fields of a plot whose other fields are calculated cell by cell
+    \param  tiles           the tiles that contain the plot
+    \param  req             the parameters of the plot; <i>req.fresnel_frequency</i> must be non-zero
+    \param  n_threads       the number of threads to use
+    \param  fields          the fields; only <i>fields.fresnel</i> and <i>fields.diffraction</i> are changed
+    \param  geometry        the geometry of the cells
+*/
+void calculate_radio_fields(const tile_map& tiles, const field_request& req, const unsigned int n_threads, field_set& fields, const plot_geometry& geometry)
+{ const polar_field polar(tiles, req, n_threads);
+
+  polar.reproject_radio_fields(req, n_threads, fields, geometry);
+}
@@ -0,0 +1,100 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   profile.cpp
+
+    Phase-level timing and event counters
+*/
+
+#include "profile.h"
+
+using namespace std;
+
+phase_profiler PROFILER;                 ///< the profiler for the program
+
+/// names of the phases, as written to the JSON summary and to traces
+static const array<const char*, static_cast<size_t>(PHASE::N_PHASES)> PHASE_NAMES { "r_startup", "tile_needs", "download", "unzip", "load",
+                                                                                   "populate_fields", "horizon", "site_search", "coverage", "radio_fields",
+                                                                                   "terrain_profiles", "render_height", "render_los", "render_elev",
+                                                                                   "render_grad", "render_coverage", "render_fresnel",
+                                                                                   "render_diffraction", "r_calls"
+                                                                                 };
+
+/// names of the counters, as written to the JSON summary
+static const array<string, static_cast<size_t>(COUNTER::N_COUNTERS)> COUNTER_NAMES { "interpolated_value"s, "ll_from_bd"s, "grid_float_errors"s, "bytes_read"s,
+                                                                                     "tile_demotions"s, "tile_promotions"s, "block_cache_hits"s, "block_cache_misses"s,
+                                                                                     "area_value"s, "area_samples"s };
+
+/*! \brief      The name of a phase
+    \param  p   the phase
+    \return     the name of <i>p</i>, as used in the JSON summary and in traces
+*/
+const char* phase_name(const PHASE p)
+  { return PHASE_NAMES[static_cast<size_t>(p)]; }
+
+// -----------  phase_profiler ----------------
+
+/*! \class  phase_profiler
+    \brief  Accumulate wall and CPU time per phase, and counts of events
+*/
+
+/// constructor
+phase_profiler::phase_profiler(void)
+{ reset(); }
+
+/*! \brief          Add time to a phase
+    \param  p       the phase
+    \param  wall_ns wall time, in ns
+    \param  cpu_ns  CPU time, in ns
+*/
+void phase_profiler::add(const PHASE p, const uint64_t wall_ns, const uint64_t cpu_ns)
+{ const size_t n { static_cast<size_t>(p) };
+
+  _wall_ns[n].fetch_add(wall_ns, memory_order_relaxed);
+  _cpu_ns[n].fetch_add(cpu_ns, memory_order_relaxed);
+  _calls[n].fetch_add(1, memory_order_relaxed);
+}
+
+/// reset all the accumulators to zero
+void phase_profiler::reset(void)
+{ for (size_t n = 0; n < N_PHASES; ++n)
+  { _wall_ns[n] = 0;
+    _cpu_ns[n] = 0;
+    _calls[n] = 0;
+  }
+
+  for (auto& counter : _counters)
+    counter = 0;
+}
+
+/*! \brief                  Summarise the accumulated values as a JSON object
+    \param  radius          the radius of the plot, in metres
+    \param  peak_rss        peak resident set size, in bytes
+    \return                 the summary
+*/
+const string phase_profiler::to_json(const double radius, const uint64_t peak_rss) const
+{ constexpr double NS_PER_S { 1e9 };
+
+  string rv { "{ \"radius_m\": "s + to_string(radius) + ",\n  \"phases\": {\n"s };
+
+  for (size_t n = 0; n < N_PHASES; ++n)
+  { rv += "    \""s + PHASE_NAMES[n] + "\": { \"wall_s\": "s + to_string(_wall_ns[n] / NS_PER_S) +
+          ", \"cpu_s\": "s + to_string(_cpu_ns[n] / NS_PER_S) + ", \"calls\": "s + to_string(_calls[n]) + " }"s;
+    rv += ( (n == N_PHASES - 1) ? "\n"s : ",\n"s );
+  }
+
+  rv += "  },\n  \"counters\": {\n"s;
+
+  for (size_t n = 0; n < N_COUNTERS; ++n)
+  { rv += "    \""s + COUNTER_NAMES[n] + "\": "s + to_string(_counters[n]);
+    rv += ( (n == N_COUNTERS - 1) ? "\n"s : ",\n"s );
+  }
+
+  rv += "  },\n  \"peak_rss_bytes\": "s + to_string(peak_rss) + "\n}"s;
+
+  return rv;
+}
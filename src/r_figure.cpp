@@ -13,6 +13,7 @@
     Classes and functions related to R figures
 */
 
+#include "profile.h"
 #include "r_figure.h"
 
 #include <experimental/string_view>
@@ -66,7 +67,9 @@ void create_screens(RInside& R, const std::vector< std::array<float, 4>>& screen
     Copies the command to <i>cout</i> if <i>TRACE_R</i> is <i>true</i>
 */
 void execute_r(RInside& R, experimental::string_view cmd)
-{ if (TRACE_R)
+{ phase_timer r_timer(PHASE::R_CALLS);
+
+  if (TRACE_R)
     cout << "R cmd: " << cmd << endl;
 
   R.parseEval(static_cast<string>(cmd));
@@ -0,0 +1,187 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   rank.cpp
+
+    The rank of every value in a field, for plots whose colours follow the distribution of the values rather than the values themselves
+*/
+
+#include "rank.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <future>
+
+using namespace std;
+
+constexpr int RADIX_BITS    { 8 };                      ///< number of bits sorted in each pass
+constexpr int RADIX_BUCKETS { 1 << RADIX_BITS };        ///< number of buckets in each pass
+
+/*! \brief      A key whose unsigned order is the same as the order of a float
+    \param  v   the value
+    \return     the key
+
+    -0 and +0 have the same key
+*/
+static inline const uint32_t sortable_key(const float v)
+{ const float normalised { v + 0.0f };                  // -0 + 0 = +0
+  uint32_t    bits;
+
+  memcpy(&bits, &normalised, sizeof(bits));
+
+  return ( (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u) );
+}
+
+/*! \brief          The float that corresponds to a key
+    \param  key     the key
+    \return         the value whose key is <i>key</i>
+*/
+static inline const float value_from_key(const uint32_t key)
+{ const uint32_t bits { (key & 0x80000000u) ? (key & 0x7fffffffu) : ~key };
+  float          rv;
+
+  memcpy(&rv, &bits, sizeof(rv));
+
+  return rv;
+}
+
+/*! \brief                  Call a function once for each of several contiguous ranges, in parallel
+    \param  n_values        the total number of values
+    \param  n_threads       the number of ranges
+    \param  fn              function to call as fn(range number, first value, one past the last value)
+*/
+template <typename F>
+static void for_each_range(const size_t n_values, const unsigned int n_threads, F&& fn)
+{ const size_t range_size { (n_values + n_threads - 1) / n_threads };
+
+  vector<future<void>> vec_futures;
+
+  for (unsigned int n = 0; n < n_threads; ++n)
+  { const size_t first { min(n * range_size, n_values) };
+    const size_t last  { min(first + range_size, n_values) };
+
+    vec_futures.emplace_back(async(launch::async, [&fn, n, first, last](void) { fn(n, first, last); }));
+  }
+
+  for (auto& this_future : vec_futures)
+    this_future.get();                                  // .get() blocks until the future is available
+}
+
+/*! \brief                  Rank the values in a field
+    \param  field           the field, indexed as [row][column]; all rows must be the same length
+    \param  max_index       the scaled rank of the highest value
+    \param  n_quantiles     the number of quantiles to return (at least two)
+    \param  n_threads       the number of threads to use
+    \return                 the scaled ranks and the quantiles
+*/
+const field_ranks rank_field(const vector<vector<float>>& field, const int max_index, const int n_quantiles, const unsigned int n_threads)
+{ field_ranks rv;
+
+  const size_t n_rows    { field.size() };
+  const size_t n_columns { field.empty() ? 0 : field[0].size() };
+  const size_t n_values  { n_rows * n_columns };
+
+  rv.index.assign(n_rows, vector<int>(n_columns, 0));
+
+  if (n_values == 0)
+    return rv;
+
+  const unsigned int n_ranges { static_cast<unsigned int>(min<size_t>(max(n_threads, 1u), n_values)) };
+
+// the key is in the top 32 bits, the cell number in the bottom 32 bits
+  vector<uint64_t> keys(n_values);
+  vector<uint64_t> buffer(n_values);
+
+  for_each_range(n_values, n_ranges, [&](const unsigned int, const size_t first, const size_t last)
+    { for (size_t n = first; n < last; ++n)
+        keys[n] = (static_cast<uint64_t>(sortable_key(field[n / n_columns][n % n_columns])) << 32) | n;
+    });
+
+// LSD radix sort of the top 32 bits; each pass is stable, so the cell numbers need not be sorted
+  vector<array<size_t, RADIX_BUCKETS>> counts(n_ranges);
+
+  for (int shift = 32; shift < 64; shift += RADIX_BITS)
+  { for_each_range(n_values, n_ranges, [&](const unsigned int range, const size_t first, const size_t last)
+      { auto& count { counts[range] };
+
+        count.fill(0);
+
+        for (size_t n = first; n < last; ++n)
+          count[(keys[n] >> shift) & (RADIX_BUCKETS - 1)]++;
+      });
+
+// if every key is in the same bucket, this pass would not change the order
+    bool trivial { false };
+
+    for (int bucket = 0; !trivial and (bucket < RADIX_BUCKETS); ++bucket)
+    { size_t total { 0 };
+
+      for (const auto& count : counts)
+        total += count[bucket];
+
+      trivial = (total == n_values);
+    }
+
+    if (trivial)
+      continue;
+
+// convert the counts to the position at which each range starts writing each bucket
+    size_t posn { 0 };
+
+    for (int bucket = 0; bucket < RADIX_BUCKETS; ++bucket)
+    { for (auto& count : counts)
+      { const size_t n { count[bucket] };
+
+        count[bucket] = posn;
+        posn += n;
+      }
+    }
+
+    for_each_range(n_values, n_ranges, [&](const unsigned int range, const size_t first, const size_t last)
+      { auto& next { counts[range] };
+
+        for (size_t n = first; n < last; ++n)
+          buffer[next[(keys[n] >> shift) & (RADIX_BUCKETS - 1)]++] = keys[n];
+      });
+
+    keys.swap(buffer);
+  }
+
+// scatter the ranks; the rank of a value is the position of the first value equal to it
+  const double denominator { static_cast<double>(max(n_values - 1, static_cast<size_t>(1))) };
+
+  for_each_range(n_values, n_ranges, [&](const unsigned int, const size_t first, const size_t last)
+    { if (first == last)
+        return;
+
+      auto key_less = [](const uint64_t a, const uint64_t b) { return ( (a >> 32) < (b >> 32) ); };
+
+      size_t   run_start { static_cast<size_t>(lower_bound(keys.cbegin(), keys.cbegin() + first, keys[first], key_less) - keys.cbegin()) };
+      uint64_t run_key   { keys[first] >> 32 };
+
+      for (size_t n = first; n < last; ++n)
+      { if ( (keys[n] >> 32) != run_key )
+        { run_start = n;
+          run_key = (keys[n] >> 32);
+        }
+
+        const size_t cell { static_cast<size_t>(keys[n] & 0xffffffffu) };
+
+        rv.index[cell / n_columns][cell % n_columns] = static_cast<int>( ((run_start * 1.0) / denominator) * max_index );
+      }
+    });
+
+  for (int n = 0; n < n_quantiles; ++n)
+  { const size_t posn { static_cast<size_t>( ((n * 1.0) / max(n_quantiles - 1, 1)) * (n_values - 1)) };
+
+    rv.quantiles.push_back(value_from_key(static_cast<uint32_t>(keys[posn] >> 32)));
+  }
+
+  return rv;
+}
@@ -0,0 +1,290 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   site_search.cpp
+
+    Score many candidate QTHs in parallel, so that the best of them can be chosen for full plots
+*/
+
+#include "diskfile.h"
+#include "site_search.h"
+#include "string_functions.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+
+using namespace std;
+
+/// the values along a bearing that are the same for every site
+struct range_entry
+{ double distance;          ///< distance from the site along the curved surface, in metres
+  double cos_factor;        ///< cos(distance / RE)
+  double correction;        ///< curvature_correction(distance)
+};
+
+/*! \brief              Is a bearing within a sector?
+    \param  b           the bearing, in degrees
+    \param  start       first bearing of the sector, in degrees
+    \param  end         bearing at the end of the sector, in degrees
+    \return             whether <i>b</i> is in the sector [<i>start</i>, <i>end</i>)
+
+    The sector may include north; e.g., start = 300, end = 60
+*/
+static inline const bool in_sector(const double b, const double start, const double end)
+{ if (end - start >= 360)
+    return true;
+
+  return ( (start <= end) ? ( (b >= start) and (b < end) ) : ( (b >= start) or (b < end) ) );
+}
+
+/*! \brief              Score one site
+    \param  tiles       the tiles that contain the area around the site
+    \param  site        the site
+    \param  req         the parameters of the search
+    \param  ranges      the distance, cosine factor and curvature correction at each sample along a bearing
+    \return             the scores of <i>site</i>
+
+    Each sample along a bearing stands for an annulus of area proportional to its distance, so the MHAT and the visible fraction
+    are weighted by distance. A sample is visible if its elevation angle is greater than that of every sample nearer to the site.
+*/
+static const site_score score_site(const tile_map& tiles, const site_candidate& site, const site_search_request& req, const vector<range_entry>& ranges)
+{ const trace_scope site_trace("score site");
+
+  site_score rv { site };
+
+  try
+  { rv.raw_height = tiles.at(llc(site.qth)).interpolated_value(site.qth);
+  }
+
+  catch (...)                       // NODATA, or outside the tiles
+  { return rv;
+  }
+
+  if (rv.raw_height <= -9000)
+    return rv;
+
+  const double eye { rv.raw_height + req.antenna_height };
+
+  double sum_horizon     { 0 };
+  int    n_horizon       { 0 };
+  double sum_height      { 0 };     // weighted by distance
+  double sum_weight      { 0 };
+  double visible_weight  { 0 };
+
+  for (int bearing = 0; bearing < 360; ++bearing)
+  { float max_angle { numeric_limits<float>::lowest() };      // in radians
+
+    for (const range_entry& r : ranges)
+    { const pair<double, double> ll { ll_from_bd(site.qth, bearing, r.distance) };
+
+      float raw_value { -9999 };
+
+      try
+      { raw_value = tiles.at(llc(ll)).interpolated_value(ll);
+      }
+
+      catch (...)                   // NODATA, or outside the tiles
+      { }
+
+      if (raw_value <= -9000)
+        continue;
+
+      const float angle { elevation_angle(site.qth, ll, eye, raw_value) };
+
+      sum_height += (raw_value * r.cos_factor - r.correction) * r.distance;
+      sum_weight += r.distance;
+
+      if (angle > max_angle)
+        visible_weight += r.distance;
+
+      max_angle = max(max_angle, angle);
+    }
+
+    if (in_sector(bearing, req.sector_start, req.sector_end) and (max_angle != numeric_limits<float>::lowest()))
+    { sum_horizon += max_angle * RTOD;
+      n_horizon++;
+    }
+  }
+
+  rv.valid = (sum_weight > 0);
+  rv.mean_horizon = (n_horizon ? static_cast<float>(sum_horizon / n_horizon) : 0);
+  rv.mhat = (rv.valid ? static_cast<float>(eye - sum_height / sum_weight) : 0);
+  rv.visible_fraction = (rv.valid ? static_cast<float>(visible_weight / sum_weight) : 0);
+
+  return rv;
+}
+
+/*! \brief              Read candidate sites from a file
+    \param  filename    name of the file
+    \return             the candidates in the file
+
+    Each non-empty line contains the name, latitude and longitude of a site, separated by white space (the format of the QTH database).
+    Throws site_search_error if the file cannot be read.
+*/
+const vector<site_candidate> read_site_candidates(const string& filename)
+{ if (!file_exists(filename))
+    throw site_search_error(SITE_SEARCH_FILE_ERROR, "File of candidate sites does not exist: "s + filename);
+
+  vector<site_candidate> rv;
+
+  for (const string& line : squash(to_lines(read_file(filename)), ' '))
+  { const vector<string> fields { split_string(remove_peripheral_spaces(line), ' ') };
+
+    if (fields.size() >= 3)
+      rv.push_back( { fields[0], { from_string<double>(fields[1]), -abs(from_string<double>(fields[2])) } } );     // longitude is always west
+  }
+
+  return rv;
+}
+
+/*! \brief          Candidate sites on a regular grid
+    \param  south   southern edge of the area, in degrees
+    \param  west    western edge of the area, in degrees
+    \param  north   northern edge of the area, in degrees
+    \param  east    eastern edge of the area, in degrees
+    \param  step    distance between adjacent candidates, in metres
+    \return         the candidates, from SW to NE, named by their row and column
+*/
+const vector<site_candidate> grid_site_candidates(const double south, const double west, const double north, const double east, const double step)
+{ const double lat_step  { step / (RE * DTOR) };
+  const double long_step { lat_step / cos( ((south + north) / 2) * DTOR ) };
+  const int    n_rows    { static_cast<int>(floor( (north - south) / lat_step )) + 1 };
+  const int    n_columns { static_cast<int>(floor( (east - west) / long_step )) + 1 };
+
+  vector<site_candidate> rv;
+
+  rv.reserve(static_cast<size_t>(n_rows) * n_columns);
+
+  for (int row = 0; row < n_rows; ++row)
+    for (int column = 0; column < n_columns; ++column)
+      rv.push_back( { "r"s + to_string(row) + "c"s + to_string(column), { south + row * lat_step, west + column * long_step } } );
+
+  return rv;
+}
+
+/*! \brief              The tiles needed to score a set of candidates
+    \param  candidates  the candidate sites
+    \param  radius      radius around each site over which it is scored, in metres
+    \return             the lat-long codes of the tiles that contain the area within <i>radius</i> of any candidate
+*/
+const set<int> site_search_tiles(const vector<site_candidate>& candidates, const double radius)
+{ set<int> rv;
+
+  for (const site_candidate& site : candidates)
+  { const double latitude   { site.qth.first };
+    const double longitude  { site.qth.second };
+    const double delta_lat  { radius / (RE * DTOR) };
+    const double delta_long { delta_lat / cos(latitude * DTOR) };
+
+    for (int south = static_cast<int>(floor(latitude - delta_lat)); south <= static_cast<int>(floor(latitude + delta_lat)); ++south)
+      for (int west = static_cast<int>(floor(longitude - delta_long)); west <= static_cast<int>(floor(longitude + delta_long)); ++west)
+        rv.insert(llc(south + 0.5, west + 0.5));
+  }
+
+  return rv;
+}
+
+/*! \brief              Score candidate sites, in parallel
+    \param  tiles       the tiles that contain the areas around the sites
+    \param  candidates  the candidate sites
+    \param  req         the parameters of the search
+    \param  n_threads   the number of threads to use
+    \return             the scores of all the sites, best first according to <i>req.rank_by</i>; sites without valid terrain are last
+
+    The distances along a bearing, and their curvature corrections, are calculated once and shared by all the sites. Thread <i>n</i>
+    (wrt 0) scores every <i>n_threads</i>th site, starting with site <i>n</i>.
+*/
+const vector<site_score> search_sites(const tile_map& tiles, const vector<site_candidate>& candidates, const site_search_request& req, const unsigned int n_threads)
+{ vector<range_entry> ranges;
+
+  for (int range_nr = 1; range_nr * req.range_step <= req.radius; ++range_nr)
+  { const double distance { range_nr * req.range_step };
+
+    ranges.push_back( { distance, cos(distance / RE), curvature_correction(distance) } );
+  }
+
+  vector<site_score> rv(candidates.size());
+
+  auto score_sites = [&](const int start)
+    { for (size_t n = start; n < candidates.size(); n += n_threads)
+        rv[n] = score_site(tiles, candidates[n], req, ranges);          // each element is written by only one thread
+    };
+
+  vector<future<void>> vec_futures;
+
+  for (int start = 0; start < static_cast<int>(n_threads); ++start)
+    vec_futures.emplace_back(async(launch::async, score_sites, start));
+
+  for (auto& this_future : vec_futures)
+    this_future.get();                                  // .get() blocks until the future is available
+
+  auto better = [&req](const site_score& a, const site_score& b)
+    { if (a.valid != b.valid)
+        return a.valid;
+
+      switch (req.rank_by)
+      { case SITE_SCORE::HORIZON :
+          return (a.mean_horizon < b.mean_horizon);
+
+        case SITE_SCORE::MHAT :
+          return (a.mhat > b.mhat);
+
+        case SITE_SCORE::VISIBLE :
+        default :
+          return (a.visible_fraction > b.visible_fraction);
+      }
+    };
+
+  stable_sort(rv.begin(), rv.end(), better);
+
+  return rv;
+}
+
+/*! \brief          Convert a name to a score
+    \param  name    name of the score: "hzn", "mhat" or "visible"
+    \return         the score called <i>name</i>
+
+    Throws site_search_error if <i>name</i> is not recognised
+*/
+const SITE_SCORE site_score_from_name(const string& name)
+{ const string lower_name { to_lower(name) };
+
+  if (lower_name == "hzn"s)
+    return SITE_SCORE::HORIZON;
+
+  if (lower_name == "mhat"s)
+    return SITE_SCORE::MHAT;
+
+  if (lower_name == "visible"s)
+    return SITE_SCORE::VISIBLE;
+
+  throw site_search_error(SITE_SEARCH_UNKNOWN_SCORE, "Unknown score: "s + name);
+}
+
+/*! \brief          Convert site scores to CSV
+    \param  scores  the scores
+    \return         the scores, one site per line after a header line
+*/
+const string site_scores_to_csv(const vector<site_score>& scores)
+{ string rv { "rank,name,latitude,longitude,height_m,mean_horizon_deg,mhat_m,visible_fraction\n"s };
+
+  for (size_t n = 0; n < scores.size(); ++n)
+  { const site_score& s { scores[n] };
+
+    rv += to_string(n + 1) + ","s + s.site.name + ","s + to_string(s.site.qth.first, 6) + ","s + to_string(s.site.qth.second, 6) + ","s;
+
+    if (s.valid)
+      rv += to_string(s.raw_height, 1) + ","s + to_string(s.mean_horizon, 3) + ","s + to_string(s.mhat, 1) + ","s + to_string(s.visible_fraction, 4) + "\n"s;
+    else
+      rv += ",,,\n"s;
+  }
+
+  return rv;
+}
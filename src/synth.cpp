@@ -0,0 +1,271 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   synth.cpp
+
+    Deterministic synthetic terrain, written as USGS-style GridFloat tiles
+*/
+
+#include "grid_float.h"
+#include "string_functions.h"
+#include "synth.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+constexpr double HOLE_BLOCK_SIZE { 0.1 };             ///< size of the square blocks, in degrees, each of which may contain a single hole
+
+/*! \brief      Mix the bits of a 64-bit value
+    \param  x   value to mix
+    \return     well-mixed version of <i>x</i>
+
+    The finaliser of splitmix64
+*/
+static inline uint64_t mix64(uint64_t x)
+{ x ^= (x >> 30);
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= (x >> 27);
+  x *= 0x94d049bb133111ebULL;
+  x ^= (x >> 31);
+
+  return x;
+}
+
+/*! \brief      Smoothstep
+    \param  t   value in the range [0, 1]
+    \return     3t² - 2t³
+*/
+static inline double smoothstep(const double t)
+  { return (t * t * (3 - 2 * t)); }
+
+// -----------  synthetic_terrain ----------------
+
+/*! \class  synthetic_terrain
+    \brief  A deterministic height field, defined for every latitude and longitude
+*/
+
+/*! \brief          Pseudo-random value associated with a lattice point
+    \param  ix      x lattice coordinate
+    \param  iy      y lattice coordinate
+    \param  octave  octave (or other discriminator)
+    \return         value in the range [0, 1)
+*/
+const double synthetic_terrain::_lattice_value(const int64_t ix, const int64_t iy, const int octave) const
+{ const uint64_t h { mix64(_seed ^ mix64(static_cast<uint64_t>(ix) ^ mix64(static_cast<uint64_t>(iy) ^ mix64(static_cast<uint64_t>(octave))))) };
+
+  return ( (h >> 11) * (1.0 / 9007199254740992.0) );      // 53 bits -> [0, 1)
+}
+
+/*! \brief              Smoothly-interpolated value noise
+    \param  x           x coordinate, in lattice units
+    \param  y           y coordinate, in lattice units
+    \param  octave      octave (or other discriminator)
+    \return             value in the range [0, 1)
+*/
+const double synthetic_terrain::_value_noise(const double x, const double y, const int octave) const
+{ const double  fx { floor(x) };
+  const double  fy { floor(y) };
+  const int64_t ix { static_cast<int64_t>(fx) };
+  const int64_t iy { static_cast<int64_t>(fy) };
+  const double  tx { smoothstep(x - fx) };
+  const double  ty { smoothstep(y - fy) };
+
+  const double v00 { _lattice_value(ix,     iy,     octave) };
+  const double v10 { _lattice_value(ix + 1, iy,     octave) };
+  const double v01 { _lattice_value(ix,     iy + 1, octave) };
+  const double v11 { _lattice_value(ix + 1, iy + 1, octave) };
+
+  const double v0 { v00 + (v10 - v00) * tx };
+  const double v1 { v01 + (v11 - v01) * tx };
+
+  return (v0 + (v1 - v0) * ty);
+}
+
+/*! \brief              Fractal Brownian motion
+    \param  x           x coordinate, in lattice units of the lowest octave
+    \param  y           y coordinate, in lattice units of the lowest octave
+    \param  n_octaves   number of octaves to sum
+    \param  octave_base discriminator of the lowest octave
+    \return             value in the range [0, 1)
+*/
+const double synthetic_terrain::_fbm(const double x, const double y, const int n_octaves, const int octave_base) const
+{ double rv        { 0 };
+  double amplitude { 0.5 };
+  double frequency { 1 };
+  double total     { 0 };
+
+  for (int n = 0; n < n_octaves; ++n)
+  { rv += amplitude * _value_noise(x * frequency, y * frequency, octave_base + n);
+    total += amplitude;
+    amplitude *= 0.5;
+    frequency *= 2;
+  }
+
+  return (rv / total);
+}
+
+/*! \brief              Is a point inside a NODATA hole?
+    \param  latitude    latitude of point
+    \param  longitude   longitude of point
+    \return             whether the point at <i>latitude</i>, <i>longitude</i> has no data
+
+    Each block of HOLE_BLOCK_SIZE × HOLE_BLOCK_SIZE degrees contains at most one circular hole,
+    which lies entirely within the block
+*/
+const bool synthetic_terrain::_in_hole(const double latitude, const double longitude) const
+{ if (_hole_probability <= 0)
+    return false;
+
+  const int64_t bx { static_cast<int64_t>(floor(longitude / HOLE_BLOCK_SIZE)) };
+  const int64_t by { static_cast<int64_t>(floor(latitude / HOLE_BLOCK_SIZE)) };
+
+  if (_lattice_value(bx, by, -1) >= _hole_probability)
+    return false;
+
+  const double radius    { HOLE_BLOCK_SIZE * (0.02 + 0.28 * _lattice_value(bx, by, -2)) };
+  const double centre_x  { (bx * HOLE_BLOCK_SIZE) + radius + (HOLE_BLOCK_SIZE - 2 * radius) * _lattice_value(bx, by, -3) };
+  const double centre_y  { (by * HOLE_BLOCK_SIZE) + radius + (HOLE_BLOCK_SIZE - 2 * radius) * _lattice_value(bx, by, -4) };
+  const double dx        { longitude - centre_x };
+  const double dy        { latitude - centre_y };
+
+  return ( (dx * dx + dy * dy) < (radius * radius) );
+}
+
+/*! \brief              Height at a point
+    \param  latitude    latitude of point
+    \param  longitude   longitude of point
+    \return             the height, in metres, at <i>latitude</i>, <i>longitude</i>; SYNTH_NODATA if there are no data at the point
+
+    Heights are always well above 1m, so that no valid height is mistaken for NODATA
+*/
+const float synthetic_terrain::height(const double latitude, const double longitude) const
+{ constexpr double MOUNTAIN_SCALE { 0.05 };      // degrees per lattice unit of the lowest octave; the 10th octave is about one ⅓″ cell
+  constexpr double PLAINS_SCALE   { 0.2 };
+  constexpr double COAST_SCALE    { 0.5 };
+
+  if (_in_hole(latitude, longitude))
+    return SYNTH_NODATA;
+
+  auto mountains = [=](void)
+    { const double f { _fbm(longitude / MOUNTAIN_SCALE, latitude / MOUNTAIN_SCALE, 10, 0) };
+
+      return (1500 + 3000 * f * f);
+    };
+
+  auto plains = [=](void)
+    { return (300 + 20 * _fbm(longitude / PLAINS_SCALE, latitude / PLAINS_SCALE, 4, 20)); };
+
+  switch (_terrain)
+  { case SYNTH_TERRAIN::MOUNTAINS :
+      return mountains();
+
+    case SYNTH_TERRAIN::PLAINS :
+      return plains();
+
+    case SYNTH_TERRAIN::MIXED :
+    default :
+    { const double mask { _fbm(longitude / COAST_SCALE, latitude / COAST_SCALE, 6, 40) };
+      const double t    { smoothstep(min(max((mask - 0.45) / 0.1, 0.0), 1.0)) };        // 0 => plains; 1 => mountains
+
+      if (t == 0)
+        return plains();
+
+      if (t == 1)
+        return mountains();
+
+      return ( (1 - t) * plains() + t * mountains() );
+    }
+  }
+}
+
+/*! \brief                      Write a synthetic tile
+    \param  terrain             the terrain
+    \param  llcode              the llcode [lat * 1000 + (+ve)long] of the tile
+    \param  directory           directory into which the header and data files are written
+    \param  cells_per_degree    number of cells per degree of latitude or longitude
+    \return                     number of NODATA cells in the tile
+
+    The header and data files are named and laid out exactly as a USGS ⅓″ tile, including the
+    overlap of USGS_TILE_OVERLAP cells on each side. Like grid_float_tile, assumes a little-endian host.
+*/
+const uint64_t write_synthetic_tile(const synthetic_terrain& terrain, const int llcode, const string& directory, const int cells_per_degree)
+{ const int    north_edge { llcode / 1000 };
+  const int    west_edge  { -(llcode % 1000) };
+  const int    n_cells    { cells_per_degree + 2 * USGS_TILE_OVERLAP };
+  const double cellsize   { 1.0 / cells_per_degree };
+  const double xllcorner  { west_edge - USGS_TILE_OVERLAP * cellsize };
+  const double yllcorner  { (north_edge - 1) - USGS_TILE_OVERLAP * cellsize };
+
+// header
+  { ostringstream header;
+
+    header << setprecision(14)
+           << "ncols         " << n_cells << EOL
+           << "nrows         " << n_cells << EOL
+           << "xllcorner     " << xllcorner << EOL
+           << "yllcorner     " << yllcorner << EOL
+           << "cellsize      " << cellsize << EOL
+           << "NODATA_value  " << static_cast<int>(SYNTH_NODATA) << EOL
+           << "byteorder     LSBFIRST" << EOL;
+
+    write_file(header.str(), local_header_filename(llcode, directory));
+  }
+
+// data, from the top row down
+  const string data_filename { local_data_filename(llcode, directory) };
+
+  ofstream ofs(data_filename, ofstream::binary);
+
+  if (!ofs)
+    throw synth_error(SYNTH_WRITE_ERROR, "Cannot open "s + data_filename);
+
+  vector<float> row(n_cells);
+  uint64_t      rv { 0 };
+
+  for (int r = 0; r < n_cells; ++r)
+  { const double latitude { yllcorner + (n_cells - r - 0.5) * cellsize };
+
+    for (int c = 0; c < n_cells; ++c)
+    { row[c] = terrain.height(latitude, xllcorner + (c + 0.5) * cellsize);
+
+      if (row[c] == SYNTH_NODATA)
+        rv++;
+    }
+
+    ofs.write(reinterpret_cast<const char*>(row.data()), n_cells * sizeof(float));
+  }
+
+  if (!ofs)
+    throw synth_error(SYNTH_WRITE_ERROR, "Error writing "s + data_filename);
+
+  return rv;
+}
+
+/*! \brief          Convert a name to a kind of synthetic terrain
+    \param  name    name of the terrain: "mountains", "plains" or "mixed"
+    \return         the kind of terrain called <i>name</i>
+
+    Throws synth_error if <i>name</i> is not recognised
+*/
+const SYNTH_TERRAIN synth_terrain_from_name(const string& name)
+{ const string lower_name { to_lower(name) };
+
+  if (lower_name == "mountains"s)
+    return SYNTH_TERRAIN::MOUNTAINS;
+
+  if (lower_name == "plains"s)
+    return SYNTH_TERRAIN::PLAINS;
+
+  if (lower_name == "mixed"s)
+    return SYNTH_TERRAIN::MIXED;
+
+  throw synth_error(SYNTH_UNKNOWN_TERRAIN, "Unknown terrain: "s + name);
+}
@@ -0,0 +1,230 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   terrain_profile.cpp
+
+    Terrain profiles along great-circle paths from the QTH
+*/
+
+#include "string_functions.h"
+#include "terrain_profile.h"
+#include "trace.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <type_traits>
+
+using namespace std;
+
+/*! \brief              The distances of the samples along a path
+    \param  distance    length of the path, in metres
+    \param  step        distance between samples, in metres
+    \return             zero, every multiple of <i>step</i> less than <i>distance</i>, and <i>distance</i>
+*/
+static const vector<double> sample_distances(const double distance, const double step)
+{ vector<double> rv { 0 };
+
+  for (int n = 1; n * step < distance; ++n)
+    rv.push_back(n * step);
+
+  if (distance > 0)
+    rv.push_back(distance);
+
+  return rv;
+}
+
+/*! \brief              Extract the terrain along one path
+    \param  tiles       the tiles that contain the path
+    \param  qth         latitude and longitude of the QTH
+    \param  eye_height  height of the antenna above the geoid (terrain plus antenna), in metres
+    \param  path        the path
+    \param  step        distance between samples along the path, in metres
+    \return             the profile along <i>path</i>
+*/
+static const terrain_profile extract_profile(const tile_map& tiles, const pair<double, double>& qth, const double eye_height, const profile_path& path, const double step)
+{ const trace_scope path_trace("profile path");
+
+  terrain_profile rv { path, { } };
+
+  const vector<double> distances { sample_distances(path.distance, step) };
+
+  rv.samples.reserve(distances.size());
+
+  for (const double distance : distances)
+  { const pair<double, double> ll { ll_from_bd(qth, path.bearing, distance) };
+
+    float raw_value { -9999 };        // default value is NODATA
+
+    try
+    { raw_value = tiles.at(llc(ll)).interpolated_value(ll);                 // height per USGS
+    }
+
+    catch (...)                       // NODATA, or outside the tiles
+    { }
+
+    const bool  valid { raw_value > -9000 };
+    const float angle { (distance == 0) ? -90.0f : static_cast<float>(elevation_angle(qth, ll, eye_height, raw_value) * RTOD) };   // straight down at the QTH
+
+    rv.samples.push_back( { static_cast<float>(distance), raw_value,
+                            (valid ? static_cast<float>(raw_value * cos(distance / RE) - curvature_correction(distance)) : -9999.0f),
+                            (valid ? angle : -9999.0f) } );
+  }
+
+  return rv;
+}
+
+/*! \brief              The paths from the QTH to some targets
+    \param  qth         latitude and longitude of the QTH
+    \param  targets     the targets
+    \return             the path to each target, in the same order as <i>targets</i>
+*/
+const vector<profile_path> target_paths(const pair<double, double>& qth, const vector<site_candidate>& targets)
+{ vector<profile_path> rv;
+
+  for (const site_candidate& target : targets)
+  { const pair<double, double> bd { bd_from_ll(qth, target.qth) };
+
+    rv.push_back( { target.name, bd.first, bd.second } );
+  }
+
+  return rv;
+}
+
+/*! \brief              Evenly spaced paths from the QTH
+    \param  n_bearings  number of bearings
+    \param  distance    length of each path, in metres
+    \return             paths of length <i>distance</i> along the bearings 0, 360 / <i>n_bearings</i>, ... degrees, named by their bearings
+*/
+const vector<profile_path> bearing_paths(const int n_bearings, const double distance)
+{ vector<profile_path> rv;
+
+  for (int n = 0; n < n_bearings; ++n)
+  { const double bearing { (n * 360.0) / n_bearings };
+
+    rv.push_back( { to_string(bearing, 2), bearing, distance } );
+  }
+
+  return rv;
+}
+
+/*! \brief              The tiles needed for some paths
+    \param  qth         latitude and longitude of the QTH
+    \param  paths       the paths
+    \param  step        distance between samples along each path, in metres
+    \return             the lat-long codes of the tiles that contain any sample
+*/
+const set<int> profile_tiles(const pair<double, double>& qth, const vector<profile_path>& paths, const double step)
+{ set<int> rv { llc(qth) };
+
+  for (const profile_path& path : paths)
+    for (const double distance : sample_distances(path.distance, step))
+      rv.insert(llc(ll_from_bd(qth, path.bearing, distance)));
+
+  return rv;
+}
+
+/*! \brief                  Extract the terrain along some paths, in parallel
+    \param  tiles           the tiles that contain the paths
+    \param  qth             latitude and longitude of the QTH
+    \param  eye_height      height of the antenna above the geoid (terrain plus antenna), in metres
+    \param  paths           the paths
+    \param  step            distance between samples along each path, in metres
+    \param  n_threads       the number of threads to use
+    \return                 the profile along each path, in the same order as <i>paths</i>
+
+    Thread <i>n</i> (wrt 0) extracts every <i>n_threads</i>th path, starting with path <i>n</i>
+*/
+const vector<terrain_profile> extract_profiles(const tile_map& tiles, const pair<double, double>& qth, const double eye_height,
+                                               const vector<profile_path>& paths, const double step, const unsigned int n_threads)
+{ vector<terrain_profile> rv(paths.size());
+
+  auto extract_paths = [&](const int start)
+    { for (size_t n = start; n < paths.size(); n += n_threads)
+        rv[n] = extract_profile(tiles, qth, eye_height, paths[n], step);          // each element is written by only one thread
+    };
+
+  vector<future<void>> vec_futures;
+
+  for (int start = 0; start < static_cast<int>(n_threads); ++start)
+    vec_futures.emplace_back(async(launch::async, extract_paths, start));
+
+  for (auto& this_future : vec_futures)
+    this_future.get();                                  // .get() blocks until the future is available
+
+  return rv;
+}
+
+/*! \brief              Convert profiles to CSV
+    \param  profiles    the profiles
+    \return             one line per sample after a header line: name, bearing, distance, raw height, height, elevation angle
+*/
+const string profiles_to_csv(const vector<terrain_profile>& profiles)
+{ string rv { "name,bearing_deg,distance_m,raw_height_m,height_m,angle_deg\n"s };
+
+  for (const terrain_profile& profile : profiles)
+  { const string prefix { profile.path.name + ","s + to_string(profile.path.bearing, 3) + ","s };
+
+    for (const profile_sample& sample : profile.samples)
+      rv += prefix + to_string(sample.distance, 1) + ","s + to_string(sample.raw_height, 2) + ","s + to_string(sample.height, 2) + ","s + to_string(sample.angle, 4) + "\n"s;
+  }
+
+  return rv;
+}
+
+/*! \brief              Write profiles to a binary file
+    \param  profiles    the profiles
+    \param  filename    name of the file
+
+    Throws terrain_profile_error if the file cannot be written
+*/
+void write_profiles_binary(const vector<terrain_profile>& profiles, const string& filename)
+{ ofstream ofs(filename, ofstream::binary);
+
+  if (!ofs)
+    throw terrain_profile_error(TERRAIN_PROFILE_WRITE_ERROR, "Cannot open "s + filename);
+
+// write the bytes of a value least significant first, whatever the byte order of the host
+  auto put = [&ofs](const auto value)
+    { using bits_type = conditional_t<sizeof(value) == 8, uint64_t, conditional_t<sizeof(value) == 4, uint32_t, uint16_t>>;
+
+      static_assert(sizeof(bits_type) == sizeof(value));
+
+      bits_type bits;
+
+      memcpy(&bits, &value, sizeof(value));                  // the bit pattern of a float/double as well as of an integer
+
+      char bytes[sizeof(value)];
+
+      for (size_t n { 0 }; n < sizeof(value); ++n)
+        bytes[n] = static_cast<char>( (bits >> (8 * n)) & 0xff );
+
+      ofs.write(bytes, sizeof(value));
+    };
+
+  put(static_cast<uint32_t>(profiles.size()));
+
+  for (const terrain_profile& profile : profiles)
+  { put(static_cast<uint16_t>(profile.path.name.size()));
+    ofs.write(profile.path.name.data(), profile.path.name.size());
+    put(profile.path.bearing);
+    put(profile.path.distance);
+    put(static_cast<uint32_t>(profile.samples.size()));
+
+    for (const profile_sample& sample : profile.samples)
+    { put(sample.distance);
+      put(sample.raw_height);
+      put(sample.height);
+      put(sample.angle);
+    }
+  }
+
+  if (!ofs)
+    throw terrain_profile_error(TERRAIN_PROFILE_WRITE_ERROR, "Error writing "s + filename);
+}
@@ -0,0 +1,125 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   tile_governor.cpp
+
+    Move tiles between RAM, mapped files and disk according to the pressure on memory
+*/
+
+#include "tile_governor.h"
+
+#include <iostream>
+
+using namespace std;
+
+extern bool debug;
+
+// -----------  tile_governor ----------------
+
+/*! \class  tile_governor
+    \brief  Demote tiles (RAM -> MAPPED -> DISK) when memory is short, and promote them again when it is not
+*/
+
+/*! \brief                      Constructor
+    \param  mem_info            source of the memory information
+    \param  low_water           demote tiles if the available memory is less than this, in bytes
+    \param  high_water          promote a tile only if the available memory would remain above this, in bytes
+    \param  pressure_threshold  demote tiles if PSI "some avg10" exceeds this, in per cent
+*/
+tile_governor::tile_governor(memory_information& mem_info, const uint64_t low_water, const uint64_t high_water, const double pressure_threshold) :
+  _mem_info(mem_info),
+  _low_water(low_water),
+  _high_water(max(high_water, low_water)),
+  _pressure_threshold(pressure_threshold)
+{ }
+
+/*! \brief          Demote one tile by one step
+    \param  tiles   the tiles
+    \param  needed  the lat-long codes of the tiles needed for the current plot
+    \return         whether a tile was demoted
+
+    The order of preference is: unneeded tiles in RAM; needed tiles in RAM; unneeded mapped tiles; needed mapped tiles
+*/
+const bool tile_governor::_demote_one(tile_map& tiles, const set<int>& needed)
+{ for (const TILE_STORAGE from : { TILE_STORAGE::RAM, TILE_STORAGE::MAPPED })
+  { for (const bool want_needed : { false, true })
+    { for (auto& [ tile_llc, tile ] : tiles)
+      { if ( (tile.storage() == from) and ( (needed.count(tile_llc) == 1) == want_needed) )
+        { const TILE_STORAGE to { (from == TILE_STORAGE::RAM) ? TILE_STORAGE::MAPPED : TILE_STORAGE::DISK };
+
+          if (debug)
+            cout << "demoting tile " << base_filename(tile_llc) << " from " << storage_name(from) << " to " << storage_name(to) << endl;
+
+          tile.storage(to);
+          PROFILER.increment(COUNTER::TILE_DEMOTIONS);
+
+          return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+/*! \brief          Promote one needed tile by one step, if there is room
+    \param  tiles   the tiles
+    \param  needed  the lat-long codes of the tiles needed for the current plot
+    \return         whether a tile was promoted
+
+    Tiles on disk are mapped before any mapped tile is moved into RAM
+*/
+const bool tile_governor::_promote_one(tile_map& tiles, const set<int>& needed)
+{ const double pressure { _mem_info.memory_pressure() };
+
+  if (pressure > _pressure_threshold / 2)                   // some hysteresis
+    return false;
+
+  for (const TILE_STORAGE from : { TILE_STORAGE::DISK, TILE_STORAGE::MAPPED })
+  { for (auto& [ tile_llc, tile ] : tiles)
+    { if ( (tile.storage() == from) and (needed.count(tile_llc) == 1) )
+      { if (_mem_info.available(true) < _high_water + tile.data_bytes())
+          return false;
+
+        const TILE_STORAGE to { (from == TILE_STORAGE::DISK) ? TILE_STORAGE::MAPPED : TILE_STORAGE::RAM };
+
+        if (debug)
+          cout << "promoting tile " << base_filename(tile_llc) << " from " << storage_name(from) << " to " << storage_name(to) << endl;
+
+        tile.storage(to);
+        PROFILER.increment(COUNTER::TILE_PROMOTIONS);
+
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/*! \brief          Demote or promote tiles until the use of memory is acceptable
+    \param  tiles   the tiles
+    \param  needed  the lat-long codes of the tiles needed for the current plot
+
+    This function MUST NOT be called while another thread is reading from <i>tiles</i>.
+*/
+void tile_governor::rebalance(tile_map& tiles, const set<int>& needed)
+{ const trace_scope rebalance_trace("tile_governor::rebalance", "n_tiles", static_cast<int>(tiles.size()));
+
+  bool demoted { false };
+
+  while ( (_mem_info.available(true) < _low_water) and _demote_one(tiles, needed) )
+    demoted = true;
+
+// PSI is averaged over ten seconds, so it cannot reflect a demotion immediately; demote just one step per call
+  if (!demoted and (_mem_info.memory_pressure() > _pressure_threshold))
+    demoted = _demote_one(tiles, needed);
+
+  if (!demoted)                                             // don't promote what we have just demoted
+    while (_promote_one(tiles, needed))
+      ;
+}
@@ -0,0 +1,104 @@
+// Released under the GNU Public License, version 2
+
+// Principal author: N7DR
+
+// Copyright owners:
+//    N7DR
+
+/*! \file   trace.cpp
+
+    Per-thread event tracing, written in Chrome trace event format (readable by chrome://tracing and Perfetto)
+*/
+
+#include "trace.h"
+
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+using namespace   chrono;
+
+trace_recorder TRACER;                   ///< the trace recorder for the program
+
+static thread_local trace_buffer* this_thread_buffer_p { nullptr };    ///< the buffer for this thread; owned by TRACER
+
+// -----------  trace_recorder ----------------
+
+/*! \class  trace_recorder
+    \brief  Record timed events in per-thread buffers
+*/
+
+/// the buffer for the current thread; creates the buffer if necessary
+trace_buffer& trace_recorder::_this_thread_buffer(void)
+{ if (!this_thread_buffer_p)
+  { lock_guard<mutex> buffers_lock(_buffers_mutex);
+
+    _buffers.emplace_back(new trace_buffer { static_cast<int>(_buffers.size()), { } });
+    this_thread_buffer_p = _buffers.back().get();
+    this_thread_buffer_p -> events.reserve(4096);
+  }
+
+  return *this_thread_buffer_p;
+}
+
+/// enable the recorder; the time origin is the time of this call
+void trace_recorder::enable(void)
+{ _origin = steady_clock::now();
+  _enabled = true;
+
+  _this_thread_buffer();                // make sure that the thread that enables the recorder is tid 0
+}
+
+/*! \brief              Record a complete event for the current thread
+    \param  name        name of the event
+    \param  start       time at which the event started
+    \param  end         time at which the event ended
+    \param  arg_name    name of the optional argument (or nullptr)
+    \param  arg_value   value of the optional argument
+*/
+void trace_recorder::record(const char* name, const steady_clock::time_point& start, const steady_clock::time_point& end, const char* arg_name, const int64_t arg_value)
+{ if (_enabled)
+    _this_thread_buffer().events.push_back( { name, arg_name, arg_value, ns_since_origin(start), static_cast<uint64_t>(duration_cast<nanoseconds>(end - start).count()) } );
+}
+
+/*! \brief              Write all the recorded events to a file
+    \param  filename    name of the file
+
+    Must not be called while other threads may be recording events
+*/
+void trace_recorder::write(const string& filename)
+{ constexpr double NS_PER_US { 1000 };
+
+  ofstream ofs(filename);
+
+  ofs << fixed << setprecision(3);
+  ofs << "{ \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [\n";
+
+  bool first { true };
+
+  auto separator = [&first](void)
+    { const char* rv { (first ? "    " : ",\n    ") };
+
+      first = false;
+      return rv;
+    };
+
+  lock_guard<mutex> buffers_lock(_buffers_mutex);
+
+  for (const auto& bp : _buffers)
+  { ofs << separator() << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << bp -> tid
+        << ", \"args\": { \"name\": \"" << (bp -> tid ? ("thread "s + to_string(bp -> tid)) : "main"s) << "\" } }";
+
+    for (const auto& e : bp -> events)
+    { ofs << separator() << "{ \"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << bp -> tid
+          << ", \"ts\": " << (e.start_ns / NS_PER_US) << ", \"dur\": " << (e.duration_ns / NS_PER_US);
+
+      if (e.arg_name)
+        ofs << ", \"args\": { \"" << e.arg_name << "\": " << e.arg_value << " }";
+
+      ofs << " }";
+    }
+  }
+
+  ofs << "\n  ]\n}\n";
+}